@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DXT_USE_SSE2
+#endif
+
+#include "image.hpp"
+#include "dxtcompress.hpp"
+
+// Range fit encoder in the spirit of J.M.P. van Waveren's "Real-Time DXT Compression" :
+// the endpoints are the inset bounding box of the block's colors, and each pixel
+// takes the nearest of the four palette colors.
+
+size_t dxtCompressedSize(unsigned int width, unsigned int height, bool bc3){
+	return (size_t)((width+3)/4) * ((height+3)/4) * (bc3 ? 16 : 8);
+}
+
+// Copies a 4x4 block, repeating the last row/column past the edges of the image
+static void extractBlock(const unsigned char * rgba, unsigned int width, unsigned int height,
+	unsigned int bx, unsigned int by, unsigned char block[64]){
+	for (unsigned int y = 0; y < 4; y++){
+		unsigned int sy = std::min(by*4 + y, height-1);
+		for (unsigned int x = 0; x < 4; x++){
+			unsigned int sx = std::min(bx*4 + x, width-1);
+			memcpy(block + (y*4 + x)*4, rgba + ((size_t)sy*width + sx)*4, 4);
+		}
+	}
+}
+
+static unsigned short to565(const unsigned char * color){
+	return (unsigned short)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+}
+
+static void from565(unsigned short c, unsigned char * color){
+	unsigned int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	color[0] = (unsigned char)((r << 3) | (r >> 2));
+	color[1] = (unsigned char)((g << 2) | (g >> 4));
+	color[2] = (unsigned char)((b << 3) | (b >> 2));
+	color[3] = 255;
+}
+
+static void colorBoundingBox(const unsigned char block[64], unsigned char minColor[4], unsigned char maxColor[4]){
+#ifdef DXT_USE_SSE2
+	__m128i p0 = _mm_loadu_si128((const __m128i*)(block));
+	__m128i p1 = _mm_loadu_si128((const __m128i*)(block + 16));
+	__m128i p2 = _mm_loadu_si128((const __m128i*)(block + 32));
+	__m128i p3 = _mm_loadu_si128((const __m128i*)(block + 48));
+	__m128i mn = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+	__m128i mx = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+	// Reduce the 4 pixels left in each register
+	mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+	mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+	mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+	mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+	int minPacked = _mm_cvtsi128_si32(mn);
+	int maxPacked = _mm_cvtsi128_si32(mx);
+	memcpy(minColor, &minPacked, 4);
+	memcpy(maxColor, &maxPacked, 4);
+#else
+	memcpy(minColor, block, 4);
+	memcpy(maxColor, block, 4);
+	for (int i = 1; i < 16; i++){
+		for (int c = 0; c < 4; c++){
+			minColor[c] = std::min(minColor[c], block[i*4+c]);
+			maxColor[c] = std::max(maxColor[c], block[i*4+c]);
+		}
+	}
+#endif
+}
+
+// Returns the 2 bit palette index of each pixel, pixel 0 in the lowest bits
+static unsigned int colorIndices(const unsigned char block[64], const unsigned char palette[4][4]){
+	unsigned int indices = 0;
+#ifdef DXT_USE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+	__m128i colors[4];
+	for (int k = 0; k < 4; k++){
+		int packed;
+		memcpy(&packed, palette[k], 4);
+		colors[k] = _mm_unpacklo_epi8(_mm_and_si128(_mm_set1_epi32(packed), rgbMask), zero);
+	}
+
+	for (int group = 0; group < 4; group++){
+		__m128i pixels = _mm_and_si128(_mm_loadu_si128((const __m128i*)(block + group*16)), rgbMask);
+		__m128i lo = _mm_unpacklo_epi8(pixels, zero); // pixels 0 and 1, 16 bits per channel
+		__m128i hi = _mm_unpackhi_epi8(pixels, zero); // pixels 2 and 3
+
+		__m128i best = _mm_setzero_si128(), bestIndex = _mm_setzero_si128();
+		for (int k = 0; k < 4; k++){
+			__m128i dlo = _mm_sub_epi16(lo, colors[k]);
+			__m128i dhi = _mm_sub_epi16(hi, colors[k]);
+			// r*r+g*g and b*b+a*a per pixel, then add the two halves of each pixel
+			__m128 sqlo = _mm_castsi128_ps(_mm_madd_epi16(dlo, dlo));
+			__m128 sqhi = _mm_castsi128_ps(_mm_madd_epi16(dhi, dhi));
+			__m128i distance = _mm_add_epi32(
+				_mm_castps_si128(_mm_shuffle_ps(sqlo, sqhi, _MM_SHUFFLE(2, 0, 2, 0))),
+				_mm_castps_si128(_mm_shuffle_ps(sqlo, sqhi, _MM_SHUFFLE(3, 1, 3, 1))));
+
+			if (k == 0){
+				best = distance;
+				continue;
+			}
+			__m128i closer = _mm_cmplt_epi32(distance, best);
+			best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+			bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, bestIndex));
+		}
+
+		int index[4];
+		_mm_storeu_si128((__m128i*)index, bestIndex);
+		for (int i = 0; i < 4; i++)
+			indices |= (unsigned int)index[i] << (2 * (group*4 + i));
+	}
+#else
+	for (int i = 0; i < 16; i++){
+		int bestIndex = 0, best = 0x7FFFFFFF;
+		for (int k = 0; k < 4; k++){
+			int dr = block[i*4] - palette[k][0], dg = block[i*4+1] - palette[k][1], db = block[i*4+2] - palette[k][2];
+			int distance = dr*dr + dg*dg + db*db;
+			if (distance < best){
+				best = distance;
+				bestIndex = k;
+			}
+		}
+		indices |= (unsigned int)bestIndex << (2*i);
+	}
+#endif
+	return indices;
+}
+
+static void compressColorBlock(const unsigned char block[64], unsigned char * out){
+	unsigned char minColor[4], maxColor[4];
+	colorBoundingBox(block, minColor, maxColor);
+
+	// Pull the endpoints in by 1/16 of the range : the extremes are rarely the best fit
+	for (int c = 0; c < 3; c++){
+		int inset = (maxColor[c] - minColor[c]) >> 4;
+		minColor[c] = (unsigned char)std::min(255, minColor[c] + inset);
+		maxColor[c] = (unsigned char)std::max(0, maxColor[c] - inset);
+	}
+
+	unsigned short c0 = to565(maxColor), c1 = to565(minColor);
+	if (c0 < c1)
+		std::swap(c0, c1);
+	unsigned int indices = 0;
+	if (c0 != c1){ // c0 > c1 selects the 4 color mode
+		unsigned char palette[4][4];
+		from565(c0, palette[0]);
+		from565(c1, palette[1]);
+		for (int c = 0; c < 4; c++){
+			palette[2][c] = (unsigned char)((2*palette[0][c] + palette[1][c]) / 3);
+			palette[3][c] = (unsigned char)((palette[0][c] + 2*palette[1][c]) / 3);
+		}
+		indices = colorIndices(block, palette);
+	}
+
+	out[0] = (unsigned char)(c0 & 0xFF);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xFF);
+	out[3] = (unsigned char)(c1 >> 8);
+	for (int i = 0; i < 4; i++)
+		out[4+i] = (unsigned char)(indices >> (8*i));
+}
+
+static void compressAlphaBlock(const unsigned char block[64], unsigned char * out){
+	unsigned char a0 = 0, a1 = 255;
+	for (int i = 0; i < 16; i++){
+		a0 = std::max(a0, block[i*4+3]);
+		a1 = std::min(a1, block[i*4+3]);
+	}
+
+	// a0 > a1 selects the 8 value mode
+	unsigned long long indices = 0;
+	if (a0 != a1){
+		int palette[8] = { a0, a1 };
+		for (int k = 1; k <= 6; k++)
+			palette[k+1] = ((7-k)*a0 + k*a1) / 7;
+		for (int i = 0; i < 16; i++){
+			int bestIndex = 0, best = 256;
+			for (int k = 0; k < 8; k++){
+				int distance = abs(block[i*4+3] - palette[k]);
+				if (distance < best){
+					best = distance;
+					bestIndex = k;
+				}
+			}
+			indices |= (unsigned long long)bestIndex << (3*i);
+		}
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	for (int i = 0; i < 6; i++)
+		out[2+i] = (unsigned char)(indices >> (8*i));
+}
+
+static void compressBlockRows(const unsigned char * rgba, unsigned int width, unsigned int height, bool bc3,
+	unsigned char * out, unsigned int firstRow, unsigned int lastRow){
+	unsigned int blocksWide = (width+3)/4;
+	size_t blockSize = bc3 ? 16 : 8;
+	unsigned char block[64];
+	for (unsigned int by = firstRow; by < lastRow; by++){
+		for (unsigned int bx = 0; bx < blocksWide; bx++){
+			unsigned char * dst = out + ((size_t)by*blocksWide + bx) * blockSize;
+			extractBlock(rgba, width, height, bx, by, block);
+			if (bc3){
+				compressAlphaBlock(block, dst);
+				dst += 8;
+			}
+			compressColorBlock(block, dst);
+		}
+	}
+}
+
+void compressDXT(const unsigned char * rgba, unsigned int width, unsigned int height, bool bc3, unsigned char * out, unsigned int threadCount){
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	unsigned int blockRows = (height+3)/4;
+	unsigned int threads = std::min(threadCount, std::max(1u, blockRows / 8));
+	if (threads == 1){
+		compressBlockRows(rgba, width, height, bc3, out, 0, blockRows);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	unsigned int rowsPerThread = (blockRows + threads - 1) / threads;
+	for (unsigned int t = 0; t < threads; t++){
+		unsigned int first = t * rowsPerThread;
+		unsigned int last = std::min(blockRows, first + rowsPerThread);
+		if (first >= last)
+			break;
+		workers.push_back(std::thread(compressBlockRows, rgba, width, height, bc3, out, first, last));
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+
+void decompressDXT(const unsigned char * blocks, unsigned int width, unsigned int height, bool bc3, unsigned char * rgba){
+	unsigned int blocksWide = (width+3)/4, blocksHigh = (height+3)/4;
+	for (unsigned int by = 0; by < blocksHigh; by++){
+		for (unsigned int bx = 0; bx < blocksWide; bx++){
+			const unsigned char * src = blocks + ((size_t)by*blocksWide + bx) * (bc3 ? 16 : 8);
+
+			int alphas[8];
+			unsigned long long alphaIndices = 0;
+			if (bc3){
+				alphas[0] = src[0];
+				alphas[1] = src[1];
+				for (int k = 1; k <= 6; k++)
+					alphas[k+1] = ((7-k)*alphas[0] + k*alphas[1]) / 7;
+				if (alphas[0] <= alphas[1]){ // 6 value mode, never written by our encoder
+					for (int k = 1; k <= 4; k++)
+						alphas[k+1] = ((5-k)*alphas[0] + k*alphas[1]) / 5;
+					alphas[6] = 0;
+					alphas[7] = 255;
+				}
+				for (int i = 0; i < 6; i++)
+					alphaIndices |= (unsigned long long)src[2+i] << (8*i);
+				src += 8;
+			}
+
+			unsigned short c0 = (unsigned short)(src[0] | (src[1] << 8));
+			unsigned short c1 = (unsigned short)(src[2] | (src[3] << 8));
+			unsigned char palette[4][4];
+			from565(c0, palette[0]);
+			from565(c1, palette[1]);
+			for (int c = 0; c < 3; c++){
+				if (c0 > c1 || bc3){
+					palette[2][c] = (unsigned char)((2*palette[0][c] + palette[1][c]) / 3);
+					palette[3][c] = (unsigned char)((palette[0][c] + 2*palette[1][c]) / 3);
+				}else{
+					palette[2][c] = (unsigned char)((palette[0][c] + palette[1][c]) / 2);
+					palette[3][c] = 0;
+				}
+			}
+			palette[2][3] = 255;
+			palette[3][3] = (c0 > c1 || bc3) ? 255 : 0;
+			unsigned int indices = src[4] | (src[5] << 8) | (src[6] << 16) | ((unsigned int)src[7] << 24);
+
+			for (unsigned int y = 0; y < 4 && by*4 + y < height; y++){
+				for (unsigned int x = 0; x < 4 && bx*4 + x < width; x++){
+					int i = y*4 + x;
+					unsigned char * dst = rgba + ((size_t)(by*4 + y)*width + bx*4 + x)*4;
+					memcpy(dst, palette[(indices >> (2*i)) & 3], 4);
+					if (bc3)
+						dst[3] = (unsigned char)alphas[(alphaIndices >> (3*i)) & 7];
+				}
+			}
+		}
+	}
+}
+
+
+
+void compressMipChain(const MipChain & chain, bool bc3, std::vector<unsigned char> & blocks, unsigned int threadCount){
+	size_t total = 0;
+	for (size_t i = 0; i < chain.levels.size(); i++)
+		total += dxtCompressedSize(chain.levels[i].width, chain.levels[i].height, bc3);
+
+	blocks.resize(total);
+	size_t offset = 0;
+	for (size_t i = 0; i < chain.levels.size(); i++){
+		const MipChainLevel & level = chain.levels[i];
+		compressDXT(&chain.pixels[level.offset], level.width, level.height, bc3, &blocks[offset], threadCount);
+		offset += dxtCompressedSize(level.width, level.height, bc3);
+	}
+}
+
+bool saveDDS(const char * path, const MipChain & chain, bool bc3, unsigned int threadCount){
+	std::vector<unsigned char> blocks;
+	compressMipChain(chain, bc3, blocks, threadCount);
+	return saveDDS(path, chain.levels[0].width, chain.levels[0].height, (unsigned int)chain.levels.size(), bc3, blocks);
+}
+
+bool saveDDS(const char * path, unsigned int width, unsigned int height, unsigned int levelCount, bool bc3,
+	const std::vector<unsigned char> & blocks){
+	// DDS_HEADER, see the DirectX documentation. loadDDS() reads height, width,
+	// linear size, mip count and the pixel format's fourCC.
+	unsigned int header[31];
+	memset(header, 0, sizeof(header));
+	header[0]  = 124;                                       // dwSize
+	header[1]  = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // CAPS, HEIGHT, WIDTH, PIXELFORMAT, MIPMAPCOUNT, LINEARSIZE
+	header[2]  = height;
+	header[3]  = width;
+	header[4]  = (unsigned int)dxtCompressedSize(width, height, bc3);
+	header[6]  = levelCount;
+	header[18] = 32;                                        // ddspf.dwSize
+	header[19] = 0x4;                                       // DDPF_FOURCC
+	header[20] = bc3 ? 0x35545844 : 0x31545844;             // "DXT5" or "DXT1"
+	header[26] = 0x1000 | 0x400000 | 0x8;                   // TEXTURE, MIPMAP, COMPLEX
+
+	FILE * file = fopen(path, "wb");
+	if (file == NULL){
+		printf("%s could not be opened for writing\n", path);
+		return false;
+	}
+	fwrite("DDS ", 1, 4, file);
+	fwrite(header, 4, 31, file);
+	fwrite(&blocks[0], 1, blocks.size(), file);
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,27 @@
+#ifndef DXTCOMPRESS_HPP
+#define DXTCOMPRESS_HPP
+
+// CPU BC1 (DXT1) and BC3 (DXT5) block compression, for baking textures offline.
+// No OpenGL involved. Images are RGBA8 ; sizes need not be multiples of 4.
+
+// Bytes needed for one level : 8 bytes per 4x4 block for BC1, 16 for BC3
+size_t dxtCompressedSize(unsigned int width, unsigned int height, bool bc3);
+
+// Compresses one level into out (dxtCompressedSize bytes). Block rows are split
+// across threadCount threads ; 0 uses every hardware thread.
+void compressDXT(const unsigned char * rgba, unsigned int width, unsigned int height, bool bc3, unsigned char * out, unsigned int threadCount = 0);
+
+// Decodes one compressed level back to RGBA8, e.g. to measure the compression error
+void decompressDXT(const unsigned char * blocks, unsigned int width, unsigned int height, bool bc3, unsigned char * rgba);
+
+// Compresses every level of the chain into blocks, one after the other as in a .DDS file
+void compressMipChain(const MipChain & chain, bool bc3, std::vector<unsigned char> & blocks, unsigned int threadCount = 0);
+
+// Writes every level of the chain as a DXT1 or DXT5 .DDS file that loadDDS() reads
+bool saveDDS(const char * path, const MipChain & chain, bool bc3, unsigned int threadCount = 0);
+
+// Same, from levels compressMipChain() already compressed. width and height are level 0's.
+bool saveDDS(const char * path, unsigned int width, unsigned int height, unsigned int levelCount, bool bc3,
+	const std::vector<unsigned char> & blocks);
+
+#endif
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "filewatch.hpp"
+
+struct FileWatch {
+	std::string directory;
+	std::string name;
+	int wd;              // inotify watch descriptor of the parent directory
+	time_t lastModified; // used by the polling fallback
+};
+
+static std::vector<FileWatch> watches;
+
+#ifdef __linux__
+static int inotifyFD = -1;
+#endif
+
+static time_t getModificationTime(const std::string & path){
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return 0;
+	return st.st_mtime;
+}
+
+int addFileWatch(const char * path){
+
+	FileWatch watch;
+	std::string fullPath(path);
+	size_t slash = fullPath.find_last_of("/\\");
+	if (slash == std::string::npos){
+		watch.directory = ".";
+		watch.name = fullPath;
+	}else{
+		watch.directory = fullPath.substr(0, slash);
+		watch.name = fullPath.substr(slash + 1);
+	}
+	watch.wd = -1;
+	watch.lastModified = getModificationTime(fullPath);
+
+#ifdef __linux__
+	if (inotifyFD < 0)
+		inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFD >= 0){
+		// Editors often save by writing a temporary file and renaming it over the original,
+		// which drops a watch on the file itself. Watching the directory survives that.
+		watch.wd = inotify_add_watch(inotifyFD, watch.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (watch.wd < 0)
+			printf("Could not watch %s, falling back to polling\n", path);
+	}
+#endif
+
+	watches.push_back(watch);
+	return (int)watches.size() - 1;
+}
+
+static void addChanged(std::vector<int> & changedIDs, int id){
+	if (std::find(changedIDs.begin(), changedIDs.end(), id) == changedIDs.end())
+		changedIDs.push_back(id);
+}
+
+void pollFileWatches(std::vector<int> & changedIDs){
+
+#ifdef __linux__
+	if (inotifyFD >= 0){
+		char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t length;
+		while ((length = read(inotifyFD, buffer, sizeof(buffer))) > 0){
+			for (char * ptr = buffer; ptr < buffer + length; ptr += sizeof(struct inotify_event) + ((struct inotify_event *)ptr)->len){
+				const struct inotify_event * event = (const struct inotify_event *)ptr;
+				if (event->len == 0)
+					continue;
+				for (size_t i = 0; i < watches.size(); i++){
+					if (watches[i].wd == event->wd && watches[i].name == event->name)
+						addChanged(changedIDs, (int)i);
+				}
+			}
+		}
+	}
+#endif
+
+	// Polling fallback for watches inotify could not take
+	for (size_t i = 0; i < watches.size(); i++){
+		if (watches[i].wd >= 0)
+			continue;
+		time_t modified = getModificationTime(watches[i].directory + "/" + watches[i].name);
+		if (modified != 0 && modified != watches[i].lastModified){
+			watches[i].lastModified = modified;
+			addChanged(changedIDs, (int)i);
+		}
+	}
+}
+
+void cleanupFileWatches(){
+#ifdef __linux__
+	if (inotifyFD >= 0){
+		close(inotifyFD);
+		inotifyFD = -1;
+	}
+#endif
+	watches.clear();
+}
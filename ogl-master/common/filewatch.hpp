@@ -0,0 +1,16 @@
+#ifndef FILEWATCH_HPP
+#define FILEWATCH_HPP
+
+#include <vector>
+
+// Start watching a file for modifications. Returns a watch ID (>= 0) ; the file need not
+// exist yet. Uses inotify on Linux, and falls back to polling the modification time
+// elsewhere or when inotify can't watch its directory.
+int addFileWatch(const char * path);
+
+// Appends the IDs of the watched files that changed since the last call. Never blocks.
+void pollFileWatches(std::vector<int> & changedIDs);
+
+void cleanupFileWatches();
+
+#endif
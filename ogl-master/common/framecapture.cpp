@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "image.hpp"
+
+#include "framecapture.hpp"
+
+static const unsigned int CaptureSlots = 3;
+
+struct CaptureSlot {
+	GLuint bufferID;
+	GLsync fence;
+	std::string path;
+};
+
+static CaptureSlot CaptureRing[CaptureSlots];
+static unsigned int CaptureNext = 0;
+static int CaptureWidth = 0, CaptureHeight = 0;
+static int CaptureErrors = 0;
+
+void initFrameCapture(int width, int height){
+	CaptureWidth = width;
+	CaptureHeight = height;
+	for (unsigned int i = 0; i < CaptureSlots; i++){
+		CaptureSlot & slot = CaptureRing[i];
+		glGenBuffers(1, &slot.bufferID);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.bufferID);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+		slot.fence = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Maps the pixels of a slot and writes them out, waiting for the GPU if asked to
+static bool finishCapture(CaptureSlot & slot, bool wait){
+	if (slot.fence == 0)
+		return true;
+	GLenum status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 5000000000ull : 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+		return false;
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.bufferID);
+	const unsigned char * pixels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+		(GLsizeiptr)CaptureWidth * CaptureHeight * 4, GL_MAP_READ_BIT);
+	if (pixels == NULL || !savePNG(slot.path.c_str(), pixels, CaptureWidth, CaptureHeight, false))
+		CaptureErrors++;
+	if (pixels != NULL)
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
+
+// Gives up on a slot whose readback never completed : its frame is lost
+static void dropCapture(CaptureSlot & slot){
+	if (slot.fence == 0)
+		return;
+	printf("%s : timed out waiting for the GPU, not captured\n", slot.path.c_str());
+	CaptureErrors++;
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+}
+
+void captureFrame(const char * imagepath){
+	CaptureSlot & slot = CaptureRing[CaptureNext];
+	if (!finishCapture(slot, true))
+		dropCapture(slot);
+	CaptureNext = (CaptureNext + 1) % CaptureSlots;
+
+	slot.path = imagepath;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.bufferID);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, CaptureWidth, CaptureHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void updateFrameCapture(bool waitForAll){
+	// Oldest first, so the files are written in the order they were captured
+	for (unsigned int i = 0; i < CaptureSlots; i++){
+		if (!finishCapture(CaptureRing[(CaptureNext + i) % CaptureSlots], waitForAll))
+			break;
+	}
+}
+
+int frameCaptureErrors(){
+	return CaptureErrors;
+}
+
+void cleanupFrameCapture(){
+	updateFrameCapture(true);
+	for (unsigned int i = 0; i < CaptureSlots; i++){
+		dropCapture(CaptureRing[i]);
+		glDeleteBuffers(1, &CaptureRing[i].bufferID);
+		CaptureRing[i].bufferID = 0;
+	}
+}
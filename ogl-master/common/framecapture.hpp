@@ -0,0 +1,23 @@
+#ifndef FRAMECAPTURE_HPP
+#define FRAMECAPTURE_HPP
+
+// Asynchronous readback of rendered frames to PNG files. glReadPixels() goes into a ring of
+// pixel pack buffers ; the pixels are only mapped and written out once their fence has
+// signalled, a frame or two later, so capturing doesn't stall the pipeline.
+
+void initFrameCapture(int width, int height);
+
+// Reads back the color buffer of the current read framebuffer ; written to imagepath later.
+// Only blocks when every buffer of the ring is still waiting for its previous frame.
+void captureFrame(const char * imagepath);
+
+// Writes out the captures that are ready. Call once per frame ; with waitForAll, blocks
+// until every pending capture has been written.
+void updateFrameCapture(bool waitForAll = false);
+
+// Number of captures that could not be written
+int frameCaptureErrors();
+
+void cleanupFrameCapture();
+
+#endif
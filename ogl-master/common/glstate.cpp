@@ -0,0 +1,141 @@
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
+#include <GL/glew.h>
+
+#include "glstate.hpp"
+
+static const GLuint MaxTextureUnits = 32;
+static const GLuint Unknown = 0xFFFFFFFF; // never a GL name, so the next bind always goes through
+
+static GLuint currentProgram = Unknown;
+static GLuint currentVertexArray = Unknown;
+static GLuint activeTextureUnit = Unknown;
+static GLuint boundTextures[MaxTextureUnits];
+static GLenum boundTargets[MaxTextureUnits];
+static bool texturesKnown = false;
+
+// Values as last uploaded, keyed by program and location
+static std::unordered_map<uint64_t, std::vector<GLfloat> > uniformValues;
+
+static unsigned int callsIssued = 0;
+static unsigned int callsSkipped = 0;
+
+void useProgram(GLuint program){
+	if (program == currentProgram){
+		callsSkipped++;
+		return;
+	}
+	glUseProgram(program);
+	currentProgram = program;
+	callsIssued++;
+}
+
+void bindVertexArray(GLuint vertexArray){
+	if (vertexArray == currentVertexArray){
+		callsSkipped++;
+		return;
+	}
+	glBindVertexArray(vertexArray);
+	currentVertexArray = vertexArray;
+	callsIssued++;
+}
+
+void bindTexture(GLuint unit, GLenum target, GLuint texture){
+	if (!texturesKnown){
+		for (GLuint i = 0; i < MaxTextureUnits; i++){
+			boundTextures[i] = Unknown;
+			boundTargets[i] = GL_NONE;
+		}
+		texturesKnown = true;
+	}
+	if (unit < MaxTextureUnits && boundTextures[unit] == texture && boundTargets[unit] == target){
+		callsSkipped++;
+		return;
+	}
+	if (unit != activeTextureUnit){
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeTextureUnit = unit;
+		callsIssued++;
+	}
+	glBindTexture(target, texture);
+	callsIssued++;
+	if (unit < MaxTextureUnits){
+		boundTextures[unit] = texture;
+		boundTargets[unit] = target;
+	}
+}
+
+// Updates the shadow copy, and tells whether the uniform needs uploading
+static bool uniformChanged(GLint location, const void * values, size_t floatCount){
+	if (location < 0){
+		callsSkipped++;
+		return false;
+	}
+	if (currentProgram == Unknown){
+		callsIssued++; // no idea which program gets it, so don't remember it
+		return true;
+	}
+	std::vector<GLfloat> & cached = uniformValues[((uint64_t)currentProgram << 32) | (uint32_t)location];
+	if (cached.size() == floatCount && memcmp(&cached[0], values, floatCount * sizeof(GLfloat)) == 0){
+		callsSkipped++;
+		return false;
+	}
+	cached.resize(floatCount);
+	memcpy(&cached[0], values, floatCount * sizeof(GLfloat));
+	callsIssued++;
+	return true;
+}
+
+void setUniform1i(GLint location, GLint value){
+	if (uniformChanged(location, &value, 1))
+		glUniform1i(location, value);
+}
+
+void setUniform1f(GLint location, GLfloat value){
+	if (uniformChanged(location, &value, 1))
+		glUniform1f(location, value);
+}
+
+void setUniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z){
+	GLfloat values[3] = { x, y, z };
+	if (uniformChanged(location, values, 3))
+		glUniform3f(location, x, y, z);
+}
+
+void setUniform3fv(GLint location, GLsizei count, const GLfloat * values){
+	if (uniformChanged(location, values, 3 * count))
+		glUniform3fv(location, count, values);
+}
+
+void setUniformMatrix4fv(GLint location, GLsizei count, const GLfloat * values){
+	if (uniformChanged(location, values, 16 * count))
+		glUniformMatrix4fv(location, count, GL_FALSE, values);
+}
+
+void invalidateGLBindings(){
+	currentProgram = Unknown;
+	currentVertexArray = Unknown;
+	activeTextureUnit = Unknown;
+	texturesKnown = false;
+}
+
+void invalidateGLState(){
+	invalidateGLBindings();
+	uniformValues.clear();
+}
+
+unsigned int glStateCallsIssued(){
+	return callsIssued;
+}
+
+unsigned int glStateCallsSkipped(){
+	return callsSkipped;
+}
+
+void resetGLStateCounters(){
+	callsIssued = 0;
+	callsSkipped = 0;
+}
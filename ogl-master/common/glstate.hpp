@@ -0,0 +1,34 @@
+#ifndef GLSTATE_HPP
+#define GLSTATE_HPP
+
+// Shadow copies of the GL state that the renderers change most : the bound program, vertex
+// array and textures, and the uniform values of each program. The wrappers below skip the
+// calls that wouldn't change anything, and count issued against skipped calls.
+//
+// Code that binds programs, vertex arrays or textures with plain GL calls must call
+// invalidateGLBindings() afterwards. Deleting a program must be followed by
+// invalidateGLState(), since GL reuses program names.
+
+void useProgram(GLuint program);
+void bindVertexArray(GLuint vertexArray);
+
+// Also makes the unit active
+void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+// Uniforms of the program bound with useProgram(). Location -1 is skipped, as GL would.
+void setUniform1i(GLint location, GLint value);
+void setUniform1f(GLint location, GLfloat value);
+void setUniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z);
+void setUniform3fv(GLint location, GLsizei count, const GLfloat * values);
+void setUniformMatrix4fv(GLint location, GLsizei count, const GLfloat * values);
+
+// Forget the bindings, or the bindings and every uniform value
+void invalidateGLBindings();
+void invalidateGLState();
+
+// Calls since the last resetGLStateCounters()
+unsigned int glStateCallsIssued();
+unsigned int glStateCallsSkipped();
+void resetGLStateCounters();
+
+#endif
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_USE_SSE2
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "image.hpp"
+
+unsigned char * loadImageRGBA(const char * imagepath, int & width, int & height, bool flipVertically){
+	int components;
+	stbi_set_flip_vertically_on_load(flipVertically ? 1 : 0);
+	unsigned char * pixels = stbi_load(imagepath, &width, &height, &components, 4);
+	if (pixels == NULL)
+		printf("%s could not be decoded : %s\n", imagepath, stbi_failure_reason());
+	return pixels;
+}
+
+void freeImage(unsigned char * pixels){
+	stbi_image_free(pixels);
+}
+
+static unsigned int crc32Table[256];
+
+static unsigned int updateCRC32(unsigned int crc, const unsigned char * data, size_t size){
+	if (crc32Table[1] == 0){
+		for (unsigned int n = 0; n < 256; n++){
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			crc32Table[n] = c;
+		}
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = crc32Table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void appendBigEndian(std::vector<unsigned char> & out, unsigned int value){
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+// Length, type, data, and the CRC of type + data
+static void writePNGChunk(FILE * file, const char * type, const std::vector<unsigned char> & data){
+	std::vector<unsigned char> chunk;
+	chunk.reserve(data.size() + 12);
+	appendBigEndian(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	appendBigEndian(chunk, updateCRC32(0, &chunk[4], data.size() + 4));
+	fwrite(&chunk[0], 1, chunk.size(), file);
+}
+
+bool savePNG(const char * imagepath, const unsigned char * rgba, int width, int height, bool withAlpha, bool flipVertically){
+	FILE * file = fopen(imagepath, "wb");
+	if (file == NULL){
+		printf("Could not write %s\n", imagepath);
+		return false;
+	}
+
+	// Scanlines, each one prefixed by filter type 0 (none)
+	unsigned int channels = withAlpha ? 4 : 3;
+	size_t rowSize = 1 + (size_t)width * channels;
+	std::vector<unsigned char> raw(rowSize * height);
+	for (int y = 0; y < height; y++){
+		const unsigned char * src = rgba + (size_t)(flipVertically ? height - 1 - y : y) * width * 4;
+		unsigned char * dst = &raw[rowSize * y];
+		*dst++ = 0;
+		if (withAlpha){
+			memcpy(dst, src, (size_t)width * 4);
+		}else{
+			for (int x = 0; x < width; x++, dst += 3, src += 4){
+				dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+			}
+		}
+	}
+
+	// zlib stream made of stored deflate blocks of at most 65535 bytes
+	std::vector<unsigned char> idat;
+	idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+	unsigned int adlerA = 1, adlerB = 0;
+	for (size_t offset = 0; offset < raw.size() || offset == 0; ){
+		size_t length = std::min<size_t>(65535, raw.size() - offset);
+		bool last = offset + length == raw.size();
+		idat.push_back(last ? 1 : 0);
+		idat.push_back((unsigned char)length);
+		idat.push_back((unsigned char)(length >> 8));
+		idat.push_back((unsigned char)~length);
+		idat.push_back((unsigned char)(~length >> 8));
+		idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + length);
+		for (size_t i = offset; i < offset + length; i++){
+			adlerA = (adlerA + raw[i]) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		}
+		offset += length;
+		if (last)
+			break;
+	}
+	appendBigEndian(idat, (adlerB << 16) | adlerA);
+
+	std::vector<unsigned char> ihdr;
+	appendBigEndian(ihdr, width);
+	appendBigEndian(ihdr, height);
+	ihdr.push_back(8);                    // bits per channel
+	ihdr.push_back(withAlpha ? 6 : 2);    // RGBA or RGB
+	ihdr.push_back(0);                    // deflate
+	ihdr.push_back(0);                    // adaptive filtering
+	ihdr.push_back(0);                    // not interlaced
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	fwrite(signature, 1, 8, file);
+	writePNGChunk(file, "IHDR", ihdr);
+	writePNGChunk(file, "IDAT", idat);
+	writePNGChunk(file, "IEND", std::vector<unsigned char>());
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	if (!ok)
+		printf("Could not write %s\n", imagepath);
+	return ok;
+}
+
+// Averages 2x2 blocks of src into rows [firstRow, lastRow) of dst.
+// Odd sizes clamp to the last row/column, so every level stays defined down to 1x1.
+static void downsampleRows(const unsigned char * src, unsigned int srcWidth, unsigned int srcHeight,
+	unsigned char * dst, unsigned int dstWidth, unsigned int firstRow, unsigned int lastRow){
+
+	for (unsigned int y = firstRow; y < lastRow; y++){
+		const unsigned char * row0 = src + (size_t)std::min(2*y,   srcHeight-1) * srcWidth * 4;
+		const unsigned char * row1 = src + (size_t)std::min(2*y+1, srcHeight-1) * srcWidth * 4;
+		unsigned char * out = dst + (size_t)y * dstWidth * 4;
+		unsigned int x = 0;
+
+#ifdef IMAGE_USE_SSE2
+		// 4 output pixels per iteration, from 8 input pixels of each row
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rounding = _mm_set1_epi16(2);
+		for (; 2*x + 8 <= srcWidth && x + 4 <= dstWidth; x += 4){
+			__m128i a = _mm_loadu_si128((const __m128i*)(row0 + 8*x));
+			__m128i b = _mm_loadu_si128((const __m128i*)(row0 + 8*x + 16));
+			__m128i c = _mm_loadu_si128((const __m128i*)(row1 + 8*x));
+			__m128i d = _mm_loadu_si128((const __m128i*)(row1 + 8*x + 16));
+
+			// Vertical sums, two pixels per register in 16 bits
+			__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(c, zero));
+			__m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(c, zero));
+			__m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(d, zero));
+			__m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(d, zero));
+
+			// Horizontal sums : add the upper pixel of each register onto the lower one
+			s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+			s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+			s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+			s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+
+			__m128i p01 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s0, s1), rounding), 2);
+			__m128i p23 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s2, s3), rounding), 2);
+			_mm_storeu_si128((__m128i*)(out + 4*x), _mm_packus_epi16(p01, p23));
+		}
+#endif
+
+		for (; x < dstWidth; x++){
+			unsigned int x0 = std::min(2*x, srcWidth-1) * 4;
+			unsigned int x1 = std::min(2*x+1, srcWidth-1) * 4;
+			for (int c = 0; c < 4; c++)
+				out[4*x+c] = (unsigned char)((row0[x0+c] + row0[x1+c] + row1[x0+c] + row1[x1+c] + 2) >> 2);
+		}
+	}
+}
+
+void buildMipChain(const unsigned char * rgba, unsigned int width, unsigned int height, MipChain & chain, unsigned int threadCount){
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	// Lay out every level first, so the pixels are allocated once
+	chain.levels.clear();
+	size_t total = 0;
+	for (unsigned int w = width, h = height; ; w = std::max(1u, w/2), h = std::max(1u, h/2)){
+		MipChainLevel level = { w, h, total };
+		chain.levels.push_back(level);
+		total += (size_t)w * h * 4;
+		if (w == 1 && h == 1)
+			break;
+	}
+	chain.pixels.resize(total);
+	memcpy(&chain.pixels[0], rgba, (size_t)width * height * 4);
+
+	// Each level depends on the previous one, so the threads split rows within a level
+	for (size_t i = 1; i < chain.levels.size(); i++){
+		const MipChainLevel & src = chain.levels[i-1];
+		const MipChainLevel & dst = chain.levels[i];
+		const unsigned char * srcPixels = &chain.pixels[src.offset];
+		unsigned char * dstPixels = &chain.pixels[dst.offset];
+
+		// Small levels are not worth a thread
+		unsigned int threads = std::min(threadCount, std::max(1u, dst.height / 32));
+		if (threads == 1){
+			downsampleRows(srcPixels, src.width, src.height, dstPixels, dst.width, 0, dst.height);
+			continue;
+		}
+
+		std::vector<std::thread> workers;
+		unsigned int rowsPerThread = (dst.height + threads - 1) / threads;
+		for (unsigned int t = 0; t < threads; t++){
+			unsigned int first = t * rowsPerThread;
+			unsigned int last = std::min(dst.height, first + rowsPerThread);
+			if (first >= last)
+				break;
+			workers.push_back(std::thread(downsampleRows, srcPixels, src.width, src.height, dstPixels, dst.width, first, last));
+		}
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+}
+
+
+
+static const unsigned int MipCacheMagic = 0x4350494D; // "MIPC"
+static const unsigned int MipCacheVersion = 1;
+
+struct MipCacheHeader {
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long sourceSize;
+	unsigned long long sourceTime;
+	unsigned int levelCount;
+	unsigned int reserved;
+	unsigned long long pixelBytes;
+};
+
+static bool getSourceStamp(const char * sourcepath, MipCacheHeader & header){
+	struct stat st;
+	if (stat(sourcepath, &st) != 0)
+		return false;
+	header.sourceSize = (unsigned long long)st.st_size;
+	header.sourceTime = (unsigned long long)st.st_mtime;
+	return true;
+}
+
+bool saveMipChain(const char * cachepath, const char * sourcepath, const MipChain & chain){
+	MipCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	if (!getSourceStamp(sourcepath, header))
+		return false;
+	header.magic = MipCacheMagic;
+	header.version = MipCacheVersion;
+	header.levelCount = (unsigned int)chain.levels.size();
+	header.pixelBytes = chain.pixels.size();
+
+	FILE * file = fopen(cachepath, "wb");
+	if (file == NULL){
+		printf("Could not write mip cache %s\n", cachepath);
+		return false;
+	}
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(&chain.levels[0], sizeof(MipChainLevel), chain.levels.size(), file);
+	fwrite(&chain.pixels[0], 1, chain.pixels.size(), file);
+	fclose(file);
+	return true;
+}
+
+bool loadMipChain(const char * cachepath, const char * sourcepath, MipChain & chain){
+	FILE * file = fopen(cachepath, "rb");
+	if (file == NULL)
+		return false;
+
+	MipCacheHeader header, expected;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1
+		&& getSourceStamp(sourcepath, expected)
+		&& header.magic == MipCacheMagic && header.version == MipCacheVersion
+		&& header.sourceSize == expected.sourceSize && header.sourceTime == expected.sourceTime
+		&& header.levelCount > 0;
+	if (ok){
+		chain.levels.resize(header.levelCount);
+		chain.pixels.resize(header.pixelBytes);
+		ok = fread(&chain.levels[0], sizeof(MipChainLevel), header.levelCount, file) == header.levelCount
+			&& fread(&chain.pixels[0], 1, header.pixelBytes, file) == header.pixelBytes;
+	}
+	// The last level must end exactly at the end of the pixels
+	if (ok){
+		const MipChainLevel & last = chain.levels.back();
+		ok = last.offset + (size_t)last.width * last.height * 4 == chain.pixels.size();
+	}
+	fclose(file);
+	return ok;
+}
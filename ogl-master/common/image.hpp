@@ -0,0 +1,41 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <stddef.h>
+#include <vector>
+
+// CPU side image handling, no OpenGL involved : decoding through stb_image,
+// mip chain generation, and a binary cache of generated chains.
+
+struct MipChainLevel {
+	unsigned int width, height;
+	size_t offset; // in bytes, into MipChain::pixels
+};
+
+// RGBA8 levels, from full size down to 1x1, stored back to back
+struct MipChain {
+	std::vector<MipChainLevel> levels;
+	std::vector<unsigned char> pixels;
+};
+
+// Decodes a PNG, JPG, TGA, BMP, ... file to RGBA8, bottom row first like OpenGL expects
+// (top row first when flipVertically is false, the .DDS convention).
+// Returns NULL on failure ; free the result with freeImage().
+unsigned char * loadImageRGBA(const char * imagepath, int & width, int & height, bool flipVertically = true);
+void freeImage(unsigned char * pixels);
+
+// Writes an RGBA8 image as a PNG, dropping the alpha channel unless withAlpha. Rows are read
+// bottom first like glReadPixels returns them, unless flipVertically is false. The image data
+// goes into stored (uncompressed) deflate blocks : bigger files, but no zlib needed.
+bool savePNG(const char * imagepath, const unsigned char * rgba, int width, int height, bool withAlpha, bool flipVertically = true);
+
+// Builds the full mip chain of an RGBA8 image with a 2x2 box filter (SSE2 when available).
+// Rows of each level are split across threadCount threads ; 0 uses every hardware thread.
+void buildMipChain(const unsigned char * rgba, unsigned int width, unsigned int height, MipChain & chain, unsigned int threadCount = 0);
+
+// Mip chain cache files remember the size and modification time of the image they were built
+// from, so loadMipChain() refuses them once the source image has changed.
+bool saveMipChain(const char * cachepath, const char * sourcepath, const MipChain & chain);
+bool loadMipChain(const char * cachepath, const char * sourcepath, MipChain & chain);
+
+#endif
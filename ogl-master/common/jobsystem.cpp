@@ -0,0 +1,140 @@
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+
+#include "jobsystem.hpp"
+
+struct Job {
+	JobFunction function;
+	void * data;
+	size_t begin, end;
+	std::atomic<size_t> * pending; // jobs of the same parallelFor still running
+};
+
+struct JobQueue {
+	std::mutex mutex;
+	std::deque<Job> jobs;
+};
+
+// Queue 0 belongs to the threads outside the pool, queue i to worker i
+static std::vector<std::thread> workers;
+static JobQueue * queues = NULL;
+static unsigned int queueCount = 0;
+static std::atomic<int> queuedJobs(0);
+static std::mutex sleepMutex;
+static std::condition_variable workerWakeup;
+static bool stopWorkers = false;
+static thread_local unsigned int workerIndex = 0;
+
+// Own jobs newest first (still warm in cache), then the oldest job of another queue
+static bool popOrSteal(unsigned int self, Job & job){
+	for (unsigned int k = 0; k < queueCount; k++){
+		JobQueue & queue = queues[(self + k) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty())
+			continue;
+		if (k == 0){
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+		}else{
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+		}
+		queuedJobs--;
+		return true;
+	}
+	return false;
+}
+
+static void runJob(const Job & job){
+	job.function(job.data, job.begin, job.end);
+	job.pending->fetch_sub(1, std::memory_order_release);
+}
+
+static void workerLoop(unsigned int index){
+	workerIndex = index;
+	for (;;){
+		Job job;
+		if (popOrSteal(index, job)){
+			runJob(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		workerWakeup.wait(lock, []{ return stopWorkers || queuedJobs > 0; });
+		if (stopWorkers)
+			return;
+	}
+}
+
+void initJobSystem(unsigned int threadCount){
+	cleanupJobSystem();
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	queueCount = threadCount;
+	queues = new JobQueue[queueCount];
+	stopWorkers = false;
+	for (unsigned int i = 1; i < threadCount; i++)
+		workers.push_back(std::thread(workerLoop, i));
+}
+
+unsigned int jobSystemThreadCount(){
+	return std::max(1u, queueCount);
+}
+
+void parallelFor(size_t count, size_t grain, JobFunction job, void * data){
+	if (count == 0)
+		return;
+	grain = std::max<size_t>(1, grain);
+
+	// Without a pool, or for a single range, don't bother with the queues
+	if (queueCount <= 1 || count <= grain){
+		job(data, 0, count);
+		return;
+	}
+
+	size_t jobCount = (count + grain - 1) / grain;
+	std::atomic<size_t> pending(jobCount);
+	JobQueue & queue = queues[workerIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		for (size_t begin = 0; begin < count; begin += grain){
+			Job range = { job, data, begin, std::min(count, begin + grain), &pending };
+			queue.jobs.push_back(range);
+		}
+		queuedJobs += (int)jobCount;
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	workerWakeup.notify_all();
+
+	// Help until our ranges are done ; this may run jobs of other parallelFor calls too
+	while (pending.load(std::memory_order_acquire) > 0){
+		Job other;
+		if (popOrSteal(workerIndex, other))
+			runJob(other);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void cleanupJobSystem(){
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopWorkers = true;
+	}
+	workerWakeup.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+	delete[] queues;
+	queues = NULL;
+	queueCount = 0;
+	queuedJobs = 0;
+}
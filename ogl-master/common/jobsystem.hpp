@@ -0,0 +1,23 @@
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+// A fixed pool of worker threads for data parallel CPU work. Each thread has its own deque
+// of jobs : it pops its own jobs newest first, and steals the oldest jobs of the others when
+// it runs out. Threads that wait for their jobs run jobs meanwhile, so parallelFor() can
+// be nested inside jobs.
+
+// threadCount counts the calling thread : 0 uses every hardware thread, 1 runs everything
+// on the caller. Calling it again resizes the pool.
+void initJobSystem(unsigned int threadCount = 0);
+
+unsigned int jobSystemThreadCount();
+
+// Calls job(data, begin, end) over [0, count) in ranges of at most grain items, spread over
+// the pool, and returns once every range is done. Ranges never overlap, so jobs writing to
+// their own items need no locking, and the result doesn't depend on the thread count.
+typedef void (*JobFunction)(void * data, size_t begin, size_t end);
+void parallelFor(size_t count, size_t grain, JobFunction job, void * data);
+
+void cleanupJobSystem();
+
+#endif
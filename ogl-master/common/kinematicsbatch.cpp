@@ -0,0 +1,253 @@
+#include <math.h>
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define KINEMATICSBATCH_USE_AVX2
+#define AVX2_FUNCTION __attribute__((target("avx2,fma")))
+#elif defined(_M_X64) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#define KINEMATICSBATCH_USE_AVX2
+#define AVX2_FUNCTION
+#endif
+
+#include "jobsystem.hpp"
+#include "selfcollision.hpp"
+#include "motionplanner.hpp"
+#include "kinematicsbatch.hpp"
+
+// A rotation by angle about the unit axis a is P + cos Q + sin K, with P = a a^T, Q = I - P and
+// K the cross product matrix of a. Between two joints the chain only has constant transforms
+// C, so from one joint's frame to the next's : rotation Cr (P + cos Q + sin K), translation
+// Cp. The constants hold, per joint, Cr P, Cr Q, Cr K and Cp ; then the rotation and offset
+// from the last joint's frame to the tip. Matrices are 3x3, by columns.
+const int JointConstants = 30;
+
+void initTipKinematics(TipKinematics & kinematics, const JointChain & chain, int tipLink, const glm::vec3 & tipPoint){
+	std::vector<int> path;
+	for (int n = tipLink; n >= 0; n = chain.parents[n])
+		path.insert(path.begin(), n);
+
+	kinematics.joints.clear();
+	kinematics.constants.clear();
+	glm::mat4 constant(1.0f);
+	for (int n : path){
+		constant = constant * chain.bases[n];
+		int joint = chain.linkJoints[n];
+		if (joint < 0)
+			continue;
+		glm::vec3 a = chain.axes[joint];
+		glm::mat3 p = glm::mat3(a.x * a, a.y * a, a.z * a);
+		glm::mat3 q = glm::mat3(1.0f) - p;
+		glm::mat3 k = glm::mat3(glm::vec3(0.0f, a.z, -a.y), glm::vec3(-a.z, 0.0f, a.x), glm::vec3(a.y, -a.x, 0.0f));
+		glm::mat3 rotation = glm::mat3(constant);
+		glm::mat3 terms[3] = { rotation * p, rotation * q, rotation * k };
+		for (int t = 0; t < 3; t++)
+			for (int c = 0; c < 3; c++)
+				for (int r = 0; r < 3; r++)
+					kinematics.constants.push_back(terms[t][c][r]);
+		for (int r = 0; r < 3; r++)
+			kinematics.constants.push_back(constant[3][r]);
+		kinematics.joints.push_back(joint);
+		constant = glm::mat4(1.0f);
+	}
+	constant = glm::translate(constant, tipPoint);
+	for (int c = 0; c < 3; c++)
+		for (int r = 0; r < 3; r++)
+			kinematics.constants.push_back(constant[c][r]);
+	for (int r = 0; r < 3; r++)
+		kinematics.constants.push_back(constant[3][r]);
+}
+
+// Cody-Waite reduction to [-pi/4, pi/4] in quarter turns, then the Cephes polynomials
+static const float TwoOverPi = 0.636619772f;
+static const float HalfPi1 = 1.5703125f, HalfPi2 = 4.837512969970703125e-4f, HalfPi3 = 7.54978995489188216e-8f;
+static const float Sin1 = -1.6666654611e-1f, Sin2 = 8.3321608736e-3f, Sin3 = -1.9515295891e-4f;
+static const float Cos1 = 4.166664568298827e-2f, Cos2 = -1.388731625493765e-3f, Cos3 = 2.443315711809948e-5f;
+
+static inline void sinCos(float x, float & s, float & c){
+	float j = floorf(x * TwoOverPi + 0.5f);
+	float r = ((x - j * HalfPi1) - j * HalfPi2) - j * HalfPi3;
+	float r2 = r * r;
+	float sinR = r + r * r2 * (Sin1 + r2 * (Sin2 + r2 * Sin3));
+	float cosR = 1.0f - 0.5f * r2 + r2 * r2 * (Cos1 + r2 * (Cos2 + r2 * Cos3));
+	int quadrant = (int)j;
+	s = quadrant & 1 ? cosR : sinR;
+	c = quadrant & 1 ? sinR : cosR;
+	if (quadrant & 2)
+		s = -s;
+	if ((quadrant + 1) & 2)
+		c = -c;
+}
+
+static void tipPosesScalar(const TipKinematics & kinematics, const float * angles, size_t count, size_t begin, size_t end,
+	float * positions, float * rotations){
+	size_t jointCount = kinematics.joints.size();
+	for (size_t i = begin; i < end; i++){
+		float rotation[9] = { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+		float position[3] = { 0.0f, 0.0f, 0.0f };
+		const float * constant = &kinematics.constants[0];
+		for (size_t j = 0; j <= jointCount; j++, constant += JointConstants){
+			const float * offset = constant + (j < jointCount ? 27 : 9);
+			for (int r = 0; r < 3; r++)
+				position[r] += rotation[r] * offset[0] + rotation[3 + r] * offset[1] + rotation[6 + r] * offset[2];
+			float step[9];
+			if (j < jointCount){
+				float s, c;
+				sinCos(angles[kinematics.joints[j] * count + i], s, c);
+				for (int e = 0; e < 9; e++)
+					step[e] = constant[e] + c * constant[9 + e] + s * constant[18 + e];
+			}
+			else{
+				for (int e = 0; e < 9; e++)
+					step[e] = constant[e];
+			}
+			float product[9];
+			for (int col = 0; col < 3; col++)
+				for (int r = 0; r < 3; r++)
+					product[col * 3 + r] = rotation[r] * step[col * 3] + rotation[3 + r] * step[col * 3 + 1] + rotation[6 + r] * step[col * 3 + 2];
+			for (int e = 0; e < 9; e++)
+				rotation[e] = product[e];
+		}
+		for (int r = 0; r < 3; r++)
+			positions[r * count + i] = position[r];
+		if (rotations)
+			for (int e = 0; e < 9; e++)
+				rotations[e * count + i] = rotation[e];
+	}
+}
+
+#ifdef KINEMATICSBATCH_USE_AVX2
+
+static bool cpuHasAvx2(){
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool fma = (info[2] & (1 << 12)) != 0, osxsave = (info[2] & (1 << 27)) != 0;
+	if (!fma || !osxsave || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+AVX2_FUNCTION static inline void sinCos8(__m256 x, __m256 & s, __m256 & c){
+	__m256 j = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(TwoOverPi), _mm256_set1_ps(0.5f)));
+	__m256 r = _mm256_fnmadd_ps(j, _mm256_set1_ps(HalfPi1), x);
+	r = _mm256_fnmadd_ps(j, _mm256_set1_ps(HalfPi2), r);
+	r = _mm256_fnmadd_ps(j, _mm256_set1_ps(HalfPi3), r);
+	__m256 r2 = _mm256_mul_ps(r, r);
+	__m256 sinR = _mm256_fmadd_ps(_mm256_set1_ps(Sin3), r2, _mm256_set1_ps(Sin2));
+	sinR = _mm256_fmadd_ps(sinR, r2, _mm256_set1_ps(Sin1));
+	sinR = _mm256_fmadd_ps(_mm256_mul_ps(sinR, r2), r, r);
+	__m256 cosR = _mm256_fmadd_ps(_mm256_set1_ps(Cos3), r2, _mm256_set1_ps(Cos2));
+	cosR = _mm256_fmadd_ps(cosR, r2, _mm256_set1_ps(Cos1));
+	cosR = _mm256_fmadd_ps(_mm256_mul_ps(cosR, r2), r2, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), r2, _mm256_set1_ps(1.0f)));
+	__m256i quadrant = _mm256_cvtps_epi32(j);
+	__m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+	__m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, two), 30));
+	__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, one), two), 30));
+	s = _mm256_xor_ps(_mm256_blendv_ps(sinR, cosR, swap), sinSign);
+	c = _mm256_xor_ps(_mm256_blendv_ps(cosR, sinR, swap), cosSign);
+}
+
+// Eight poses per iteration, the last ones masked, so that every pose goes through the same
+// arithmetic wherever it falls in the batch
+AVX2_FUNCTION static void tipPosesAvx2(const TipKinematics & kinematics, const float * angles, size_t count, size_t begin, size_t end,
+	float * positions, float * rotations){
+	size_t jointCount = kinematics.joints.size();
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	for (size_t i = begin; i < end; i += 8){
+		__m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(end - i)), lanes);
+		__m256 rotation[9], position[3];
+		for (int e = 0; e < 9; e++)
+			rotation[e] = _mm256_set1_ps(e % 4 == 0 ? 1.0f : 0.0f);
+		for (int r = 0; r < 3; r++)
+			position[r] = _mm256_setzero_ps();
+		const float * constant = &kinematics.constants[0];
+		for (size_t j = 0; j <= jointCount; j++, constant += JointConstants){
+			const float * offset = constant + (j < jointCount ? 27 : 9);
+			__m256 ox = _mm256_set1_ps(offset[0]), oy = _mm256_set1_ps(offset[1]), oz = _mm256_set1_ps(offset[2]);
+			for (int r = 0; r < 3; r++)
+				position[r] = _mm256_fmadd_ps(rotation[r], ox, _mm256_fmadd_ps(rotation[3 + r], oy, _mm256_fmadd_ps(rotation[6 + r], oz, position[r])));
+			__m256 step[9];
+			if (j < jointCount){
+				__m256 s, c;
+				sinCos8(_mm256_maskload_ps(angles + kinematics.joints[j] * count + i, mask), s, c);
+				for (int e = 0; e < 9; e++)
+					step[e] = _mm256_fmadd_ps(s, _mm256_set1_ps(constant[18 + e]), _mm256_fmadd_ps(c, _mm256_set1_ps(constant[9 + e]), _mm256_set1_ps(constant[e])));
+			}
+			else{
+				for (int e = 0; e < 9; e++)
+					step[e] = _mm256_set1_ps(constant[e]);
+			}
+			__m256 product[9];
+			for (int col = 0; col < 3; col++)
+				for (int r = 0; r < 3; r++)
+					product[col * 3 + r] = _mm256_fmadd_ps(rotation[r], step[col * 3], _mm256_fmadd_ps(rotation[3 + r], step[col * 3 + 1],
+						_mm256_mul_ps(rotation[6 + r], step[col * 3 + 2])));
+			for (int e = 0; e < 9; e++)
+				rotation[e] = product[e];
+		}
+		for (int r = 0; r < 3; r++)
+			_mm256_maskstore_ps(positions + r * count + i, mask, position[r]);
+		if (rotations)
+			for (int e = 0; e < 9; e++)
+				_mm256_maskstore_ps(rotations + e * count + i, mask, rotation[e]);
+	}
+}
+
+#endif
+
+TipPosePath bestTipPosePath(){
+#ifdef KINEMATICSBATCH_USE_AVX2
+	static const bool avx2 = cpuHasAvx2();
+	if (avx2)
+		return TipPoseAvx2;
+#endif
+	return TipPoseScalar;
+}
+
+static void tipPosesRange(const TipKinematics & kinematics, const float * angles, size_t count, size_t begin, size_t end,
+	float * positions, float * rotations, TipPosePath path){
+#ifdef KINEMATICSBATCH_USE_AVX2
+	if (path == TipPoseAvx2){
+		tipPosesAvx2(kinematics, angles, count, begin, end, positions, rotations);
+		return;
+	}
+#endif
+	tipPosesScalar(kinematics, angles, count, begin, end, positions, rotations);
+}
+
+void tipPosesBatch(const TipKinematics & kinematics, const float * angles, size_t count, float * positions, float * rotations,
+	TipPosePath path){
+	tipPosesRange(kinematics, angles, count, 0, count, positions, rotations, path);
+}
+
+struct TipPoseJob {
+	const TipKinematics * kinematics;
+	const float * angles;
+	size_t count;
+	float * positions;
+	float * rotations;
+	TipPosePath path;
+};
+
+static void runTipPoseJob(void * data, size_t begin, size_t end){
+	TipPoseJob * job = (TipPoseJob *)data;
+	tipPosesRange(*job->kinematics, job->angles, job->count, begin, end, job->positions, job->rotations, job->path);
+}
+
+void tipPosesBatchParallel(const TipKinematics & kinematics, const float * angles, size_t count, float * positions, float * rotations,
+	TipPosePath path){
+	TipPoseJob job = { &kinematics, angles, count, positions, rotations, path };
+	parallelFor(count, 4096, runTipPoseJob, &job);
+}
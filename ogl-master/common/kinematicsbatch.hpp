@@ -0,0 +1,40 @@
+#ifndef KINEMATICSBATCH_HPP
+#define KINEMATICSBATCH_HPP
+
+// Forward kinematics of one link of a JointChain (common/motionplanner) for many joint angle
+// vectors at once, for inverse kinematics restarts, planning and reachability maps. The
+// transforms between consecutive joints are folded together beforehand, so each pose costs
+// one sine, one cosine and a few dozen multiply-adds per joint on the path to the tip. Runs
+// eight poses at a time with AVX2 and FMA when the CPU has them, checked at run time, one
+// at a time otherwise. No OpenGL involved.
+//
+// Batches are structures of arrays : value k of pose i is at array[k * count + i].
+
+struct TipKinematics {
+	std::vector<int> joints;       // chain joints on the path from the root to the tip, root first
+	std::vector<float> constants;  // per joint 30 floats, then 12 for the tip, see the .cpp
+};
+
+// tipPoint is in tipLink's space, e.g. the end of the pen
+void initTipKinematics(TipKinematics & kinematics, const JointChain & chain, int tipLink, const glm::vec3 & tipPoint);
+
+enum TipPosePath {
+	TipPoseScalar,
+	TipPoseAvx2,
+};
+
+// The fastest path this CPU runs
+TipPosePath bestTipPosePath();
+
+// angles holds chain.jointCount() arrays, joints off the path are ignored. positions gets 3
+// arrays (x, y, z) and rotations, unless NULL, 9 (the columns of a 3x3 matrix). The paths
+// agree to within float rounding ; a given path gives the same result for a pose whatever
+// the batch.
+void tipPosesBatch(const TipKinematics & kinematics, const float * angles, size_t count, float * positions, float * rotations,
+	TipPosePath path = bestTipPosePath());
+
+// Same, spread over the job system (common/jobsystem)
+void tipPosesBatchParallel(const TipKinematics & kinematics, const float * angles, size_t count, float * positions, float * rotations,
+	TipPosePath path = bestTipPosePath());
+
+#endif
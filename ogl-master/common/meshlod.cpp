@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "meshlod.hpp"
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix : xx xy xz xw yy yz
+// yw zz zw ww. weight is the total weight of the planes, to turn sums into averages.
+struct Quadric {
+	double m[10];
+	double weight;
+};
+
+static void addPlane(Quadric & q, const glm::vec3 & n, float d, double weight){
+	double a = n.x, b = n.y, c = n.z, w = d;
+	q.m[0] += weight * a * a; q.m[1] += weight * a * b; q.m[2] += weight * a * c; q.m[3] += weight * a * w;
+	q.m[4] += weight * b * b; q.m[5] += weight * b * c; q.m[6] += weight * b * w;
+	q.m[7] += weight * c * c; q.m[8] += weight * c * w;
+	q.m[9] += weight * w * w;
+	q.weight += weight;
+}
+
+static void addQuadric(Quadric & q, const Quadric & other){
+	for (int i = 0; i < 10; i++)
+		q.m[i] += other.m[i];
+	q.weight += other.weight;
+}
+
+// Weighted mean squared distance from p to the planes of q and r together
+static double collapseCost(const Quadric & q, const Quadric & r, const glm::vec3 & p){
+	double m[10];
+	for (int i = 0; i < 10; i++)
+		m[i] = q.m[i] + r.m[i];
+	double x = p.x, y = p.y, z = p.z;
+	double cost = m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+		+ m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+		+ m[7] * z * z + 2 * m[8] * z
+		+ m[9];
+	double weight = q.weight + r.weight;
+	return weight > 0 ? std::max(cost, 0.0) / weight : 0.0;
+}
+
+struct Edge {
+	unsigned int a, b;  // welded vertices, a < b
+	unsigned int triangle;
+	bool operator<(const Edge & other) const { return a != other.a ? a < other.a : b < other.b; }
+	bool operator==(const Edge & other) const { return a == other.a && b == other.b; }
+};
+
+struct Collapse {
+	unsigned int from, to;
+	double cost;
+	bool operator<(const Collapse & other) const { return cost < other.cost; }
+};
+
+// Boundary edges are kept in place by planes through them, perpendicular to their triangle,
+// weighted this much more than the triangles' own planes
+static const double BoundaryWeight = 10.0;
+
+// Merged position of a welded vertex, following the collapses
+static unsigned int collapsedVertex(std::vector<unsigned int> & collapsedTo, unsigned int v){
+	unsigned int root = v;
+	while (collapsedTo[root] != root)
+		root = collapsedTo[root];
+	while (collapsedTo[v] != root){
+		unsigned int next = collapsedTo[v];
+		collapsedTo[v] = root;
+		v = next;
+	}
+	return root;
+}
+
+float simplifyMesh(const std::vector<unsigned short> & indices, const std::vector<glm::vec3> & positions,
+	const std::vector<glm::vec3> & normals, size_t targetIndexCount, std::vector<unsigned short> & result){
+	size_t vertexCount = positions.size();
+	result.clear();
+	if (vertexCount == 0)
+		return 0.0f;
+
+	// Weld vertices sharing a position : order them by position, then number the runs
+	std::vector<unsigned int> order(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+		order[i] = (unsigned int)i;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b){
+		const glm::vec3 & p = positions[a];
+		const glm::vec3 & q = positions[b];
+		if (p.x != q.x) return p.x < q.x;
+		if (p.y != q.y) return p.y < q.y;
+		return p.z < q.z;
+	});
+	std::vector<unsigned int> welded(vertexCount);
+	std::vector<unsigned int> weldStart;   // first of each welded vertex's runs, in order
+	for (size_t i = 0; i < vertexCount; i++){
+		if (i == 0 || positions[order[i]] != positions[order[i - 1]])
+			weldStart.push_back((unsigned int)i);
+		welded[order[i]] = (unsigned int)weldStart.size() - 1;
+	}
+	size_t weldedCount = weldStart.size();
+	weldStart.push_back((unsigned int)vertexCount);
+	std::vector<glm::vec3> weldedPositions(weldedCount);
+	for (size_t w = 0; w < weldedCount; w++)
+		weldedPositions[w] = positions[order[weldStart[w]]];
+
+	// Triangles, as original vertices so that corners can find their normals back
+	std::vector<unsigned int> triangles;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3){
+		unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+		if (welded[a] == welded[b] || welded[b] == welded[c] || welded[c] == welded[a])
+			continue;
+		triangles.push_back(a);
+		triangles.push_back(b);
+		triangles.push_back(c);
+	}
+
+	std::vector<Quadric> quadrics(weldedCount);
+	memset(&quadrics[0], 0, weldedCount * sizeof(Quadric));
+	std::vector<Edge> edges;
+	for (size_t t = 0; t < triangles.size() / 3; t++){
+		unsigned int w[3] = { welded[triangles[3 * t]], welded[triangles[3 * t + 1]], welded[triangles[3 * t + 2]] };
+		glm::vec3 normal = glm::cross(weldedPositions[w[1]] - weldedPositions[w[0]], weldedPositions[w[2]] - weldedPositions[w[0]]);
+		float length = glm::length(normal);
+		if (length == 0.0f)
+			continue;
+		normal /= length;
+		float d = -glm::dot(normal, weldedPositions[w[0]]);
+		for (int k = 0; k < 3; k++){
+			addPlane(quadrics[w[k]], normal, d, 0.5 * length);
+			Edge edge = { std::min(w[k], w[(k + 1) % 3]), std::max(w[k], w[(k + 1) % 3]), (unsigned int)t };
+			edges.push_back(edge);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	for (size_t i = 0; i < edges.size(); i++){
+		bool shared = (i > 0 && edges[i] == edges[i - 1]) || (i + 1 < edges.size() && edges[i] == edges[i + 1]);
+		if (shared)
+			continue;
+		unsigned int a = edges[i].a, b = edges[i].b;
+		size_t t = edges[i].triangle;
+		const glm::vec3 & p0 = weldedPositions[welded[triangles[3 * t]]];
+		glm::vec3 normal = glm::cross(weldedPositions[welded[triangles[3 * t + 1]]] - p0, weldedPositions[welded[triangles[3 * t + 2]]] - p0);
+		glm::vec3 edge = weldedPositions[b] - weldedPositions[a];
+		glm::vec3 side = glm::cross(edge, normal);
+		float length = glm::length(side);
+		if (length == 0.0f)
+			continue;
+		side /= length;
+		float d = -glm::dot(side, weldedPositions[a]);
+		double weight = BoundaryWeight * glm::dot(edge, edge);
+		addPlane(quadrics[a], side, d, weight);
+		addPlane(quadrics[b], side, d, weight);
+	}
+
+	// Passes of independent collapses, cheapest first : a collapse locks the triangles around
+	// both its ends until the next pass, which sees the new connectivity
+	std::vector<unsigned int> collapsedTo(weldedCount);
+	for (size_t w = 0; w < weldedCount; w++)
+		collapsedTo[w] = (unsigned int)w;
+	size_t targetTriangles = targetIndexCount / 3;
+	double maxCost = 0.0;
+	std::vector<unsigned int> corners;  // current welded vertices of each triangle
+	std::vector<unsigned int> aroundStart, around;  // triangles around each welded vertex
+	std::vector<Collapse> collapses;
+	std::vector<char> locked;
+	while (triangles.size() / 3 > targetTriangles){
+		size_t triangleCount = triangles.size() / 3;
+		corners.resize(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i++)
+			corners[i] = collapsedVertex(collapsedTo, welded[triangles[i]]);
+
+		aroundStart.assign(weldedCount + 1, 0);
+		for (size_t i = 0; i < corners.size(); i++)
+			aroundStart[corners[i] + 1]++;
+		for (size_t w = 0; w < weldedCount; w++)
+			aroundStart[w + 1] += aroundStart[w];
+		around.resize(corners.size());
+		std::vector<unsigned int> fill(aroundStart.begin(), aroundStart.end() - 1);
+		for (size_t i = 0; i < corners.size(); i++)
+			around[fill[corners[i]]++] = (unsigned int)(i / 3);
+
+		// The cheaper direction of each edge ; edges are seen once per triangle, duplicates are harmless
+		collapses.clear();
+		for (size_t i = 0; i < corners.size(); i++){
+			unsigned int a = corners[i], b = corners[i % 3 == 2 ? i - 2 : i + 1];
+			double ab = collapseCost(quadrics[a], quadrics[b], weldedPositions[b]);
+			double ba = collapseCost(quadrics[a], quadrics[b], weldedPositions[a]);
+			Collapse collapse = { ab <= ba ? a : b, ab <= ba ? b : a, std::min(ab, ba) };
+			collapses.push_back(collapse);
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		locked.assign(weldedCount, 0);
+		size_t removed = 0;
+		for (const Collapse & collapse : collapses){
+			if (removed >= triangleCount - targetTriangles)
+				break;
+			if (locked[collapse.from] || locked[collapse.to])
+				continue;
+
+			// Refuse collapses that fold a remaining triangle over
+			bool folds = false;
+			size_t lost = 0;
+			for (unsigned int k = aroundStart[collapse.from]; k < aroundStart[collapse.from + 1] && !folds; k++){
+				const unsigned int * c = &corners[3 * around[k]];
+				if (c[0] == collapse.to || c[1] == collapse.to || c[2] == collapse.to){
+					lost++;
+					continue;
+				}
+				glm::vec3 p[3], q[3];
+				for (int j = 0; j < 3; j++){
+					p[j] = weldedPositions[c[j]];
+					q[j] = weldedPositions[c[j] == collapse.from ? collapse.to : c[j]];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				folds = glm::dot(before, after) <= 0.0f;
+			}
+			if (folds)
+				continue;
+
+			collapsedTo[collapse.from] = collapse.to;
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			maxCost = std::max(maxCost, collapse.cost);
+			removed += lost;
+			unsigned int ends[2] = { collapse.from, collapse.to };
+			for (unsigned int end : ends)
+				for (unsigned int k = aroundStart[end]; k < aroundStart[end + 1]; k++)
+					for (int j = 0; j < 3; j++)
+						locked[corners[3 * around[k] + j]] = 1;
+		}
+		if (removed == 0)
+			break; // nothing left that doesn't fold
+
+		// Drop the triangles that collapsed to a line
+		size_t kept = 0;
+		for (size_t t = 0; t < triangleCount; t++){
+			unsigned int a = collapsedVertex(collapsedTo, corners[3 * t]);
+			unsigned int b = collapsedVertex(collapsedTo, corners[3 * t + 1]);
+			unsigned int c = collapsedVertex(collapsedTo, corners[3 * t + 2]);
+			if (a == b || b == c || c == a)
+				continue;
+			for (int j = 0; j < 3; j++)
+				triangles[3 * kept + j] = triangles[3 * t + j];
+			kept++;
+		}
+		triangles.resize(3 * kept);
+	}
+
+	// Back to real vertices : a corner whose position went away takes the vertex of the kept
+	// position with the closest normal
+	result.reserve(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++){
+		unsigned int v = triangles[i];
+		unsigned int w = collapsedVertex(collapsedTo, welded[v]);
+		if (w != welded[v]){
+			float best = -2.0f;
+			for (unsigned int k = weldStart[w]; k < weldStart[w + 1]; k++){
+				float similarity = glm::dot(normals[order[k]], normals[triangles[i]]);
+				if (similarity > best){
+					best = similarity;
+					v = order[k];
+				}
+			}
+		}
+		result.push_back((unsigned short)v);
+	}
+	return (float)sqrt(maxCost);
+}
+
+void buildMeshLods(const std::vector<unsigned short> & indices, const std::vector<glm::vec3> & positions,
+	const std::vector<glm::vec3> & normals, unsigned int levelCount, float ratio, MeshLodChain & chain){
+	chain.levels.clear();
+	chain.vertexOrder.clear();
+	chain.indices = indices;
+	MeshLodLevel full = { 0, indices.size(), 0.0f };
+	chain.levels.push_back(full);
+
+	std::vector<unsigned short> simplified;
+	while (chain.levels.size() < levelCount){
+		size_t previous = chain.levels.back().indexCount;
+		size_t target = (size_t)(previous / 3 * ratio) * 3;
+		if (target < 3)
+			break;
+		// From the full mesh every time, so that errors don't pile up level after level
+		float error = simplifyMesh(indices, positions, normals, target, simplified);
+		if (simplified.empty() || simplified.size() >= previous)
+			break;
+		MeshLodLevel level = { chain.indices.size(), simplified.size(), error };
+		chain.levels.push_back(level);
+		chain.indices.insert(chain.indices.end(), simplified.begin(), simplified.end());
+	}
+}
+
+static const unsigned int LodCacheMagic = 0x43444F4C; // "LODC"
+static const unsigned int LodCacheVersion = 2;
+
+struct LodCacheHeader {
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long sourceSize;
+	unsigned long long sourceTime;
+	unsigned long long vertexCount;
+	unsigned long long indexCount;
+	unsigned int levelCount;
+	unsigned int orderCount;
+};
+
+static bool getSourceStamp(const char * sourcepath, LodCacheHeader & header){
+	struct stat st;
+	if (stat(sourcepath, &st) != 0)
+		return false;
+	header.sourceSize = (unsigned long long)st.st_size;
+	header.sourceTime = (unsigned long long)st.st_mtime;
+	return true;
+}
+
+bool saveMeshLods(const char * cachepath, const char * sourcepath, size_t vertexCount, const MeshLodChain & chain){
+	LodCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	if (!getSourceStamp(sourcepath, header) || chain.levels.empty())
+		return false;
+	header.magic = LodCacheMagic;
+	header.version = LodCacheVersion;
+	header.vertexCount = vertexCount;
+	header.indexCount = chain.indices.size();
+	header.levelCount = (unsigned int)chain.levels.size();
+	header.orderCount = (unsigned int)chain.vertexOrder.size();
+
+	FILE * file = fopen(cachepath, "wb");
+	if (file == NULL){
+		printf("Could not write LOD cache %s\n", cachepath);
+		return false;
+	}
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(&chain.levels[0], sizeof(MeshLodLevel), chain.levels.size(), file);
+	if (!chain.indices.empty())
+		fwrite(&chain.indices[0], sizeof(unsigned short), chain.indices.size(), file);
+	if (!chain.vertexOrder.empty())
+		fwrite(&chain.vertexOrder[0], sizeof(unsigned short), chain.vertexOrder.size(), file);
+	fclose(file);
+	return true;
+}
+
+bool loadMeshLods(const char * cachepath, const char * sourcepath, size_t vertexCount, MeshLodChain & chain){
+	FILE * file = fopen(cachepath, "rb");
+	if (file == NULL)
+		return false;
+
+	LodCacheHeader header, expected;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1
+		&& getSourceStamp(sourcepath, expected)
+		&& header.magic == LodCacheMagic && header.version == LodCacheVersion
+		&& header.sourceSize == expected.sourceSize && header.sourceTime == expected.sourceTime
+		&& header.vertexCount == vertexCount && header.levelCount > 0;
+	if (ok){
+		chain.levels.resize(header.levelCount);
+		chain.indices.resize(header.indexCount);
+		chain.vertexOrder.resize(header.orderCount);
+		ok = fread(&chain.levels[0], sizeof(MeshLodLevel), header.levelCount, file) == header.levelCount
+			&& (header.indexCount == 0 || fread(&chain.indices[0], sizeof(unsigned short), header.indexCount, file) == header.indexCount)
+			&& (header.orderCount == 0 || fread(&chain.vertexOrder[0], sizeof(unsigned short), header.orderCount, file) == header.orderCount);
+	}
+	// Every level within the indices, and every index within the vertices
+	size_t indexedCount = chain.vertexOrder.empty() ? vertexCount : chain.vertexOrder.size();
+	for (size_t i = 0; ok && i < chain.levels.size(); i++)
+		ok = chain.levels[i].firstIndex + chain.levels[i].indexCount <= chain.indices.size();
+	for (size_t i = 0; ok && i < chain.indices.size(); i++)
+		ok = chain.indices[i] < indexedCount;
+	for (size_t i = 0; ok && i < chain.vertexOrder.size(); i++)
+		ok = chain.vertexOrder[i] < vertexCount;
+	fclose(file);
+	return ok;
+}
+
+unsigned int selectMeshLod(float screenRadius, const float * switchRadii, unsigned int levelCount, unsigned int currentLevel, float hysteresis){
+	if (levelCount == 0)
+		return 0;
+	unsigned int level = std::min(currentLevel, levelCount - 1);
+	while (level + 1 < levelCount && screenRadius < switchRadii[level] * (1.0f - hysteresis))
+		level++;
+	while (level > 0 && screenRadius > switchRadii[level - 1] * (1.0f + hysteresis))
+		level--;
+	return level;
+}
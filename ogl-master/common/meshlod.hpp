@@ -0,0 +1,45 @@
+#ifndef MESHLOD_HPP
+#define MESHLOD_HPP
+
+// Levels of detail of an indexed mesh, as made by indexVBO, simplified with quadric error
+// metrics (Garland and Heckbert). Each edge collapse moves a vertex onto one of its
+// neighbours, so every level indexes the same vertices : only the index lists differ.
+//
+// Vertices at the same position with different normals (hard edges) collapse together ;
+// each corner then takes the vertex of the kept position whose normal is closest to its own.
+// No OpenGL involved.
+
+struct MeshLodLevel {
+	size_t firstIndex;  // into MeshLodChain::indices
+	size_t indexCount;
+	float error;        // estimated distance to the original surface, in mesh units
+};
+
+struct MeshLodChain {
+	std::vector<MeshLodLevel> levels;  // level 0 is the mesh itself
+	std::vector<unsigned short> indices;
+	// When the vertices were reordered after indexVBO (see meshoptimize.hpp), the indexVBO
+	// vertex each one comes from ; empty otherwise. Saved with the levels.
+	std::vector<unsigned short> vertexOrder;
+};
+
+// Each level keeps about `ratio` of the triangles of the one before. Fewer levels come out
+// when a mesh can't be simplified any further without folding triangles over.
+void buildMeshLods(const std::vector<unsigned short> & indices, const std::vector<glm::vec3> & positions,
+	const std::vector<glm::vec3> & normals, unsigned int levelCount, float ratio, MeshLodChain & chain);
+
+// One level, of at most targetIndexCount indices when it can be reached. Returns the error.
+float simplifyMesh(const std::vector<unsigned short> & indices, const std::vector<glm::vec3> & positions,
+	const std::vector<glm::vec3> & normals, size_t targetIndexCount, std::vector<unsigned short> & result);
+
+// Like the mip chain caches, LOD cache files remember the size and modification time of the
+// mesh they were built from, and the number of vertices indexVBO made of it
+bool saveMeshLods(const char * cachepath, const char * sourcepath, size_t vertexCount, const MeshLodChain & chain);
+bool loadMeshLods(const char * cachepath, const char * sourcepath, size_t vertexCount, MeshLodChain & chain);
+
+// Level to draw for a bounding sphere covering screenRadius pixels, given the one drawn so far.
+// Level i + 1 replaces level i under switchRadii[i] (decreasing radii), but only once the
+// radius is past it by `hysteresis` (a fraction of it), so that levels don't flicker.
+unsigned int selectMeshLod(float screenRadius, const float * switchRadii, unsigned int levelCount, unsigned int currentLevel, float hysteresis);
+
+#endif
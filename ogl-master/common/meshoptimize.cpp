@@ -0,0 +1,154 @@
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "meshoptimize.hpp"
+
+// Scoring constants from Forsyth's article. The cache modelled is larger than most real ones,
+// which only makes it favour recent vertices a little longer.
+static const int ScoredCacheSize = 32;
+static const float CacheDecayPower = 1.5f;
+static const float LastTriangleScore = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+
+// How much drawing a triangle through this vertex now is worth : more while the vertex is
+// recent in the cache, and more when few triangles are left to use it
+static float vertexScore(int cachePosition, unsigned int liveTriangles){
+	if (liveTriangles == 0)
+		return -1.0f;
+	float score = 0.0f;
+	if (cachePosition >= 0){
+		if (cachePosition < 3)
+			score = LastTriangleScore; // in the triangle just drawn : no point in favouring it more
+		else
+			score = powf(1.0f - (cachePosition - 3) * (1.0f / (ScoredCacheSize - 3)), CacheDecayPower);
+	}
+	return score + ValenceBoostScale * powf((float)liveTriangles, -ValenceBoostPower);
+}
+
+void optimizeVertexCache(std::vector<unsigned short> & indices, size_t vertexCount){
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangles around each vertex ; the first liveTriangles[v] of them aren't drawn yet
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		liveTriangles[indices[i]]++;
+	std::vector<unsigned int> aroundStart(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		aroundStart[v + 1] = aroundStart[v] + liveTriangles[v];
+	std::vector<unsigned int> around(triangleCount * 3);
+	std::vector<unsigned int> fill(aroundStart.begin(), aroundStart.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		around[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> scores(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		scores[v] = vertexScore(-1, liveTriangles[v]);
+	std::vector<float> triangleScores(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScores[t] = scores[indices[3 * t]] + scores[indices[3 * t + 1]] + scores[indices[3 * t + 2]];
+	std::vector<char> drawn(triangleCount, 0);
+
+	int best = (int)(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+	std::vector<unsigned int> cache, grown;
+	std::vector<unsigned short> result;
+	result.reserve(triangleCount * 3);
+	size_t cursor = 0;
+	while (result.size() < triangleCount * 3){
+		// Dead end, nothing in the cache has triangles left : carry on with the next one in order
+		if (best < 0){
+			while (drawn[cursor])
+				cursor++;
+			best = (int)cursor;
+		}
+
+		const unsigned short * corners = &indices[3 * best];
+		result.insert(result.end(), corners, corners + 3);
+		drawn[best] = 1;
+		for (int k = 0; k < 3; k++){
+			unsigned int v = corners[k];
+			unsigned int * live = &around[aroundStart[v]];
+			unsigned int * last = live + liveTriangles[v] - 1;
+			std::swap(*std::find(live, last, (unsigned int)best), *last);
+			liveTriangles[v]--;
+		}
+
+		// The triangle's vertices move to the front of the cache, pushing the others back
+		grown.assign(corners, corners + 3);
+		for (unsigned int v : cache)
+			if (v != corners[0] && v != corners[1] && v != corners[2])
+				grown.push_back(v);
+		for (size_t i = 0; i < grown.size(); i++){
+			cachePosition[grown[i]] = i < (size_t)ScoredCacheSize ? (int)i : -1;
+			scores[grown[i]] = vertexScore(cachePosition[grown[i]], liveTriangles[grown[i]]);
+		}
+
+		// Only the triangles around those vertices changed score : the next best is one of them
+		best = -1;
+		float bestScore = -1.0f;
+		for (unsigned int v : grown){
+			for (unsigned int k = aroundStart[v]; k < aroundStart[v] + liveTriangles[v]; k++){
+				unsigned int t = around[k];
+				float score = scores[indices[3 * t]] + scores[indices[3 * t + 1]] + scores[indices[3 * t + 2]];
+				triangleScores[t] = score;
+				if (score > bestScore){
+					bestScore = score;
+					best = (int)t;
+				}
+			}
+		}
+		if (grown.size() > (size_t)ScoredCacheSize)
+			grown.resize(ScoredCacheSize);
+		cache.swap(grown);
+	}
+	indices.swap(result);
+}
+
+void optimizeVertexFetch(std::vector<unsigned short> & indices, size_t vertexCount, std::vector<unsigned short> & order){
+	const unsigned int Unused = 0xFFFFFFFF;
+	std::vector<unsigned int> renumbered(vertexCount, Unused);
+	order.clear();
+	for (size_t i = 0; i < indices.size(); i++){
+		unsigned short v = indices[i];
+		if (renumbered[v] == Unused){
+			renumbered[v] = (unsigned int)order.size();
+			order.push_back(v);
+		}
+		indices[i] = (unsigned short)renumbered[v];
+	}
+}
+
+void reorderVertices(std::vector<glm::vec3> & attribute, const std::vector<unsigned short> & order){
+	std::vector<glm::vec3> reordered(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+		reordered[i] = attribute[order[i]];
+	attribute.swap(reordered);
+}
+
+void analyzeVertexCache(const unsigned short * indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize,
+	float & acmr, float & atvr){
+	// A vertex is in the cache when fewer than cacheSize misses happened since its own
+	std::vector<unsigned int> missedAt(vertexCount, 0);
+	std::vector<char> used(vertexCount, 0);
+	unsigned int misses = 0;
+	size_t usedCount = 0;
+	for (size_t i = 0; i < indexCount; i++){
+		unsigned short v = indices[i];
+		if (!used[v] || misses - missedAt[v] >= cacheSize){
+			misses++;
+			missedAt[v] = misses;
+		}
+		if (!used[v]){
+			used[v] = 1;
+			usedCount++;
+		}
+	}
+	acmr = indexCount >= 3 ? (float)misses / (indexCount / 3) : 0.0f;
+	atvr = usedCount > 0 ? (float)misses / usedCount : 0.0f;
+}
@@ -0,0 +1,23 @@
+#ifndef MESHOPTIMIZE_HPP
+#define MESHOPTIMIZE_HPP
+
+// Post-load ordering of indexed triangle meshes, as made by indexVBO. No OpenGL involved.
+//
+// optimizeVertexCache() reorders the triangles so that consecutive ones share vertices still
+// in the GPU's post-transform cache (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation").
+// optimizeVertexFetch() then renumbers the vertices in the order the triangles first use
+// them, so that vertex fetches walk the buffer forward.
+
+void optimizeVertexCache(std::vector<unsigned short> & indices, size_t vertexCount);
+
+// Fills order with the old index of each new vertex ; vertices no triangle uses are dropped.
+// Apply it to every vertex attribute with reorderVertices().
+void optimizeVertexFetch(std::vector<unsigned short> & indices, size_t vertexCount, std::vector<unsigned short> & order);
+void reorderVertices(std::vector<glm::vec3> & attribute, const std::vector<unsigned short> & order);
+
+// Simulates a FIFO post-transform cache of cacheSize vertices : average cache misses per
+// triangle (ACMR, 0.5 at best on large meshes, 3 at worst) and per vertex used (ATVR, 1 at best)
+void analyzeVertexCache(const unsigned short * indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize,
+	float & acmr, float & atvr);
+
+#endif
@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "objloader.hpp"
+#include "vboindexer.hpp"
+#include "meshlod.hpp"
+#include "meshoptimize.hpp"
+#include "glstate.hpp"
+#include "meshregistry.hpp"
+
+// Same layout as the Vertex struct of the standard shading programs
+struct MeshVertex {
+	float position[4];
+	float color[4];
+	float normal[3];
+};
+
+struct MeshEntry {
+	std::string path;       // first path it was loaded from
+	glm::vec4 color;
+	int references;
+	unsigned long lastUsed; // useClock when last acquired or released
+
+	// Only while resident : ranges of the arena buffers, in vertices and indices. The index
+	// range holds every level of detail, one after the other.
+	bool resident;
+	size_t firstVertex, vertexCount;
+	size_t firstIndex, rangeIndexCount;
+	GLsizei indexCount;
+	std::vector<MeshLodLevel> lods;  // firstIndex relative to the mesh's
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+	size_t residentBytes;
+};
+
+struct FreeRange {
+	size_t offset, count;
+};
+
+// First fit sub-allocator over [0, capacity), in elements. Freed ranges merge with their
+// neighbours, so meshes evicted one after the other leave room for a larger one.
+struct RangeAllocator {
+	std::vector<FreeRange> freeRanges; // sorted by offset
+	size_t capacity;
+
+	bool allocate(size_t count, size_t & offset){
+		for (size_t i = 0; i < freeRanges.size(); i++){
+			if (freeRanges[i].count < count)
+				continue;
+			offset = freeRanges[i].offset;
+			freeRanges[i].offset += count;
+			freeRanges[i].count -= count;
+			if (freeRanges[i].count == 0)
+				freeRanges.erase(freeRanges.begin() + i);
+			return true;
+		}
+		return false;
+	}
+
+	void release(size_t offset, size_t count){
+		if (count == 0)
+			return;
+		size_t i = 0;
+		while (i < freeRanges.size() && freeRanges[i].offset < offset)
+			i++;
+		FreeRange range = { offset, count };
+		freeRanges.insert(freeRanges.begin() + i, range);
+		if (i + 1 < freeRanges.size() && freeRanges[i].offset + freeRanges[i].count == freeRanges[i + 1].offset){
+			freeRanges[i].count += freeRanges[i + 1].count;
+			freeRanges.erase(freeRanges.begin() + i + 1);
+		}
+		if (i > 0 && freeRanges[i - 1].offset + freeRanges[i - 1].count == freeRanges[i].offset){
+			freeRanges[i - 1].count += freeRanges[i].count;
+			freeRanges.erase(freeRanges.begin() + i);
+		}
+	}
+
+	void grow(size_t newCapacity){
+		release(capacity, newCapacity - capacity);
+		capacity = newCapacity;
+	}
+};
+
+// Every mesh shares one vertex array object, one vertex buffer and one index buffer
+static GLuint arenaVertexArrayID = 0;
+static GLuint arenaVertexBufferID = 0;
+static GLuint arenaIndexBufferID = 0;
+static RangeAllocator vertexRanges = { std::vector<FreeRange>(), 0 };
+static RangeAllocator indexRanges = { std::vector<FreeRange>(), 0 };
+static const size_t initialArenaVertices = 64 * 1024;
+static const size_t initialArenaIndices = 256 * 1024;
+
+// Indirect submission : one command and one model matrix per queued draw. Each command's
+// baseInstance points the per instance matrix attributes at its own matrix.
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+static const GLuint instanceMatrixLocation = 3; // a mat4 takes locations 3 to 6
+static GLuint indirectBufferID = 0;
+static GLuint instanceBufferID = 0;
+static size_t drawCapacity = 0;  // commands and matrices the two buffers hold
+static size_t frameDraws = 0;    // already used this frame
+static std::vector<DrawElementsIndirectCommand> queuedCommands;
+static std::vector<glm::mat4> queuedMatrices;
+static unsigned int drawCalls = 0;
+static size_t drawnTriangles = 0;
+
+// Levels of detail built for each mesh, each with about half the triangles of the one before
+static const unsigned int lodLevelCount = 4;
+static const float lodRatio = 0.5f;
+
+// Post-transform cache size the ACMR and ATVR printed on first load are measured for
+static const unsigned int vertexCacheSize = 16;
+
+static std::vector<MeshEntry> meshes;
+static std::unordered_map<std::string, int> meshesByPath;  // path and color
+static std::unordered_map<uint64_t, int> meshesByContent;  // file and color hash
+static size_t budgetBytes = 0;
+static size_t residentBytes = 0;
+static unsigned long useClock = 0;
+
+// 64 bit FNV-1a
+static uint64_t hashBytes(const void * data, size_t size, uint64_t hash = 14695981039346656037ULL){
+	const unsigned char * bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	return hash;
+}
+
+static bool hashFile(const char * path, const glm::vec4 & color, uint64_t & hash){
+	FILE * file = fopen(path, "rb");
+	if (file == NULL){
+		printf("Impossible to open %s\n", path);
+		return false;
+	}
+	hash = hashBytes(&color[0], sizeof(color));
+	unsigned char buffer[16 * 1024];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		hash = hashBytes(buffer, read, hash);
+	fclose(file);
+	return true;
+}
+
+static void pointAttributes(){
+	glBindBuffer(GL_ARRAY_BUFFER, arenaVertexBufferID);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, position));
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, color));
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, normal));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+}
+
+// Moves a buffer's content into a larger one, on the GPU
+static GLuint growBuffer(GLuint buffer, size_t oldBytes, size_t newBytes){
+	GLuint grown;
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+	if (buffer != 0){
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+		glDeleteBuffers(1, &buffer);
+	}
+	return grown;
+}
+
+// Finds room for the mesh in the arena, growing its buffers when they are full
+static void allocateArenaRanges(MeshEntry & mesh, size_t vertexCount, size_t indexCount){
+	if (arenaVertexArrayID == 0)
+		glGenVertexArrays(1, &arenaVertexArrayID);
+	bindVertexArray(arenaVertexArrayID);
+
+	while (!vertexRanges.allocate(vertexCount, mesh.firstVertex)){
+		size_t capacity = std::max(vertexRanges.capacity * 2, std::max(initialArenaVertices, vertexRanges.capacity + vertexCount));
+		arenaVertexBufferID = growBuffer(arenaVertexBufferID, vertexRanges.capacity * sizeof(MeshVertex), capacity * sizeof(MeshVertex));
+		vertexRanges.grow(capacity);
+		pointAttributes();
+	}
+	while (!indexRanges.allocate(indexCount, mesh.firstIndex)){
+		size_t capacity = std::max(indexRanges.capacity * 2, std::max(initialArenaIndices, indexRanges.capacity + indexCount));
+		arenaIndexBufferID = growBuffer(arenaIndexBufferID, indexRanges.capacity * sizeof(unsigned short), capacity * sizeof(unsigned short));
+		indexRanges.grow(capacity);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arenaIndexBufferID);
+	}
+	bindVertexArray(0);
+}
+
+// .obj files go through loadOBJ(), anything else through Assimp when it is built in
+static bool importMesh(const std::string & path, std::vector<unsigned short> & indices,
+	std::vector<glm::vec3> & indexedVertices, std::vector<glm::vec3> & indexedNormals){
+	size_t dot = path.rfind('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	if (extension == "obj"){
+		std::vector<glm::vec3> vertices, normals;
+		if (!loadOBJ(path.c_str(), vertices, normals))
+			return false;
+		indexVBO(vertices, normals, indices, indexedVertices, indexedNormals);
+		return true;
+	}
+#ifdef USE_ASSIMP
+	return loadAssImp(path.c_str(), indices, indexedVertices, indexedNormals);
+#else
+	printf("%s : built without Assimp, only .obj meshes can be loaded\n", path.c_str());
+	return false;
+#endif
+}
+
+// Loads, indexes and uploads the mesh ; the CPU copies die with this function
+static bool uploadMesh(MeshEntry & mesh){
+	std::vector<unsigned short> indices;
+	std::vector<glm::vec3> indexedVertices, indexedNormals;
+	if (!importMesh(mesh.path, indices, indexedVertices, indexedNormals))
+		return false;
+
+	// Ordering and simplifying take much longer than loading, so the results are kept next
+	// to the mesh : the vertex order and the index lists of every level
+	MeshLodChain chain;
+	std::string cachepath = mesh.path + ".lods";
+	if (loadMeshLods(cachepath.c_str(), mesh.path.c_str(), indexedVertices.size(), chain)){
+		if (!chain.vertexOrder.empty()){
+			reorderVertices(indexedVertices, chain.vertexOrder);
+			reorderVertices(indexedNormals, chain.vertexOrder);
+		}
+	}else{
+		float acmrBefore, atvrBefore, acmr, atvr;
+		analyzeVertexCache(indices.data(), indices.size(), indexedVertices.size(), vertexCacheSize, acmrBefore, atvrBefore);
+
+		// Triangles first, then vertices in the order those triangles use them
+		std::vector<unsigned short> vertexOrder;
+		optimizeVertexCache(indices, indexedVertices.size());
+		optimizeVertexFetch(indices, indexedVertices.size(), vertexOrder);
+		size_t sourceVertexCount = indexedVertices.size();
+		reorderVertices(indexedVertices, vertexOrder);
+		reorderVertices(indexedNormals, vertexOrder);
+
+		// Simplified levels come out in the order of their collapses : sort them again
+		buildMeshLods(indices, indexedVertices, indexedNormals, lodLevelCount, lodRatio, chain);
+		for (size_t l = 1; l < chain.levels.size(); l++){
+			std::vector<unsigned short> level(chain.indices.begin() + chain.levels[l].firstIndex,
+				chain.indices.begin() + chain.levels[l].firstIndex + chain.levels[l].indexCount);
+			optimizeVertexCache(level, indexedVertices.size());
+			std::copy(level.begin(), level.end(), chain.indices.begin() + chain.levels[l].firstIndex);
+		}
+		chain.vertexOrder = vertexOrder;
+		analyzeVertexCache(indices.data(), indices.size(), indexedVertices.size(), vertexCacheSize, acmr, atvr);
+		printf("Optimized %s : ACMR %.2f -> %.2f, ATVR %.2f -> %.2f\n", mesh.path.c_str(), acmrBefore, acmr, atvrBefore, atvr);
+		saveMeshLods(cachepath.c_str(), mesh.path.c_str(), sourceVertexCount, chain);
+	}
+
+	glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+	if (!indexedVertices.empty())
+		boundsMin = boundsMax = indexedVertices[0];
+	for (const glm::vec3 & p : indexedVertices){
+		boundsMin = glm::min(boundsMin, p);
+		boundsMax = glm::max(boundsMax, p);
+	}
+	mesh.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+	mesh.boundsRadius = 0.0f;
+	for (const glm::vec3 & p : indexedVertices)
+		mesh.boundsRadius = std::max(mesh.boundsRadius, glm::length(p - mesh.boundsCenter));
+
+	std::vector<MeshVertex> meshVertices(indexedVertices.size());
+	for (size_t i = 0; i < meshVertices.size(); i++){
+		MeshVertex & v = meshVertices[i];
+		v.position[0] = indexedVertices[i].x;
+		v.position[1] = indexedVertices[i].y;
+		v.position[2] = indexedVertices[i].z;
+		v.position[3] = 1.0f;
+		memcpy(v.color, &mesh.color[0], sizeof(v.color));
+		memcpy(v.normal, &indexedNormals[i].x, sizeof(v.normal));
+	}
+
+	// Indices stay relative to the mesh ; draws add firstVertex as their base vertex.
+	// The copy targets leave the element array binding of whatever VAO is bound alone.
+	allocateArenaRanges(mesh, meshVertices.size(), chain.indices.size());
+	if (!meshVertices.empty()){
+		glBindBuffer(GL_COPY_WRITE_BUFFER, arenaVertexBufferID);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, mesh.firstVertex * sizeof(MeshVertex), meshVertices.size() * sizeof(MeshVertex), &meshVertices[0]);
+	}
+	if (!chain.indices.empty()){
+		glBindBuffer(GL_COPY_WRITE_BUFFER, arenaIndexBufferID);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, mesh.firstIndex * sizeof(unsigned short), chain.indices.size() * sizeof(unsigned short), &chain.indices[0]);
+	}
+
+	mesh.vertexCount = meshVertices.size();
+	mesh.rangeIndexCount = chain.indices.size();
+	mesh.lods = chain.levels;
+	mesh.indexCount = (GLsizei)chain.levels[0].indexCount;
+	mesh.residentBytes = meshVertices.size() * sizeof(MeshVertex) + chain.indices.size() * sizeof(unsigned short);
+	mesh.resident = true;
+	residentBytes += mesh.residentBytes;
+	return true;
+}
+
+static void evictMesh(MeshEntry & mesh){
+	vertexRanges.release(mesh.firstVertex, mesh.vertexCount);
+	indexRanges.release(mesh.firstIndex, mesh.rangeIndexCount);
+	residentBytes -= mesh.residentBytes;
+	mesh.residentBytes = 0;
+	mesh.resident = false;
+}
+
+// Evicts unreferenced meshes, least recently used first, until the budget is met
+static void enforceBudget(){
+	while (residentBytes > budgetBytes){
+		int oldest = -1;
+		for (size_t i = 0; i < meshes.size(); i++){
+			const MeshEntry & mesh = meshes[i];
+			if (mesh.resident && mesh.references == 0 && (oldest < 0 || mesh.lastUsed < meshes[oldest].lastUsed))
+				oldest = (int)i;
+		}
+		if (oldest < 0)
+			return; // everything left is in use
+		evictMesh(meshes[oldest]);
+	}
+}
+
+void initMeshRegistry(size_t gpuBudgetBytes){
+	budgetBytes = gpuBudgetBytes;
+}
+
+void setMeshBudget(size_t gpuBudgetBytes){
+	budgetBytes = gpuBudgetBytes;
+	enforceBudget();
+}
+
+int acquireMesh(const char * path, const glm::vec4 & color){
+	char colorKey[64];
+	snprintf(colorKey, sizeof(colorKey), "|%g,%g,%g,%g", color.r, color.g, color.b, color.a);
+	std::string key = std::string(path) + colorKey;
+
+	int index;
+	std::unordered_map<std::string, int>::iterator byPath = meshesByPath.find(key);
+	if (byPath != meshesByPath.end()){
+		index = byPath->second;
+	}else{
+		// Unknown path : maybe a copy of a mesh we already have
+		uint64_t hash;
+		if (!hashFile(path, color, hash))
+			return -1;
+		std::unordered_map<uint64_t, int>::iterator byContent = meshesByContent.find(hash);
+		if (byContent != meshesByContent.end()){
+			index = byContent->second;
+		}else{
+			MeshEntry mesh;
+			mesh.path = path;
+			mesh.color = color;
+			mesh.references = 0;
+			mesh.lastUsed = 0;
+			mesh.resident = false;
+			mesh.firstVertex = mesh.vertexCount = mesh.firstIndex = mesh.rangeIndexCount = 0;
+			mesh.boundsCenter = glm::vec3(0.0f);
+			mesh.boundsRadius = 0.0f;
+			mesh.indexCount = 0;
+			mesh.residentBytes = 0;
+			if (!uploadMesh(mesh))
+				return -1;
+			index = (int)meshes.size();
+			meshes.push_back(mesh);
+			meshesByContent[hash] = index;
+		}
+		meshesByPath[key] = index;
+	}
+
+	MeshEntry & mesh = meshes[index];
+	if (!mesh.resident && !uploadMesh(mesh))
+		return -1;
+	mesh.references++;
+	mesh.lastUsed = ++useClock;
+	enforceBudget();
+	if (residentBytes > budgetBytes)
+		printf("Meshes in use take %lu KB, over the %lu KB budget\n", (unsigned long)(residentBytes / 1024), (unsigned long)(budgetBytes / 1024));
+	return index;
+}
+
+void retainMesh(int mesh){
+	meshes[mesh].references++;
+}
+
+void releaseMesh(int mesh){
+	if (mesh < 0 || meshes[mesh].references <= 0)
+		return;
+	meshes[mesh].references--;
+	meshes[mesh].lastUsed = ++useClock;
+	enforceBudget();
+}
+
+void bindMeshArena(){
+	bindVertexArray(arenaVertexArrayID);
+}
+
+void drawMesh(int mesh, unsigned int lod){
+	const MeshEntry & entry = meshes[mesh];
+	const MeshLodLevel & level = entry.lods[std::min<size_t>(lod, entry.lods.size() - 1)];
+	glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)level.indexCount, GL_UNSIGNED_SHORT,
+		(void*)((entry.firstIndex + level.firstIndex) * sizeof(unsigned short)), (GLint)entry.firstVertex);
+	drawCalls++;
+	drawnTriangles += level.indexCount / 3;
+}
+
+bool isMeshMultiDrawSupported(){
+	// Indirect commands only honour baseInstance with ARB_base_instance (GL 4.2)
+	return (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance) || GLEW_VERSION_4_3;
+}
+
+void beginMeshFrame(){
+	drawCalls = 0;
+	drawnTriangles = 0;
+	frameDraws = 0;
+	if (drawCapacity == 0)
+		return;
+	// Orphan last frame's commands and matrices instead of waiting for the GPU to read them
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBufferID);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+	glBufferData(GL_ARRAY_BUFFER, drawCapacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+}
+
+void queueMeshDraw(int mesh, const glm::mat4 & model, unsigned int lod){
+	const MeshEntry & entry = meshes[mesh];
+	const MeshLodLevel & level = entry.lods[std::min<size_t>(lod, entry.lods.size() - 1)];
+	DrawElementsIndirectCommand command = { (GLuint)level.indexCount, 1, (GLuint)(entry.firstIndex + level.firstIndex), (GLint)entry.firstVertex, 0 };
+	queuedCommands.push_back(command);
+	queuedMatrices.push_back(model);
+	drawnTriangles += level.indexCount / 3;
+}
+
+// Fresh, larger buffers ; draws already submitted keep the storage they were issued with
+static void growDrawBuffers(size_t count){
+	drawCapacity = std::max(count, std::max<size_t>(1024, drawCapacity * 2));
+	frameDraws = 0;
+	if (indirectBufferID == 0){
+		glGenBuffers(1, &indirectBufferID);
+		glGenBuffers(1, &instanceBufferID);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBufferID);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+	glBufferData(GL_ARRAY_BUFFER, drawCapacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+
+	// The arena's vertex array reads one matrix per instance
+	bindVertexArray(arenaVertexArrayID);
+	for (GLuint column = 0; column < 4; column++){
+		glVertexAttribPointer(instanceMatrixLocation + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(instanceMatrixLocation + column, 1);
+		glEnableVertexAttribArray(instanceMatrixLocation + column);
+	}
+}
+
+void submitMeshDraws(){
+	size_t count = queuedCommands.size();
+	if (count == 0)
+		return;
+	if (frameDraws + count > drawCapacity)
+		growDrawBuffers(frameDraws + count);
+
+	for (size_t i = 0; i < count; i++)
+		queuedCommands[i].baseInstance = (GLuint)(frameDraws + i);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+	glBufferSubData(GL_ARRAY_BUFFER, frameDraws * sizeof(glm::mat4), count * sizeof(glm::mat4), &queuedMatrices[0]);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBufferID);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, frameDraws * sizeof(DrawElementsIndirectCommand), count * sizeof(DrawElementsIndirectCommand), &queuedCommands[0]);
+
+	bindVertexArray(arenaVertexArrayID);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)(frameDraws * sizeof(DrawElementsIndirectCommand)), (GLsizei)count, 0);
+	drawCalls++;
+
+	frameDraws += count;
+	queuedCommands.clear();
+	queuedMatrices.clear();
+}
+
+unsigned int meshDrawCallCount(){
+	return drawCalls;
+}
+
+size_t meshTriangleCount(){
+	return drawnTriangles;
+}
+
+GLsizei meshIndexCount(int mesh){
+	return meshes[mesh].indexCount;
+}
+
+unsigned int meshLodCount(int mesh){
+	return (unsigned int)meshes[mesh].lods.size();
+}
+
+GLsizei meshLodIndexCount(int mesh, unsigned int lod){
+	const MeshEntry & entry = meshes[mesh];
+	return (GLsizei)entry.lods[std::min<size_t>(lod, entry.lods.size() - 1)].indexCount;
+}
+
+void meshBounds(int mesh, glm::vec3 & center, float & radius){
+	center = meshes[mesh].boundsCenter;
+	radius = meshes[mesh].boundsRadius;
+}
+
+size_t meshResidentBytes(int mesh){
+	return meshes[mesh].residentBytes;
+}
+
+size_t meshRegistryResidentBytes(){
+	return residentBytes;
+}
+
+void printMeshRegistry(){
+	printf("%d meshes, %lu KB resident, budget %lu KB, arena %lu KB in %d + %d free ranges\n", (int)meshes.size(),
+		(unsigned long)(residentBytes / 1024), (unsigned long)(budgetBytes / 1024),
+		(unsigned long)((vertexRanges.capacity * sizeof(MeshVertex) + indexRanges.capacity * sizeof(unsigned short)) / 1024),
+		(int)vertexRanges.freeRanges.size(), (int)indexRanges.freeRanges.size());
+	for (size_t i = 0; i < meshes.size(); i++){
+		const MeshEntry & mesh = meshes[i];
+		if (mesh.resident){
+			printf("  %-30s %3d refs  %8lu bytes  triangles", mesh.path.c_str(), mesh.references, (unsigned long)mesh.residentBytes);
+			for (size_t l = 0; l < mesh.lods.size(); l++)
+				printf("%s%lu", l == 0 ? " " : "/", (unsigned long)(mesh.lods[l].indexCount / 3));
+			printf("\n");
+		}else
+			printf("  %-30s %3d refs  evicted\n", mesh.path.c_str(), mesh.references);
+	}
+}
+
+void cleanupMeshRegistry(){
+	for (size_t i = 0; i < meshes.size(); i++)
+		if (meshes[i].resident)
+			evictMesh(meshes[i]);
+	glDeleteVertexArrays(1, &arenaVertexArrayID);
+	glDeleteBuffers(1, &arenaVertexBufferID);
+	glDeleteBuffers(1, &arenaIndexBufferID);
+	glDeleteBuffers(1, &indirectBufferID);
+	glDeleteBuffers(1, &instanceBufferID);
+	arenaVertexArrayID = arenaVertexBufferID = arenaIndexBufferID = 0;
+	indirectBufferID = instanceBufferID = 0;
+	drawCapacity = frameDraws = 0;
+	vertexRanges = RangeAllocator();
+	indexRanges = RangeAllocator();
+	meshes.clear();
+	meshesByPath.clear();
+	meshesByContent.clear();
+	residentBytes = 0;
+	useClock = 0;
+}
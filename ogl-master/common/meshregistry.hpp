@@ -0,0 +1,74 @@
+#ifndef MESHREGISTRY_HPP
+#define MESHREGISTRY_HPP
+
+// Registry of the indexed meshes drawn by the standard shaders : .obj files, or any format
+// Assimp reads when built with USE_ASSIMP. Meshes are keyed by path, and by a hash of their
+// file and color, so that copies under another name share one upload. The CPU copies are
+// freed as soon as the buffers are filled.
+//
+// Every mesh lives in one vertex buffer and one index buffer, sub-allocated with a free
+// list and grown on the GPU when full, behind a single vertex array object : bind it once
+// with bindMeshArena(), then drawMesh() as many meshes as needed.
+//
+// Handles are reference counted. Meshes nobody holds stay resident until the registry goes
+// over its GPU budget, then the least recently released are evicted ; acquiring them again
+// reloads them. Must be used from the render thread ; vertex arrays are bound through
+// glstate.hpp.
+//
+// Each mesh comes with up to 4 levels of detail, sharing its vertices (see meshlod.hpp).
+// Triangles and vertices are put in vertex cache order (see meshoptimize.hpp). Both are done
+// the first time a mesh is loaded, and cached in a .lods file next to the .obj.
+//
+// Vertex attributes : 0 position (vec4), 1 color (vec4), 2 normal (vec3). 16 bit indices.
+
+void initMeshRegistry(size_t gpuBudgetBytes);
+
+// Changing the budget evicts right away if needed
+void setMeshBudget(size_t gpuBudgetBytes);
+
+// Returns a handle holding one reference, or -1 when the file can't be loaded
+int acquireMesh(const char * path, const glm::vec4 & color);
+
+// Takes an extra reference on a handle that is already held
+void retainMesh(int mesh);
+
+void releaseMesh(int mesh);
+
+void bindMeshArena();
+
+// Draws the mesh's triangles with glDrawElementsBaseVertex, after bindMeshArena(), at the
+// given level of detail or the coarsest one there is. Only valid while a reference is held.
+void drawMesh(int mesh, unsigned int lod = 0);
+GLsizei meshIndexCount(int mesh);
+
+// Level 0 is the full mesh
+unsigned int meshLodCount(int mesh);
+GLsizei meshLodIndexCount(int mesh, unsigned int lod);
+
+// Bounding sphere of the vertices, in mesh space
+void meshBounds(int mesh, glm::vec3 & center, float & radius);
+
+// Indirect submission, when isMeshMultiDrawSupported() : queueMeshDraw() as many meshes as
+// needed, then submitMeshDraws() sends them all in one glMultiDrawElementsIndirect call.
+// Each draw gets its model matrix as a per instance vertex attribute at locations 3 to 6.
+// Call beginMeshFrame() at the start of each frame, which recycles the command buffers.
+bool isMeshMultiDrawSupported();
+void beginMeshFrame();
+void queueMeshDraw(int mesh, const glm::mat4 & model, unsigned int lod = 0);
+void submitMeshDraws();
+
+// drawMesh() and submitMeshDraws() calls, and triangles drawn or queued, since beginMeshFrame()
+unsigned int meshDrawCallCount();
+size_t meshTriangleCount();
+
+// Buffer bytes of one mesh, 0 when it is evicted, and of every resident mesh
+size_t meshResidentBytes(int mesh);
+size_t meshRegistryResidentBytes();
+
+// One line per mesh : path, references, resident bytes and triangles per level, or evicted
+void printMeshRegistry();
+
+// Frees every mesh, held or not
+void cleanupMeshRegistry();
+
+#endif
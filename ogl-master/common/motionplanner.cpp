@@ -0,0 +1,506 @@
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "jobsystem.hpp"
+#include "selfcollision.hpp"
+#include "motionplanner.hpp"
+
+void initJointChain(JointChain & chain, const glm::mat4 * bases, const int * parents, const glm::vec3 * axes,
+	const float * minAngles, const float * maxAngles, int linkCount){
+	chain.linkCount = linkCount;
+	chain.bases.assign(bases, bases + linkCount);
+	chain.parents.assign(parents, parents + linkCount);
+	chain.linkJoints.assign(linkCount, -1);
+	chain.jointLinks.clear();
+	chain.axes.clear();
+	chain.minAngles.clear();
+	chain.maxAngles.clear();
+	for (int n = 0; n < linkCount; n++){
+		if (glm::dot(axes[n], axes[n]) == 0.0f)
+			continue;
+		chain.linkJoints[n] = chain.jointCount();
+		chain.jointLinks.push_back(n);
+		chain.axes.push_back(glm::normalize(axes[n]));
+		chain.minAngles.push_back(minAngles[n]);
+		chain.maxAngles.push_back(maxAngles[n]);
+	}
+}
+
+void forwardKinematics(const JointChain & chain, const float * angles, glm::mat4 * worlds){
+	for (int n = 0; n < chain.linkCount; n++){
+		glm::mat4 local = chain.bases[n];
+		int joint = chain.linkJoints[n];
+		if (joint >= 0)
+			local = local * glm::rotate(glm::mat4(1.0f), angles[joint], chain.axes[joint]);
+		worlds[n] = chain.parents[n] >= 0 ? worlds[chain.parents[n]] * local : local;
+	}
+}
+
+bool solveInverseKinematics(const JointChain & chain, int tipLink, const glm::vec3 & target, float * angles,
+	int iterations, float tolerance){
+	// Only the joints between the root and the tip move it
+	std::vector<char> movesTip(chain.linkCount, 0);
+	for (int n = tipLink; n >= 0; n = chain.parents[n])
+		movesTip[n] = 1;
+
+	std::vector<glm::mat4> worlds(chain.linkCount);
+	forwardKinematics(chain, angles, &worlds[0]);
+	for (int iteration = 0; iteration < iterations; iteration++){
+		if (glm::length(target - glm::vec3(worlds[tipLink][3])) < tolerance)
+			return true;
+
+		// From the joint nearest the tip to the root, turn each so that the tip points at
+		// the target, as seen along its axis
+		for (int j = chain.jointCount() - 1; j >= 0; j--){
+			int link = chain.jointLinks[j];
+			if (!movesTip[link])
+				continue;
+			glm::vec3 pivot = glm::vec3(worlds[link][3]);
+			glm::vec3 axis = glm::normalize(glm::mat3(worlds[link]) * chain.axes[j]);
+			glm::vec3 toTip = glm::vec3(worlds[tipLink][3]) - pivot;
+			glm::vec3 toTarget = target - pivot;
+			toTip -= axis * glm::dot(axis, toTip);
+			toTarget -= axis * glm::dot(axis, toTarget);
+			if (glm::dot(toTip, toTip) < 1e-8f || glm::dot(toTarget, toTarget) < 1e-8f)
+				continue;
+			float angle = atan2f(glm::dot(axis, glm::cross(toTip, toTarget)), glm::dot(toTip, toTarget));
+			angles[j] = glm::clamp(angles[j] + angle, chain.minAngles[j], chain.maxAngles[j]);
+			forwardKinematics(chain, angles, &worlds[0]);
+		}
+	}
+	return glm::length(target - glm::vec3(worlds[tipLink][3])) < tolerance;
+}
+
+// Random numbers of each sample from its own seed, so that the jobs drawing them may run in
+// any order
+static uint32_t sampleSeed(uint32_t seed, uint32_t index){
+	uint32_t h = seed * 0x9E3779B9u + index * 0x85EBCA6Bu + 0x632BE5ABu;
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	return h ? h : 1;
+}
+
+static float nextRandom(uint32_t & state){
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+static float distance(const float * a, const float * b, int dof){
+	float sum = 0.0f;
+	for (int j = 0; j < dof; j++)
+		sum += (a[j] - b[j]) * (a[j] - b[j]);
+	return sqrtf(sum);
+}
+
+struct PlannerTree {
+	std::vector<float> states;  // dof per node
+	std::vector<int> parents;
+
+	int size() const { return (int)parents.size(); }
+	void add(const float * state, int dof, int parent){
+		states.insert(states.end(), state, state + dof);
+		parents.push_back(parent);
+	}
+};
+
+// Linear search : the trees stay small, and each job searches for its own sample
+static int nearestNode(const PlannerTree & tree, const float * state, int dof){
+	int best = 0;
+	float bestDistance = 1e30f;
+	for (int n = 0; n < tree.size(); n++){
+		const float * other = &tree.states[n * dof];
+		float sum = 0.0f;
+		for (int j = 0; j < dof; j++)
+			sum += (state[j] - other[j]) * (state[j] - other[j]);
+		if (sum < bestDistance){
+			bestDistance = sum;
+			best = n;
+		}
+	}
+	return best;
+}
+
+struct PlannerContext {
+	const JointChain * chain;
+	const CollisionRig * collision;
+	const MotionPlannerSettings * settings;
+	int dof;
+	std::chrono::high_resolution_clock::time_point startTime;
+};
+
+static double secondsSince(std::chrono::high_resolution_clock::time_point start){
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static bool outOfTime(const PlannerContext & context){
+	return context.settings->maxSeconds > 0.0 && secondsSince(context.startTime) >= context.settings->maxSeconds;
+}
+
+static bool poseValid(const PlannerContext & context, const float * angles, int & checks){
+	glm::mat4 worlds[MaxCollisionLinks];
+	forwardKinematics(*context.chain, angles, worlds);
+	checks++;
+	return !findSelfCollision(*context.collision, worlds);
+}
+
+// The poses between from and to, ends excluded, checkResolution apart. The middle one goes
+// first, then the quarters, and so on : collisions tend to show up in fewer checks.
+static bool moveValid(const PlannerContext & context, const float * from, const float * to, int & checks){
+	float longest = 0.0f;
+	for (int j = 0; j < context.dof; j++)
+		longest = std::max(longest, fabsf(to[j] - from[j]));
+	int steps = (int)ceilf(longest / context.settings->checkResolution);
+	if (steps <= 1)
+		return true;
+
+	int stride = 1;
+	while (stride * 2 < steps)
+		stride *= 2;
+	float pose[MaxCollisionLinks];
+	for (; stride >= 1; stride /= 2){
+		for (int i = stride; i < steps; i += 2 * stride){
+			float t = (float)i / steps;
+			for (int j = 0; j < context.dof; j++)
+				pose[j] = from[j] + (to[j] - from[j]) * t;
+			if (!poseValid(context, pose, checks))
+				return false;
+		}
+	}
+	return true;
+}
+
+// One tree extension or connection attempt, computed by a job and merged afterwards
+struct PlannerMove {
+	int parent;                      // node of the tree it starts from
+	float state[MaxCollisionLinks];  // where it got to
+	bool valid;                      // extensions : it got there. Connections : it got anywhere.
+	bool reached;                    // connections : all the way to their target
+	int checks;
+};
+
+struct ExtendJob {
+	const PlannerContext * context;
+	const PlannerTree * tree;
+	uint32_t firstSample;
+	PlannerMove * moves;
+};
+
+// A random sample, and a step of at most stepSize towards it from the nearest node
+static void runExtendJob(void * data, size_t begin, size_t end){
+	ExtendJob & job = *(ExtendJob *)data;
+	const PlannerContext & context = *job.context;
+	const JointChain & chain = *context.chain;
+	for (size_t i = begin; i < end; i++){
+		PlannerMove & move = job.moves[i];
+		move.checks = 0;
+		move.reached = false;
+		uint32_t random = sampleSeed(context.settings->seed, job.firstSample + (uint32_t)i);
+		for (int j = 0; j < context.dof; j++)
+			move.state[j] = chain.minAngles[j] + (chain.maxAngles[j] - chain.minAngles[j]) * nextRandom(random);
+
+		move.parent = nearestNode(*job.tree, move.state, context.dof);
+		const float * from = &job.tree->states[move.parent * context.dof];
+		float length = distance(from, move.state, context.dof);
+		if (length > context.settings->stepSize){
+			for (int j = 0; j < context.dof; j++)
+				move.state[j] = from[j] + (move.state[j] - from[j]) * (context.settings->stepSize / length);
+		}
+		move.valid = poseValid(context, move.state, move.checks) && moveValid(context, from, move.state, move.checks);
+	}
+}
+
+struct ConnectJob {
+	const PlannerContext * context;
+	const PlannerTree * tree;
+	const float * targets;
+	PlannerMove * moves;
+};
+
+// From the nearest node towards the target, in steps of stepSize, as far as possible
+static void runConnectJob(void * data, size_t begin, size_t end){
+	ConnectJob & job = *(ConnectJob *)data;
+	const PlannerContext & context = *job.context;
+	int dof = context.dof;
+	for (size_t i = begin; i < end; i++){
+		PlannerMove & move = job.moves[i];
+		const float * target = &job.targets[i * dof];
+		move.checks = 0;
+		move.parent = nearestNode(*job.tree, target, dof);
+		const float * from = &job.tree->states[move.parent * dof];
+		int steps = std::max(1, (int)ceilf(distance(from, target, dof) / context.settings->stepSize));
+
+		float previous[MaxCollisionLinks], next[MaxCollisionLinks];
+		std::copy(from, from + dof, previous);
+		int step = 1;
+		for (; step <= steps; step++){
+			float t = (float)step / steps;
+			for (int j = 0; j < dof; j++)
+				next[j] = from[j] + (target[j] - from[j]) * t;
+			if (!poseValid(context, next, move.checks) || !moveValid(context, previous, next, move.checks))
+				break;
+			std::copy(next, next + dof, previous);
+		}
+		std::copy(previous, previous + dof, move.state);
+		move.valid = step > 1;
+		move.reached = step > steps;
+	}
+}
+
+// Node's branch, from the root when towardsRoot is false
+static void appendBranch(const PlannerTree & tree, int node, int dof, bool towardsRoot, std::vector<float> & path){
+	std::vector<float> branch;
+	for (; node >= 0; node = tree.parents[node])
+		branch.insert(branch.end(), &tree.states[node * dof], &tree.states[node * dof] + dof);
+	if (!towardsRoot){
+		for (int n = (int)branch.size() / dof - 1; n >= 0; n--)
+			path.insert(path.end(), &branch[n * dof], &branch[n * dof] + dof);
+	}else{
+		path.insert(path.end(), branch.begin(), branch.end());
+	}
+}
+
+static float pathLength(const std::vector<float> & path, int dof){
+	float length = 0.0f;
+	for (size_t w = 1; w * dof < path.size(); w++)
+		length += distance(&path[(w - 1) * dof], &path[w * dof], dof);
+	return length;
+}
+
+struct ShortcutJob {
+	const PlannerContext * context;
+	const std::vector<float> * path;
+	const int * from;
+	const int * to;
+	char * valid;
+	int * checks;
+};
+
+static void runShortcutJob(void * data, size_t begin, size_t end){
+	ShortcutJob & job = *(ShortcutJob *)data;
+	int dof = job.context->dof;
+	for (size_t i = begin; i < end; i++){
+		job.checks[i] = 0;
+		job.valid[i] = moveValid(*job.context, &(*job.path)[job.from[i] * dof], &(*job.path)[job.to[i] * dof], job.checks[i]);
+	}
+}
+
+// Tries random straight moves between two waypoints of the path, and keeps the one that
+// saves the most
+static void shortcutPath(const PlannerContext & context, std::vector<float> & path, int & checks, bool & timedOut){
+	const MotionPlannerSettings & settings = *context.settings;
+	int dof = context.dof;
+	std::vector<int> from(settings.batchSize), to(settings.batchSize), moveChecks(settings.batchSize);
+	std::vector<char> valid(settings.batchSize);
+	for (int round = 0; round < settings.shortcutRounds; round++){
+		int waypoints = (int)path.size() / dof;
+		if (waypoints <= 2)
+			return;
+		if (outOfTime(context)){
+			timedOut = true;
+			return;
+		}
+		uint32_t random = sampleSeed(settings.seed ^ 0x5C0FFEEu, (uint32_t)round);
+		for (int i = 0; i < settings.batchSize; i++){
+			int a = (int)(nextRandom(random) * waypoints) % waypoints;
+			int b = (int)(nextRandom(random) * waypoints) % waypoints;
+			from[i] = std::min(a, b);
+			to[i] = std::max(a, b);
+		}
+		ShortcutJob job = { &context, &path, &from[0], &to[0], &valid[0], &moveChecks[0] };
+		parallelFor(settings.batchSize, 1, runShortcutJob, &job);
+
+		int best = -1;
+		float bestSaving = 1e-4f;
+		for (int i = 0; i < settings.batchSize; i++){
+			checks += moveChecks[i];
+			if (!valid[i] || to[i] - from[i] < 2)
+				continue;
+			float along = 0.0f;
+			for (int w = from[i]; w < to[i]; w++)
+				along += distance(&path[w * dof], &path[(w + 1) * dof], dof);
+			float saving = along - distance(&path[from[i] * dof], &path[to[i] * dof], dof);
+			if (saving > bestSaving){
+				bestSaving = saving;
+				best = i;
+			}
+		}
+		if (best >= 0)
+			path.erase(path.begin() + (from[best] + 1) * dof, path.begin() + to[best] * dof);
+	}
+}
+
+bool planMotion(const JointChain & chain, const CollisionRig & collision, const float * start, const float * goal,
+	const MotionPlannerSettings & settings, std::vector<float> & path, MotionPlanStats * stats){
+	int dof = chain.jointCount();
+	PlannerContext context = { &chain, &collision, &settings, dof, std::chrono::high_resolution_clock::now() };
+	MotionPlanStats result = { 0, 2, 0, 0.0, 0.0f, false };
+	path.clear();
+
+	bool found = false;
+	if (chain.linkCount <= MaxCollisionLinks && poseValid(context, start, result.collisionChecks) &&
+		poseValid(context, goal, result.collisionChecks)){
+		if (moveValid(context, start, goal, result.collisionChecks)){
+			path.insert(path.end(), start, start + dof);
+			path.insert(path.end(), goal, goal + dof);
+			found = true;
+		}
+
+		// Tree 0 grows from the start, tree 1 from the goal. Each round extends one towards
+		// the samples, then the other towards what the first could reach, and they swap.
+		PlannerTree trees[2];
+		trees[0].add(start, dof, -1);
+		trees[1].add(goal, dof, -1);
+		std::vector<PlannerMove> extensions(settings.batchSize), connections;
+		std::vector<float> targets;
+		std::vector<int> targetNodes;
+		int grown = 0;
+		while (!found && result.samples < settings.maxSamples){
+			if (outOfTime(context)){
+				result.outOfTime = true;
+				break;
+			}
+			PlannerTree & a = trees[grown];
+			PlannerTree & b = trees[1 - grown];
+			ExtendJob extend = { &context, &a, (uint32_t)result.samples, &extensions[0] };
+			parallelFor(settings.batchSize, 1, runExtendJob, &extend);
+			result.samples += settings.batchSize;
+
+			targets.clear();
+			targetNodes.clear();
+			for (const PlannerMove & move : extensions){
+				result.collisionChecks += move.checks;
+				if (!move.valid)
+					continue;
+				a.add(move.state, dof, move.parent);
+				targets.insert(targets.end(), move.state, move.state + dof);
+				targetNodes.push_back(a.size() - 1);
+			}
+
+			connections.resize(targetNodes.size());
+			if (!connections.empty()){
+				ConnectJob connect = { &context, &b, &targets[0], &connections[0] };
+				parallelFor(connections.size(), 1, runConnectJob, &connect);
+			}
+			for (size_t i = 0; i < connections.size() && !found; i++){
+				const PlannerMove & move = connections[i];
+				result.collisionChecks += move.checks;
+				if (move.reached){
+					int startNode = grown == 0 ? targetNodes[i] : move.parent;
+					int goalNode = grown == 0 ? move.parent : targetNodes[i];
+					appendBranch(trees[0], startNode, dof, false, path);
+					appendBranch(trees[1], goalNode, dof, true, path);
+					found = true;
+				}else if (move.valid){
+					b.add(move.state, dof, move.parent);
+				}
+			}
+			grown = 1 - grown;
+		}
+		result.treeNodes = trees[0].size() + trees[1].size();
+	}
+
+	if (found)
+		shortcutPath(context, path, result.collisionChecks, result.outOfTime);
+	result.pathLength = found ? pathLength(path, dof) : 0.0f;
+	result.seconds = secondsSince(context.startTime);
+	if (stats)
+		*stats = result;
+	return found;
+}
+
+// Per joint, the velocity through a waypoint is the harmonic mean of the speeds of the moves
+// on either side, or zero when the joint turns back (Fritsch and Butland). It is at most
+// twice the slower speed, so each joint moves monotonically between its waypoint angles. The
+// moves last 1.5 times as long as at constant speed, which keeps every joint within
+// maxJointSpeed along the splines.
+void timeParameterize(const std::vector<float> & path, int jointCount, float maxJointSpeed, JointTrajectory & trajectory,
+	bool stopAtWaypoints){
+	int waypoints = (int)path.size() / jointCount;
+	trajectory.jointCount = jointCount;
+	trajectory.angles = path;
+	trajectory.times.assign(1, 0.0f);
+	for (int w = 1; w < waypoints; w++){
+		float longest = 0.0f;
+		for (int j = 0; j < jointCount; j++)
+			longest = std::max(longest, fabsf(path[w * jointCount + j] - path[(w - 1) * jointCount + j]));
+		trajectory.times.push_back(trajectory.times.back() + 1.5f * longest / maxJointSpeed);
+	}
+
+	trajectory.velocities.assign(path.size(), 0.0f);
+	if (stopAtWaypoints)
+		return;
+	for (int w = 1; w + 1 < waypoints; w++){
+		float before = trajectory.times[w] - trajectory.times[w - 1];
+		float after = trajectory.times[w + 1] - trajectory.times[w];
+		if (before <= 0.0f || after <= 0.0f)
+			continue;
+		for (int j = 0; j < jointCount; j++){
+			float speedBefore = (path[w * jointCount + j] - path[(w - 1) * jointCount + j]) / before;
+			float speedAfter = (path[(w + 1) * jointCount + j] - path[w * jointCount + j]) / after;
+			if (speedBefore * speedAfter > 0.0f)
+				trajectory.velocities[w * jointCount + j] = 2.0f * speedBefore * speedAfter / (speedBefore + speedAfter);
+		}
+	}
+}
+
+// Cubic Hermite segment between waypoints
+static void sampleSegment(const JointTrajectory & trajectory, size_t segment, float s, float * angles){
+	int dof = trajectory.jointCount;
+	float duration = trajectory.times[segment + 1] - trajectory.times[segment];
+	const float * a = &trajectory.angles[segment * dof];
+	const float * b = &trajectory.angles[(segment + 1) * dof];
+	const float * va = &trajectory.velocities[segment * dof];
+	const float * vb = &trajectory.velocities[(segment + 1) * dof];
+	float s2 = s * s, s3 = s2 * s;
+	float h00 = 2.0f * s3 - 3.0f * s2 + 1.0f, h01 = 1.0f - h00;
+	float h10 = (s3 - 2.0f * s2 + s) * duration, h11 = (s3 - s2) * duration;
+	for (int j = 0; j < dof; j++)
+		angles[j] = h00 * a[j] + h01 * b[j] + h10 * va[j] + h11 * vb[j];
+}
+
+bool sampleTrajectory(const JointTrajectory & trajectory, float time, float * angles){
+	int dof = trajectory.jointCount;
+	const std::vector<float> & times = trajectory.times;
+	if (times.empty())
+		return false;
+	size_t next = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+	if (next == 0 || next == times.size()){
+		const float * held = &trajectory.angles[(next == 0 ? 0 : times.size() - 1) * dof];
+		std::copy(held, held + dof, angles);
+		return next == 0;
+	}
+	sampleSegment(trajectory, next - 1, (time - times[next - 1]) / (times[next] - times[next - 1]), angles);
+	return true;
+}
+
+bool trajectoryCollisionFree(const JointChain & chain, const CollisionRig & collision, const JointTrajectory & trajectory,
+	float checkResolution){
+	int dof = trajectory.jointCount;
+	std::vector<float> angles(dof);
+	glm::mat4 worlds[MaxCollisionLinks];
+	for (size_t w = 0; w + 1 < trajectory.times.size(); w++){
+		float longest = 0.0f;
+		for (int j = 0; j < dof; j++)
+			longest = std::max(longest, fabsf(trajectory.angles[(w + 1) * dof + j] - trajectory.angles[w * dof + j]));
+		// Uniform steps in s, over which the joints go up to 1.5 times their average speed
+		int steps = (int)ceilf(1.5f * longest / checkResolution);
+		for (int i = 1; i < steps; i++){
+			sampleSegment(trajectory, w, (float)i / steps, angles.data());
+			forwardKinematics(chain, angles.data(), worlds);
+			if (findSelfCollision(collision, worlds))
+				return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,88 @@
+#ifndef MOTIONPLANNER_HPP
+#define MOTIONPLANNER_HPP
+
+// Joint space motion planning for a rig : forward kinematics, inverse kinematics by cyclic
+// coordinate descent, and RRT-Connect (Kuffner and LaValle) against the self-collision
+// checks of selfcollision.hpp. Plans come out as time-parameterized trajectories to play
+// back. No OpenGL involved.
+//
+// Each round of the planner draws a batch of samples and extends the trees towards them on
+// the job system ; the results are merged in sample order, so that plans only depend on the
+// seed, not on the thread count.
+
+// A rig's links, each placed by its parent's world transform, a fixed transform, then a
+// rotation about its joint axis. Links without an axis are fixed ; the others are the joints.
+struct JointChain {
+	int linkCount;
+	std::vector<glm::mat4> bases;     // per link : from its parent, at joint angle 0
+	std::vector<int> parents;         // per link, parents first, -1 for roots
+	std::vector<int> linkJoints;      // per link : its joint, -1 for fixed links
+	std::vector<int> jointLinks;      // per joint : its link
+	std::vector<glm::vec3> axes;      // per joint, unit, in its link's space
+	std::vector<float> minAngles;     // per joint, radians
+	std::vector<float> maxAngles;
+
+	int jointCount() const { return (int)jointLinks.size(); }
+};
+
+// axes, minAngles and maxAngles (radians) are per link ; zero axes make fixed links. Chains
+// of more than MaxCollisionLinks links can't be planned for.
+void initJointChain(JointChain & chain, const glm::mat4 * bases, const int * parents, const glm::vec3 * axes,
+	const float * minAngles, const float * maxAngles, int linkCount);
+
+// World transform of every link, given an angle per joint
+void forwardKinematics(const JointChain & chain, const float * angles, glm::mat4 * worlds);
+
+// Brings the origin of tipLink to target, within tolerance, starting from angles and keeping
+// within the joint limits. Returns false when it got no closer than tolerance.
+bool solveInverseKinematics(const JointChain & chain, int tipLink, const glm::vec3 & target, float * angles,
+	int iterations, float tolerance);
+
+struct MotionPlannerSettings {
+	float stepSize = 0.3f;          // radians, longest joint space move of one tree extension
+	float checkResolution = 0.05f;  // radians between the collision checks along a move
+	int batchSize = 32;             // samples per round, extended in parallel
+	int maxSamples = 5000;          // the planner gives up past these
+	double maxSeconds = 0.0;        // or past this wall clock time, 0 for no limit ; checked between rounds
+	int shortcutRounds = 30;        // each validates batchSize random shortcuts, and takes the best
+	unsigned int seed = 1;
+};
+
+struct MotionPlanStats {
+	int samples;
+	int treeNodes;
+	int collisionChecks;     // poses checked
+	double seconds;
+	float pathLength;        // joint space, radians, after shortcutting
+	bool outOfTime;          // maxSeconds ran out, while sampling or shortcutting
+};
+
+// Collision free path from start to goal, as waypoints of jointCount() angles each, start
+// and goal included. Returns false when either is in collision, or no path was found. When
+// maxSeconds runs out during the shortcuts, the path found so far is kept.
+bool planMotion(const JointChain & chain, const CollisionRig & collision, const float * start, const float * goal,
+	const MotionPlannerSettings & settings, std::vector<float> & path, MotionPlanStats * stats = NULL);
+
+// Waypoints joined by cubic splines in each joint angle, starting and ending at rest. Each
+// move takes as long as the joint that has the furthest to go needs at maxJointSpeed.
+struct JointTrajectory {
+	int jointCount;
+	std::vector<float> angles;      // jointCount per waypoint
+	std::vector<float> velocities;  // jointCount per waypoint, radians per second
+	std::vector<float> times;       // seconds from the start, per waypoint
+};
+
+// The splines round the corners of the path, only keeping within the joint limits. With
+// stopAtWaypoints, the joints come to rest at every waypoint instead, and the moves stay on
+// the straight lines between them.
+void timeParameterize(const std::vector<float> & path, int jointCount, float maxJointSpeed, JointTrajectory & trajectory,
+	bool stopAtWaypoints = false);
+
+// Angles at time, held at the ends. Returns false once past the last waypoint.
+bool sampleTrajectory(const JointTrajectory & trajectory, float time, float * angles);
+
+// Checks the poses along the splines, checkResolution radians apart
+bool trajectoryCollisionFree(const JointChain & chain, const CollisionRig & collision, const JointTrajectory & trajectory,
+	float checkResolution);
+
+#endif
@@ -87,3 +87,100 @@ bool loadOBJ(
 
     return true;
 }
+
+
+#ifdef USE_ASSIMP // Assimp is only linked to the targets defining this
+
+#include <chrono>
+
+// Include AssImp
+#include <assimp/Importer.hpp>      // C++ importer interface
+#include <assimp/scene.h>           // Output data structure
+#include <assimp/postprocess.h>     // Post processing flags
+
+static double secondsSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+bool loadAssImp(
+    const char* path,
+    std::vector<unsigned short>& indices,
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec3>& normals,
+    AssImpTimings* timings
+) {
+    Assimp::Importer importer;
+    // Only positions and normals are kept : the other components go before the vertices are
+    // joined, so that they don't keep vertices apart, and points and lines go altogether
+    importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, aiComponent_TANGENTS_AND_BITANGENTS | aiComponent_COLORS |
+        aiComponent_TEXCOORDS | aiComponent_BONEWEIGHTS | aiComponent_ANIMATIONS | aiComponent_TEXTURES |
+        aiComponent_LIGHTS | aiComponent_CAMERAS | aiComponent_MATERIALS);
+    importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    const aiScene* scene = importer.ReadFile(path, 0);
+    if (!scene) {
+        printf("%s\n", importer.GetErrorString());
+        return false;
+    }
+    double readSeconds = secondsSince(start);
+
+    // Normals are only generated for meshes without any. The node transforms are baked into
+    // the vertices, a mesh placed by several nodes being copied for each.
+    start = std::chrono::high_resolution_clock::now();
+    scene = importer.ApplyPostProcessing(aiProcess_RemoveComponent | aiProcess_Triangulate | aiProcess_SortByPType |
+        aiProcess_GenNormals | aiProcess_PreTransformVertices | aiProcess_JoinIdenticalVertices |
+        aiProcess_ImproveCacheLocality);
+    if (!scene) {
+        printf("%s\n", importer.GetErrorString());
+        return false;
+    }
+    double postProcessSeconds = secondsSince(start);
+
+    // Every mesh of the file in one, written straight into the outputs once they are sized
+    start = std::chrono::high_resolution_clock::now();
+    size_t vertexCount = 0, indexCount = 0;
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++) {
+        const aiMesh* mesh = scene->mMeshes[m];
+        if (mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE)
+            continue;
+        vertexCount += mesh->mNumVertices;
+        indexCount += mesh->mNumFaces * 3;
+    }
+    if (vertexCount > 65536) {
+        printf("%s has %lu vertices, more than 16 bit indices can address\n", path, (unsigned long)vertexCount);
+        return false;
+    }
+    indices.resize(indexCount);
+    vertices.resize(vertexCount);
+    normals.resize(vertexCount);
+
+    size_t firstVertex = 0, index = 0;
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++) {
+        const aiMesh* mesh = scene->mMeshes[m];
+        if (mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE)
+            continue;
+        for (unsigned int v = 0; v < mesh->mNumVertices; v++) {
+            const aiVector3D& position = mesh->mVertices[v];
+            const aiVector3D& normal = mesh->mNormals[v];
+            vertices[firstVertex + v] = glm::vec3(position.x, position.y, position.z);
+            normals[firstVertex + v] = glm::vec3(normal.x, normal.y, normal.z);
+        }
+        for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+            const aiFace& face = mesh->mFaces[f];
+            indices[index++] = (unsigned short)(firstVertex + face.mIndices[0]);
+            indices[index++] = (unsigned short)(firstVertex + face.mIndices[1]);
+            indices[index++] = (unsigned short)(firstVertex + face.mIndices[2]);
+        }
+        firstVertex += mesh->mNumVertices;
+    }
+
+    if (timings) {
+        timings->read = readSeconds;
+        timings->postProcess = postProcessSeconds;
+        timings->convert = secondsSince(start);
+    }
+    return true;
+}
+
+#endif
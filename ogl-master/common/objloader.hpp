@@ -9,11 +9,20 @@ bool loadOBJ(
 
 
 
+// Seconds spent in each stage of loadAssImp()
+struct AssImpTimings {
+	double read;         // Assimp::Importer::ReadFile, parsing only
+	double postProcess;  // Assimp's post-processing steps
+	double convert;      // into the output arrays
+};
+
+// Any format Assimp reads, already indexed like indexVBO's output. Only built with USE_ASSIMP.
 bool loadAssImp(
 	const char* path,
 	std::vector<unsigned short>& indices,
 	std::vector<glm::vec3>& vertices,
-	std::vector<glm::vec3>& normals
+	std::vector<glm::vec3>& normals,
+	AssImpTimings* timings = NULL
 );
 
 #endif
\ No newline at end of file
@@ -0,0 +1,534 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <math.h>
+
+#include <GL/glew.h>
+
+#include <LinearMath/btQuickprof.h>
+
+#include "text2D.hpp"
+
+#include "profiler.hpp"
+
+// Frames whose GPU timestamps may still be in flight. A frame that is still not
+// available when its slot comes around again loses its GPU times rather than stalling.
+static const unsigned int FramesInFlight = 4;
+static const unsigned int MaxScopesPerFrame = 1024;
+// Completed frames kept for the HUD and the trace export
+static const unsigned int HistoryFrames = 300;
+// The HUD averages over the last HudWindow frames and graphs the last GraphColumns
+static const unsigned int HudWindow = 60;
+static const unsigned int GraphColumns = 100;
+static const unsigned int GraphRows = 12;
+static const double GraphMaxMs = 100.0 / 3.0;
+
+struct ProfileRecord {
+	const char * name;
+	int depth;
+	int parent;                  // index of the enclosing record, -1 for the frame itself
+	unsigned int calls;          // 1, except for sampled scopes
+	bool sampled;                // a Bullet scope, of which btQuickprof only keeps totals
+	double cpuBegin, cpuEnd;     // in microseconds since initProfiler()
+	bool gpu;
+	double gpuBegin, gpuEnd;     // in microseconds on the CPU clock, or negative when unknown
+};
+
+struct ProfileFrame {
+	std::vector<ProfileRecord> records;
+	std::vector<GLuint> queries; // 2 per record, indexed like records
+	bool pending;                // waiting for its GPU timestamps
+	bool hasGPUScopes;
+};
+
+static std::chrono::high_resolution_clock::time_point ProfilerStart;
+static bool ProfilerGPUTimers = false;
+static double ProfilerGPUOffset = 0.0; // GPU timestamp - CPU time, in microseconds
+
+static ProfileFrame ProfilerFrames[FramesInFlight];
+static unsigned int ProfilerCurrentFrame = 0;
+static bool ProfilerInFrame = false;
+static std::vector<int> ProfilerOpenScopes; // record indices, -1 when the scope was dropped
+static std::vector<CProfileIterator> ProfilerOpenNodes; // on the matching btQuickprof nodes
+static CProfileIterator * ProfilerRootNode = NULL;
+static bool ProfilerOverflowReported = false;
+
+static std::deque<std::vector<ProfileRecord> > ProfilerHistory;
+
+static double profilerNow(){
+	return std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - ProfilerStart).count();
+}
+
+// Our scopes are also btQuickprof samples, so that the BT_PROFILE scopes inside Bullet
+// (stepSimulation, solveConstraints, ...) nest under whichever of our scopes called them.
+// Their nodes are tagged so they can be told apart from the nodes Bullet creates.
+static char ProfilerNodeTag;
+
+// The totals of a Bullet node already turned into records. btQuickprof's only grow until
+// the next CProfileManager::Reset(), and a scope may run several times in a frame.
+struct SampledTotals {
+	int calls;
+	float time;
+};
+static std::deque<SampledTotals> ProfilerSampledTotals; // pointed to by the Bullet nodes
+
+void initProfiler(){
+	ProfilerStart = std::chrono::high_resolution_clock::now();
+	ProfilerRootNode = CProfileManager::Get_Iterator();
+
+	// Timer queries are core since 3.3, but some drivers still don't implement them
+	ProfilerGPUTimers = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+	if (ProfilerGPUTimers){
+		// Align the GPU clock with ours once, so both timelines line up in the trace
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		ProfilerGPUOffset = gpuNow / 1000.0 - profilerNow();
+	}else{
+		printf("GL_ARB_timer_query not supported, the profiler only measures the CPU\n");
+	}
+
+	for (unsigned int i = 0; i < FramesInFlight; i++){
+		ProfilerFrames[i].pending = false;
+		ProfilerFrames[i].hasGPUScopes = false;
+	}
+}
+
+// Moves a finished frame to the history. Its GPU times must have been read already.
+static void retireFrame(ProfileFrame & frame){
+	ProfilerHistory.push_back(frame.records);
+	if (ProfilerHistory.size() > HistoryFrames)
+		ProfilerHistory.pop_front();
+	frame.pending = false;
+}
+
+// Reads the timestamps of a frame if they are all available, without waiting
+static bool collectFrame(ProfileFrame & frame){
+	if (frame.hasGPUScopes){
+		// Queries complete in order, so the last one issued tells for the whole frame
+		GLuint lastQuery = 0;
+		for (size_t i = frame.records.size(); i-- > 0; ){
+			if (frame.records[i].gpu){
+				lastQuery = frame.queries[2*i+1];
+				break;
+			}
+		}
+		GLint available = 0;
+		glGetQueryObjectiv(lastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+
+		for (size_t i = 0; i < frame.records.size(); i++){
+			ProfileRecord & record = frame.records[i];
+			if (!record.gpu)
+				continue;
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(frame.queries[2*i], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.queries[2*i+1], GL_QUERY_RESULT, &end);
+			record.gpuBegin = begin / 1000.0 - ProfilerGPUOffset;
+			record.gpuEnd = end / 1000.0 - ProfilerGPUOffset;
+		}
+	}
+	retireFrame(frame);
+	return true;
+}
+
+void beginProfilerFrame(){
+	ProfileFrame & frame = ProfilerFrames[ProfilerCurrentFrame];
+
+	// The GPU is more than FramesInFlight frames behind : keep the CPU times only
+	if (frame.pending && !collectFrame(frame)){
+		for (size_t i = 0; i < frame.records.size(); i++)
+			frame.records[i].gpu = false;
+		retireFrame(frame);
+	}
+
+	frame.records.clear();
+	frame.hasGPUScopes = false;
+	ProfilerOpenScopes.clear();
+	ProfilerOpenNodes.clear();
+	ProfilerInFrame = true;
+	beginProfileScope("Frame", true);
+}
+
+void endProfilerFrame(){
+	if (!ProfilerInFrame)
+		return;
+	while (!ProfilerOpenScopes.empty())
+		endProfileScope();
+	ProfilerInFrame = false;
+
+	// Everything is collected : start the next frame from zero
+	CProfileManager::Reset();
+	for (size_t i = 0; i < ProfilerSampledTotals.size(); i++){
+		ProfilerSampledTotals[i].calls = 0;
+		ProfilerSampledTotals[i].time = 0.0f;
+	}
+
+	ProfilerFrames[ProfilerCurrentFrame].pending = true;
+	ProfilerCurrentFrame = (ProfilerCurrentFrame + 1) % FramesInFlight;
+
+	// Collect every frame that is ready, oldest first
+	for (unsigned int i = 0; i < FramesInFlight; i++){
+		ProfileFrame & frame = ProfilerFrames[(ProfilerCurrentFrame + i) % FramesInFlight];
+		if (frame.pending && !collectFrame(frame))
+			break;
+	}
+}
+
+void beginProfileScope(const char * name, bool gpu){
+	if (!ProfilerInFrame)
+		return;
+
+	// Follow CProfileManager into its tree : it stays on the same node for direct recursion,
+	// and otherwise enters the child of that name, comparing pointers as we do
+	CProfileIterator node = ProfilerOpenNodes.empty() ? *ProfilerRootNode : ProfilerOpenNodes.back();
+	CProfileManager::Start_Profile(name);
+	if (name != node.Get_Current_Parent_Name()){
+		int index = 0;
+		for (node.First(); node.Get_Current_Name() != name; node.Next())
+			index++;
+		node.Set_Current_UserPointer(&ProfilerNodeTag);
+		node.Enter_Child(index);
+	}
+	ProfilerOpenNodes.push_back(node);
+
+	ProfileFrame & frame = ProfilerFrames[ProfilerCurrentFrame];
+	if (frame.records.size() >= MaxScopesPerFrame){
+		if (!ProfilerOverflowReported)
+			printf("Profiler : more than %u scopes in a frame, dropping the rest\n", MaxScopesPerFrame);
+		ProfilerOverflowReported = true;
+		ProfilerOpenScopes.push_back(-1);
+		return;
+	}
+
+	ProfileRecord record;
+	record.name = name;
+	record.depth = (int)ProfilerOpenScopes.size();
+	record.parent = ProfilerOpenScopes.empty() ? -1 : ProfilerOpenScopes.back();
+	record.calls = 1;
+	record.sampled = false;
+	record.gpu = gpu && ProfilerGPUTimers;
+	record.gpuBegin = record.gpuEnd = -1.0;
+	ProfilerOpenScopes.push_back((int)frame.records.size());
+	frame.records.push_back(record);
+
+	if (record.gpu){
+		// Query objects are created on demand and reused by every later frame in this slot
+		size_t needed = frame.records.size() * 2;
+		if (frame.queries.size() < needed){
+			size_t first = frame.queries.size();
+			frame.queries.resize(std::max(needed, first * 2));
+			glGenQueries((GLsizei)(frame.queries.size() - first), &frame.queries[first]);
+		}
+		glQueryCounter(frame.queries[needed - 2], GL_TIMESTAMP);
+		frame.hasGPUScopes = true;
+	}
+
+	// Last, so the bookkeeping above is not counted in the scope
+	frame.records.back().cpuBegin = profilerNow();
+}
+
+// Turns what the Bullet nodes below one of our nodes gathered since they were last collected
+// into records of the current frame, laid out one after the other from the start of their
+// parent : btQuickprof only keeps totals.
+static void collectBulletNodes(CProfileIterator node, int parent, int depth, double begin){
+	ProfileFrame & frame = ProfilerFrames[ProfilerCurrentFrame];
+	int index = 0;
+	for (node.First(); !node.Is_Done(); node.Next(), index++){
+		if (node.Get_Current_UserPointer() == &ProfilerNodeTag)
+			continue;
+		SampledTotals * seen = (SampledTotals*)node.Get_Current_UserPointer();
+		if (seen == NULL){
+			SampledTotals none = { 0, 0.0f };
+			ProfilerSampledTotals.push_back(none);
+			seen = &ProfilerSampledTotals.back();
+			node.Set_Current_UserPointer(seen);
+		}
+		int calls = node.Get_Current_Total_Calls();
+		float time = node.Get_Current_Total_Time();
+		// Reset in the meantime, by stepSimulation() for one
+		if (calls < seen->calls || time < seen->time){
+			seen->calls = 0;
+			seen->time = 0.0f;
+		}
+		if (calls == seen->calls)
+			continue;
+		if (frame.records.size() >= MaxScopesPerFrame)
+			return;
+		double duration = (time - seen->time) * 1000.0; // btQuickprof counts milliseconds
+		ProfileRecord record = { node.Get_Current_Name(), depth, parent, (unsigned int)(calls - seen->calls), true,
+			begin, begin + duration, false, -1.0, -1.0 };
+		seen->calls = calls;
+		seen->time = time;
+		frame.records.push_back(record);
+		CProfileIterator child = node;
+		child.Enter_Child(index);
+		collectBulletNodes(child, (int)frame.records.size() - 1, depth + 1, begin);
+		begin += duration;
+	}
+}
+
+void endProfileScope(){
+	if (!ProfilerInFrame || ProfilerOpenScopes.empty())
+		return;
+	double now = profilerNow();
+	int index = ProfilerOpenScopes.back();
+	ProfilerOpenScopes.pop_back();
+	CProfileIterator node = ProfilerOpenNodes.back();
+	ProfilerOpenNodes.pop_back();
+
+	ProfileFrame & frame = ProfilerFrames[ProfilerCurrentFrame];
+	if (index >= 0){
+		ProfileRecord & record = frame.records[index];
+		record.cpuEnd = now;
+		if (record.gpu)
+			glQueryCounter(frame.queries[2*index+1], GL_TIMESTAMP);
+		collectBulletNodes(node, index, record.depth + 1, record.cpuBegin);
+	}
+	CProfileManager::Stop_Profile();
+}
+
+
+
+// Per frame times of one scope over a window of frames. Scopes are keyed by their path from
+// the frame down, so a function called from two places is reported twice.
+struct ScopeSeries {
+	std::string path;   // names separated by '\1', which sorts before any printable character
+	const char * name;
+	int depth;
+	unsigned int calls;
+	std::vector<double> cpuMs, gpuMs; // summed per frame, for the frames the scope ran in
+	size_t lastFrame, lastGPUFrame;
+};
+
+static bool compareSeriesPaths(const ScopeSeries & a, const ScopeSeries & b){
+	return a.path < b.path;
+}
+
+// Gathers the series of the history frames from firstFrame on, parents before their children
+static void collectSeries(size_t firstFrame, std::vector<ScopeSeries> & series){
+	std::map<std::string, size_t> seriesIndex;
+	std::vector<std::string> paths;
+	for (size_t f = firstFrame; f < ProfilerHistory.size(); f++){
+		const std::vector<ProfileRecord> & records = ProfilerHistory[f];
+		paths.resize(records.size());
+		for (size_t i = 0; i < records.size(); i++){
+			const ProfileRecord & record = records[i];
+			paths[i] = record.parent >= 0 ? paths[record.parent] + '\1' + record.name : std::string(record.name);
+
+			std::map<std::string, size_t>::iterator it = seriesIndex.find(paths[i]);
+			if (it == seriesIndex.end()){
+				ScopeSeries entry;
+				entry.path = paths[i];
+				entry.name = record.name;
+				entry.depth = record.depth;
+				entry.calls = 0;
+				entry.lastFrame = entry.lastGPUFrame = (size_t)-1;
+				it = seriesIndex.insert(std::make_pair(paths[i], series.size())).first;
+				series.push_back(entry);
+			}
+			ScopeSeries & scope = series[it->second];
+			if (scope.lastFrame != f){
+				scope.cpuMs.push_back(0.0);
+				scope.lastFrame = f;
+			}
+			scope.cpuMs.back() += (record.cpuEnd - record.cpuBegin) / 1000.0;
+			scope.calls += record.calls;
+			if (record.gpu && record.gpuBegin >= 0.0){
+				if (scope.lastGPUFrame != f){
+					scope.gpuMs.push_back(0.0);
+					scope.lastGPUFrame = f;
+				}
+				scope.gpuMs.back() += (record.gpuEnd - record.gpuBegin) / 1000.0;
+			}
+		}
+	}
+	std::sort(series.begin(), series.end(), compareSeriesPaths);
+}
+
+struct SeriesSummary {
+	double mean, p50, p95, p99, max;
+};
+
+// Nearest rank percentiles
+static SeriesSummary summarize(std::vector<double> values){
+	SeriesSummary summary = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+	if (values.empty())
+		return summary;
+	std::sort(values.begin(), values.end());
+	size_t n = values.size();
+	for (size_t i = 0; i < n; i++)
+		summary.mean += values[i];
+	summary.mean /= n;
+	summary.p50 = values[std::max<size_t>(1, (size_t)ceil(0.50 * n)) - 1];
+	summary.p95 = values[std::max<size_t>(1, (size_t)ceil(0.95 * n)) - 1];
+	summary.p99 = values[std::max<size_t>(1, (size_t)ceil(0.99 * n)) - 1];
+	summary.max = values[n - 1];
+	return summary;
+}
+
+// One column per frame, made of stacked glyphs
+static void drawGraph(const char * label, bool gpu, int x, int y, int size){
+	int barSize = std::max(2, size / 3);
+	unsigned int count = std::min<size_t>(GraphColumns, ProfilerHistory.size());
+	size_t first = ProfilerHistory.size() - count;
+
+	double worst = 0.0;
+	for (unsigned int c = 0; c < count; c++){
+		const ProfileRecord & frame = ProfilerHistory[first + c][0];
+		double ms = gpu ? (frame.gpuBegin >= 0.0 ? (frame.gpuEnd - frame.gpuBegin) / 1000.0 : 0.0)
+			: (frame.cpuEnd - frame.cpuBegin) / 1000.0;
+		worst = std::max(worst, ms);
+		int rows = (int)std::min<double>(GraphRows, ms / GraphMaxMs * GraphRows + 0.5);
+		for (int r = 0; r < rows; r++)
+			printText2D("#", x + c * barSize, y - (int)GraphRows * barSize + r * barSize, barSize);
+	}
+
+	char text[128];
+	snprintf(text, sizeof(text), "%s max %.2f ms", label, worst);
+	printText2D(text, x + GraphColumns * barSize + size, y - size, size);
+}
+
+void drawProfilerHUD(int x, int y, int size){
+	if (ProfilerHistory.empty())
+		return;
+
+	size_t count = std::min<size_t>(HudWindow, ProfilerHistory.size());
+	std::vector<ScopeSeries> series;
+	collectSeries(ProfilerHistory.size() - count, series);
+
+	char text[256];
+	snprintf(text, sizeof(text), "%-28s %8s %8s %8s %6s", "scope (ms/frame)", "CPU avg", "CPU p99", "GPU avg", "calls");
+	printText2D(text, x, y - size, size);
+	int line = 2;
+	for (size_t s = 0; s < series.size(); s++, line++){
+		const ScopeSeries & scope = series[s];
+		SeriesSummary cpu = summarize(scope.cpuMs);
+		char name[64];
+		snprintf(name, sizeof(name), "%*s%s", scope.depth * 2, "", scope.name);
+		char gpuText[16] = "-";
+		if (!scope.gpuMs.empty())
+			snprintf(gpuText, sizeof(gpuText), "%.3f", summarize(scope.gpuMs).mean);
+		snprintf(text, sizeof(text), "%-28s %8.3f %8.3f %8s %6.1f", name, cpu.mean, cpu.p99, gpuText, (double)scope.calls / count);
+		printText2D(text, x, y - line * size, size);
+	}
+
+	int graphTop = y - (line + 1) * size;
+	int graphHeight = (int)GraphRows * std::max(2, size / 3) + size;
+	drawGraph("CPU frame", false, x, graphTop, size);
+	if (ProfilerGPUTimers)
+		drawGraph("GPU frame", true, x, graphTop - graphHeight, size);
+}
+
+unsigned int profileScopeCalls(const char * path){
+	std::vector<ScopeSeries> series;
+	collectSeries(0, series);
+	for (size_t s = 0; s < series.size(); s++){
+		std::string name = series[s].path;
+		std::replace(name.begin(), name.end(), '\1', '/');
+		if (name == path)
+			return series[s].calls;
+	}
+	return 0;
+}
+
+bool writeProfilerReport(const char * path){
+	FILE * file = fopen(path, "w");
+	if (file == NULL){
+		printf("Could not write profiler report %s\n", path);
+		return false;
+	}
+
+	std::vector<ScopeSeries> series;
+	collectSeries(0, series);
+
+	size_t length = strlen(path);
+	bool csv = length >= 4 && strcmp(path + length - 4, ".csv") == 0;
+	if (csv)
+		fprintf(file, "scope,frames,calls_per_frame,cpu_mean_ms,cpu_p50_ms,cpu_p95_ms,cpu_p99_ms,cpu_max_ms,"
+			"gpu_frames,gpu_mean_ms,gpu_p50_ms,gpu_p95_ms,gpu_p99_ms,gpu_max_ms\n");
+	else
+		fprintf(file, "{\"frames\":%lu,\"scopes\":[", (unsigned long)ProfilerHistory.size());
+
+	for (size_t s = 0; s < series.size(); s++){
+		const ScopeSeries & scope = series[s];
+		std::string name = scope.path;
+		std::replace(name.begin(), name.end(), '\1', '/');
+		SeriesSummary cpu = summarize(scope.cpuMs);
+		SeriesSummary gpu = summarize(scope.gpuMs);
+		double callsPerFrame = (double)scope.calls / scope.cpuMs.size();
+		if (csv)
+			fprintf(file, "%s,%lu,%.2f,%.4f,%.4f,%.4f,%.4f,%.4f,%lu,%.4f,%.4f,%.4f,%.4f,%.4f\n", name.c_str(),
+				(unsigned long)scope.cpuMs.size(), callsPerFrame, cpu.mean, cpu.p50, cpu.p95, cpu.p99, cpu.max,
+				(unsigned long)scope.gpuMs.size(), gpu.mean, gpu.p50, gpu.p95, gpu.p99, gpu.max);
+		else
+			fprintf(file, "%s\n{\"scope\":\"%s\",\"frames\":%lu,\"calls_per_frame\":%.2f,"
+				"\"cpu_ms\":{\"mean\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f},"
+				"\"gpu_frames\":%lu,\"gpu_ms\":{\"mean\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f}}",
+				s == 0 ? "" : ",", name.c_str(), (unsigned long)scope.cpuMs.size(), callsPerFrame,
+				cpu.mean, cpu.p50, cpu.p95, cpu.p99, cpu.max,
+				(unsigned long)scope.gpuMs.size(), gpu.mean, gpu.p50, gpu.p95, gpu.p99, gpu.max);
+	}
+	if (!csv)
+		fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("Wrote the profile of %lu frames to %s\n", (unsigned long)ProfilerHistory.size(), path);
+	return true;
+}
+
+bool writeChromeTrace(const char * path){
+	FILE * file = fopen(path, "w");
+	if (file == NULL){
+		printf("Could not write profiler trace %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+	size_t events = 0;
+	for (size_t f = 0; f < ProfilerHistory.size(); f++){
+		const std::vector<ProfileRecord> & records = ProfilerHistory[f];
+		for (size_t i = 0; i < records.size(); i++){
+			const ProfileRecord & record = records[i];
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"calls\":%u}}",
+				record.name, record.sampled ? "sampled" : "cpu", record.cpuBegin, record.cpuEnd - record.cpuBegin, record.calls);
+			events++;
+			if (record.gpu && record.gpuBegin >= 0.0){
+				fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f}",
+					record.name, record.gpuBegin, record.gpuEnd - record.gpuBegin);
+				events++;
+			}
+		}
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("Wrote %lu profiler events from %lu frames to %s\n", (unsigned long)events, (unsigned long)ProfilerHistory.size(), path);
+	return true;
+}
+
+void cleanupProfiler(){
+	for (unsigned int i = 0; i < FramesInFlight; i++){
+		ProfileFrame & frame = ProfilerFrames[i];
+		if (!frame.queries.empty())
+			glDeleteQueries((GLsizei)frame.queries.size(), &frame.queries[0]);
+		frame.queries.clear();
+		frame.records.clear();
+		frame.pending = false;
+	}
+	ProfilerHistory.clear();
+	ProfilerInFrame = false;
+	ProfilerOpenNodes.clear();
+	if (ProfilerRootNode != NULL)
+		CProfileManager::Release_Iterator(ProfilerRootNode);
+	ProfilerRootNode = NULL;
+	CProfileManager::CleanupMemory();
+	ProfilerSampledTotals.clear();
+}
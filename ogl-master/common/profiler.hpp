@@ -0,0 +1,53 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+// Hierarchical frame profiler. CPU scopes are timed with a high resolution clock ; GPU scopes
+// also record a pair of GL timestamp queries, read back a few frames later so that nothing
+// ever waits on the GPU. Must be used from the render thread only.
+//
+// Every scope is also a btQuickprof sample, so the BT_PROFILE scopes run on the render
+// thread, Bullet's or ours, show up in the same tree under the scope that opened them.
+// btQuickprof is not thread safe : code running in jobs must not use BT_PROFILE. The history
+// keeps a snapshot of that tree for each of the last few hundred frames.
+
+void initProfiler();
+
+// Bracket each frame. Everything profiled in between is nested under a "Frame" scope.
+void beginProfilerFrame();
+void endProfilerFrame();
+
+// Scope names must outlive the profiler : use string literals.
+// Prefer the PROFILE_SCOPE / PROFILE_GPU_SCOPE macros, which close the scope automatically.
+void beginProfileScope(const char * name, bool gpu);
+void endProfileScope();
+
+struct ProfileScope {
+	ProfileScope(const char * name, bool gpu) { beginProfileScope(name, gpu); }
+	~ProfileScope() { endProfileScope(); }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, false)
+#define PROFILE_GPU_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, true)
+
+// Queues the per scope averages and rolling frame time graphs through printText2D(),
+// x, y being the top left corner in pixels. initText2D() must have been called.
+void drawProfilerHUD(int x, int y, int size);
+
+// Writes per scope statistics over the frames kept in the history : calls per frame, mean,
+// median, 95th and 99th percentile and max of the CPU and GPU times. CSV when the path ends
+// in .csv, JSON otherwise.
+bool writeProfilerReport(const char * path);
+
+// Writes the frames kept in the history as a Chrome trace (chrome://tracing, Perfetto).
+// CPU scopes go to thread 1, GPU scopes to thread 2.
+bool writeChromeTrace(const char * path);
+
+// Calls of a scope over the frames kept in the history, the path being the names from the
+// frame down separated by '/', e.g. "Frame/updateScene"
+unsigned int profileScopeCalls(const char * path);
+
+void cleanupProfiler();
+
+#endif
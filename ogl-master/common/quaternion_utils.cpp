@@ -4,6 +4,11 @@
 #include <glm/gtx/norm.hpp>
 using namespace glm;
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QUATERNION_USE_SSE2
+#endif
+
 #include "quaternion_utils.hpp"
 
 
@@ -118,6 +123,71 @@ quat RotateTowards(quat q1, quat q2, float maxAngle){
 
 
 
+// slerp(q1, q2, t) = f(1-t) q1 + f(t) q2, with f(t) = sin(t*angle) / sin(angle) expanded in
+// powers of cos(angle) - 1 : each term is the previous one times (u[i]*t*t - v[i]) * (cos - 1).
+// Eight terms, the last one scaled by onePlusMu to make up for the ones left out.
+static const float onePlusMu = 1.85298109240830f;
+static const float slerpU[8] = { 1.0f/(1*3), 1.0f/(2*5), 1.0f/(3*7), 1.0f/(4*9), 1.0f/(5*11), 1.0f/(6*13), 1.0f/(7*15), onePlusMu/(8*17) };
+static const float slerpV[8] = { 1.0f/3, 2.0f/5, 3.0f/7, 4.0f/9, 5.0f/11, 6.0f/13, 7.0f/15, onePlusMu*8/17 };
+
+quat FastSlerp(quat q1, quat q2, float t){
+	float cosTheta = dot(q1, q2);
+	// Avoid taking the long path around the sphere
+	float sign = cosTheta < 0.0f ? -1.0f : 1.0f;
+	float xm1 = cosTheta * sign - 1.0f;
+	float d = 1.0f - t;
+	float sqrT = t * t, sqrD = d * d;
+	float cT = 1.0f, cD = 1.0f;
+	for (int i = 7; i >= 0; i--){
+		cT = 1.0f + (slerpU[i] * sqrT - slerpV[i]) * xm1 * cT;
+		cD = 1.0f + (slerpU[i] * sqrD - slerpV[i]) * xm1 * cD;
+	}
+	return q1 * (cD * d) + q2 * (cT * t * sign);
+}
+
+void SlerpBatch(const quat * q1, const quat * q2, const float * t, quat * out, size_t count){
+	size_t i = 0;
+#ifdef QUATERNION_USE_SSE2
+	// Four quaternions per iteration, transposed so that each register holds one component
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	for (; i + 4 <= count; i += 4){
+		__m128 ax = _mm_loadu_ps(&q1[i].x), ay = _mm_loadu_ps(&q1[i+1].x), az = _mm_loadu_ps(&q1[i+2].x), aw = _mm_loadu_ps(&q1[i+3].x);
+		__m128 bx = _mm_loadu_ps(&q2[i].x), by = _mm_loadu_ps(&q2[i+1].x), bz = _mm_loadu_ps(&q2[i+2].x), bw = _mm_loadu_ps(&q2[i+3].x);
+		_MM_TRANSPOSE4_PS(ax, ay, az, aw);
+		_MM_TRANSPOSE4_PS(bx, by, bz, bw);
+		__m128 cosTheta = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+			_mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+		__m128 sign = _mm_and_ps(cosTheta, signBit);
+		__m128 xm1 = _mm_sub_ps(_mm_xor_ps(cosTheta, sign), one);
+		__m128 vt = _mm_loadu_ps(t + i);
+		__m128 vd = _mm_sub_ps(one, vt);
+		__m128 sqrT = _mm_mul_ps(vt, vt), sqrD = _mm_mul_ps(vd, vd);
+		__m128 cT = one, cD = one;
+		for (int k = 7; k >= 0; k--){
+			__m128 u = _mm_set1_ps(slerpU[k]), v = _mm_set1_ps(slerpV[k]);
+			cT = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, sqrT), v), xm1), cT));
+			cD = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, sqrD), v), xm1), cD));
+		}
+		cD = _mm_mul_ps(cD, vd);
+		cT = _mm_xor_ps(_mm_mul_ps(cT, vt), sign);
+		__m128 rx = _mm_add_ps(_mm_mul_ps(ax, cD), _mm_mul_ps(bx, cT));
+		__m128 ry = _mm_add_ps(_mm_mul_ps(ay, cD), _mm_mul_ps(by, cT));
+		__m128 rz = _mm_add_ps(_mm_mul_ps(az, cD), _mm_mul_ps(bz, cT));
+		__m128 rw = _mm_add_ps(_mm_mul_ps(aw, cD), _mm_mul_ps(bw, cT));
+		_MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+		_mm_storeu_ps(&out[i].x, rx);
+		_mm_storeu_ps(&out[i+1].x, ry);
+		_mm_storeu_ps(&out[i+2].x, rz);
+		_mm_storeu_ps(&out[i+3].x, rw);
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = FastSlerp(q1[i], q2[i], t[i]);
+}
+
+
+
 
 
 
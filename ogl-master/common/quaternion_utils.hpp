@@ -7,5 +7,13 @@ quat LookAt(vec3 direction, vec3 desiredUp);
 
 quat RotateTowards(quat q1, quat q2, float maxAngle);
 
+// Like slerp(), along the shortest arc, but with David Eberly's polynomial fit ("A Fast and
+// Accurate Algorithm for Computing SLERP") : no trigonometry and no division. For unit
+// quaternions, the components come out within 3e-5 of slerp()'s.
+quat FastSlerp(quat q1, quat q2, float t);
+
+// out[i] = FastSlerp(q1[i], q2[i], t[i]), four at a time with SSE2. out may be q1 or q2.
+void SlerpBatch(const quat * q1, const quat * q2, const float * t, quat * out, size_t count);
+
 
 #endif // QUATERNION_UTILS_H
\ No newline at end of file
@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "scene.hpp"
+
+// Just enough JSON : objects, arrays, numbers, strings without unicode escapes, true, false, null
+struct JsonValue {
+	enum Type { Null, Bool, Number, String, Array, Object };
+	Type type = Null;
+	double number = 0.0;
+	std::string string;
+	std::vector<JsonValue> items;   // array elements, or object values
+	std::vector<std::string> keys;  // object keys, in the same order as items
+	int line = 0;
+
+	const JsonValue * find(const char * key) const {
+		for (size_t i = 0; i < keys.size(); i++)
+			if (keys[i] == key)
+				return &items[i];
+		return NULL;
+	}
+};
+
+struct JsonParser {
+	const char * p;
+	const char * end;
+	int line;
+	const char * error;
+	int errorLine;
+
+	bool fail(const char * message){
+		if (error == NULL){
+			error = message;
+			errorLine = line;
+		}
+		return false;
+	}
+
+	void skipSpaces(){
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')){
+			if (*p == '\n')
+				line++;
+			p++;
+		}
+	}
+
+	bool parseString(std::string & out){
+		p++; // opening quote
+		const char * start = p;
+		while (p < end && *p != '"' && *p != '\\' && *p != '\n')
+			p++;
+		out.assign(start, p);
+		while (p < end && *p == '\\'){
+			if (p + 1 >= end)
+				return fail("unterminated string");
+			char escaped = p[1];
+			switch (escaped){
+			case 'n': out += '\n'; break;
+			case 't': out += '\t'; break;
+			case '"': case '\\': case '/': out += escaped; break;
+			default: return fail("unsupported escape sequence");
+			}
+			p += 2;
+			start = p;
+			while (p < end && *p != '"' && *p != '\\' && *p != '\n')
+				p++;
+			out.append(start, p);
+		}
+		if (p >= end || *p != '"')
+			return fail("unterminated string");
+		p++;
+		return true;
+	}
+
+	bool parseValue(JsonValue & value){
+		skipSpaces();
+		value.line = line;
+		if (p >= end)
+			return fail("unexpected end of file");
+
+		if (*p == '{'){
+			value.type = JsonValue::Object;
+			p++;
+			skipSpaces();
+			if (p < end && *p == '}'){
+				p++;
+				return true;
+			}
+			for (;;){
+				skipSpaces();
+				if (p >= end || *p != '"')
+					return fail("expected a key");
+				value.keys.push_back(std::string());
+				if (!parseString(value.keys.back()))
+					return false;
+				skipSpaces();
+				if (p >= end || *p != ':')
+					return fail("expected ':'");
+				p++;
+				value.items.push_back(JsonValue());
+				if (!parseValue(value.items.back()))
+					return false;
+				skipSpaces();
+				if (p < end && *p == ','){
+					p++;
+					continue;
+				}
+				if (p < end && *p == '}'){
+					p++;
+					return true;
+				}
+				return fail("expected ',' or '}'");
+			}
+		}
+
+		if (*p == '['){
+			value.type = JsonValue::Array;
+			p++;
+			skipSpaces();
+			if (p < end && *p == ']'){
+				p++;
+				return true;
+			}
+			for (;;){
+				value.items.push_back(JsonValue());
+				if (!parseValue(value.items.back()))
+					return false;
+				skipSpaces();
+				if (p < end && *p == ','){
+					p++;
+					continue;
+				}
+				if (p < end && *p == ']'){
+					p++;
+					return true;
+				}
+				return fail("expected ',' or ']'");
+			}
+		}
+
+		if (*p == '"'){
+			value.type = JsonValue::String;
+			return parseString(value.string);
+		}
+
+		if (end - p >= 4 && strncmp(p, "true", 4) == 0){
+			value.type = JsonValue::Bool;
+			value.number = 1.0;
+			p += 4;
+			return true;
+		}
+		if (end - p >= 5 && strncmp(p, "false", 5) == 0){
+			value.type = JsonValue::Bool;
+			p += 5;
+			return true;
+		}
+		if (end - p >= 4 && strncmp(p, "null", 4) == 0){
+			p += 4;
+			return true;
+		}
+
+		// The buffer ends with a '\0', so strtod can't run past it
+		char * numberEnd;
+		value.number = strtod(p, &numberEnd);
+		if (numberEnd == p)
+			return fail("unexpected character");
+		value.type = JsonValue::Number;
+		p = numberEnd;
+		return true;
+	}
+};
+
+// Reads the members of the scene, remembering the first error
+struct SceneReader {
+	const char * path;
+	bool ok;
+
+	bool fail(const JsonValue & value, const char * message){
+		if (ok)
+			printf("%s:%d : %s\n", path, value.line, message);
+		ok = false;
+		return false;
+	}
+
+	bool readFloat(const JsonValue & value, float & out){
+		if (value.type != JsonValue::Number)
+			return fail(value, "expected a number");
+		out = (float)value.number;
+		return true;
+	}
+
+	bool readFloats(const JsonValue & value, float * out, size_t count){
+		if (value.type != JsonValue::Array || value.items.size() != count)
+			return fail(value, count == 2 ? "expected an array of 2 numbers" : count == 3 ? "expected an array of 3 numbers" : "expected an array of 4 numbers");
+		for (size_t i = 0; i < count; i++)
+			if (!readFloat(value.items[i], out[i]))
+				return false;
+		return true;
+	}
+
+	// Optional members keep their default value
+	void readVec3(const JsonValue & object, const char * key, glm::vec3 & out){
+		const JsonValue * value = object.find(key);
+		if (value != NULL)
+			readFloats(*value, &out.x, 3);
+	}
+
+	void readNumber(const JsonValue & object, const char * key, float & out){
+		const JsonValue * value = object.find(key);
+		if (value != NULL)
+			readFloat(*value, out);
+	}
+
+	// Looks a name up in one of the scene's tables
+	int readName(const JsonValue & object, const char * key, const std::unordered_map<std::string, int> & names, int missing){
+		const JsonValue * value = object.find(key);
+		if (value == NULL)
+			return missing;
+		if (value->type != JsonValue::String){
+			fail(*value, "expected a name");
+			return missing;
+		}
+		std::unordered_map<std::string, int>::const_iterator found = names.find(value->string);
+		if (found == names.end()){
+			fail(*value, ("unknown name \"" + value->string + "\"").c_str());
+			return missing;
+		}
+		return found->second;
+	}
+};
+
+bool loadScene(const char * path, Scene & scene){
+	FILE * file = fopen(path, "rb");
+	if (file == NULL){
+		printf("Impossible to open %s\n", path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	std::vector<char> text(size + 1, '\0');
+	size_t read = fread(&text[0], 1, size, file);
+	fclose(file);
+
+	JsonParser parser = { &text[0], &text[0] + read, 1, NULL, 0 };
+	JsonValue root;
+	parser.parseValue(root);
+	parser.skipSpaces();
+	if (parser.error == NULL && parser.p != parser.end)
+		parser.fail("unexpected text after the scene");
+	if (parser.error != NULL){
+		printf("%s:%d : %s\n", path, parser.errorLine, parser.error);
+		return false;
+	}
+
+	SceneReader reader = { path, true };
+	if (root.type != JsonValue::Object)
+		return reader.fail(root, "expected an object");
+
+	scene = Scene();
+	std::unordered_map<std::string, int> meshNames, materialNames, rigNames;
+
+	// Meshes, merging the entries that would load the same vertices
+	if (const JsonValue * meshes = root.find("meshes")){
+		std::unordered_map<std::string, int> uniqueMeshes;
+		for (size_t i = 0; i < meshes->keys.size(); i++){
+			const JsonValue & entry = meshes->items[i];
+			const JsonValue * meshPath = entry.find("path");
+			if (meshPath == NULL || meshPath->type != JsonValue::String)
+				return reader.fail(entry, "expected a mesh path");
+			SceneMesh mesh = { meshPath->string, glm::vec4(1.0f) };
+			if (const JsonValue * color = entry.find("color"))
+				reader.readFloats(*color, &mesh.color.x, 4);
+
+			char colorKey[64];
+			snprintf(colorKey, sizeof(colorKey), "|%g,%g,%g,%g", mesh.color.r, mesh.color.g, mesh.color.b, mesh.color.a);
+			std::pair<std::unordered_map<std::string, int>::iterator, bool> inserted =
+				uniqueMeshes.insert(std::make_pair(mesh.path + colorKey, (int)scene.meshes.size()));
+			if (inserted.second)
+				scene.meshes.push_back(mesh);
+			meshNames[meshes->keys[i]] = inserted.first->second;
+		}
+	}
+
+	// Materials. There is always at least one, nodes without a material use the first.
+	if (const JsonValue * materials = root.find("materials")){
+		for (size_t i = 0; i < materials->keys.size(); i++){
+			const JsonValue & entry = materials->items[i];
+			SceneMaterial material = { glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(0.1f), 20.0f };
+			reader.readVec3(entry, "diffuse", material.diffuse);
+			reader.readVec3(entry, "ambient", material.ambient);
+			reader.readVec3(entry, "specular", material.specular);
+			reader.readNumber(entry, "shininess", material.shininess);
+			materialNames[materials->keys[i]] = (int)scene.materials.size();
+			scene.materials.push_back(material);
+		}
+	}
+	if (scene.materials.empty()){
+		SceneMaterial material = { glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(0.1f), 20.0f };
+		scene.materials.push_back(material);
+	}
+
+	if (const JsonValue * lights = root.find("lights")){
+		for (size_t i = 0; i < lights->items.size(); i++){
+			const JsonValue & entry = lights->items[i];
+			SceneLight light = { glm::vec3(0.0f), glm::vec3(1.0f), glm::vec3(0.2f), glm::vec3(0.8f) };
+			reader.readVec3(entry, "position", light.position);
+			reader.readVec3(entry, "diffuse", light.diffuse);
+			reader.readVec3(entry, "ambient", light.ambient);
+			reader.readVec3(entry, "specular", light.specular);
+			scene.lights.push_back(light);
+		}
+	}
+
+	// Rig templates
+	if (const JsonValue * rigs = root.find("rigs")){
+		for (size_t r = 0; r < rigs->keys.size(); r++){
+			const JsonValue & nodes = rigs->items[r];
+			if (nodes.type != JsonValue::Array || nodes.items.empty())
+				return reader.fail(nodes, "expected an array of rig nodes");
+
+			SceneRig rig;
+			rig.name = rigs->keys[r];
+			std::unordered_map<std::string, int> nodeNames;
+			for (size_t n = 0; n < nodes.items.size(); n++){
+				const JsonValue & entry = nodes.items[n];
+				SceneRigNode node = { "", -1, -1, 0, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), -180.0f, 180.0f, false };
+				const JsonValue * name = entry.find("name");
+				if (name == NULL || name->type != JsonValue::String)
+					return reader.fail(entry, "expected a node name");
+				node.name = name->string;
+				// Parents must come first, so that the rig is already flattened
+				node.parent = reader.readName(entry, "parent", nodeNames, -1);
+				if (n > 0 && node.parent < 0)
+					return reader.fail(entry, "only the first node of a rig can be its root");
+				node.mesh = reader.readName(entry, "mesh", meshNames, -1);
+				node.material = reader.readName(entry, "material", materialNames, 0);
+				reader.readVec3(entry, "offset", node.offset);
+				reader.readVec3(entry, "axis", node.axis);
+				node.jointed = entry.find("axis") != NULL || entry.find("limits") != NULL;
+				if (const JsonValue * limits = entry.find("limits")){
+					float range[2];
+					if (reader.readFloats(*limits, range, 2)){
+						node.minAngle = range[0];
+						node.maxAngle = range[1];
+					}
+				}
+				if (!nodeNames.insert(std::make_pair(node.name, (int)rig.nodes.size())).second)
+					return reader.fail(entry, "duplicate node name");
+				rig.nodes.push_back(node);
+			}
+			rigNames[rig.name] = (int)scene.rigs.size();
+			scene.rigs.push_back(rig);
+		}
+	}
+
+	if (const JsonValue * instances = root.find("instances")){
+		scene.instances.reserve(instances->items.size());
+		for (size_t i = 0; i < instances->items.size() && reader.ok; i++){
+			const JsonValue & entry = instances->items[i];
+			SceneInstance instance = { -1, glm::vec3(0.0f), 0.0f };
+			instance.rig = reader.readName(entry, "rig", rigNames, -1);
+			if (instance.rig < 0)
+				return reader.fail(entry, "expected a rig");
+			reader.readVec3(entry, "position", instance.position);
+			reader.readNumber(entry, "yaw", instance.yaw);
+			scene.instances.push_back(instance);
+		}
+	}
+
+	return reader.ok;
+}
+
+void instantiateScene(const Scene & scene, std::vector<glm::mat4> & locals, std::vector<int> & parents, std::vector<size_t> & instanceStarts){
+	size_t count = 0;
+	for (size_t i = 0; i < scene.instances.size(); i++)
+		count += scene.rigs[scene.instances[i].rig].nodes.size();
+	locals.resize(count);
+	parents.resize(count);
+	instanceStarts.resize(scene.instances.size());
+
+	size_t start = 0;
+	for (size_t i = 0; i < scene.instances.size(); i++){
+		const SceneInstance & instance = scene.instances[i];
+		const SceneRig & rig = scene.rigs[instance.rig];
+		instanceStarts[i] = start;
+
+		glm::mat4 placement = glm::rotate(glm::translate(glm::mat4(1.0f), instance.position), glm::radians(instance.yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+		for (size_t n = 0; n < rig.nodes.size(); n++){
+			const SceneRigNode & node = rig.nodes[n];
+			locals[start + n] = glm::translate(node.parent < 0 ? placement : glm::mat4(1.0f), node.offset);
+			parents[start + n] = node.parent < 0 ? -1 : (int)start + node.parent;
+		}
+		start += rig.nodes.size();
+	}
+}
+
+int findRigNode(const SceneRig & rig, const char * name){
+	for (size_t n = 0; n < rig.nodes.size(); n++)
+		if (rig.nodes[n].name == name)
+			return (int)n;
+	return -1;
+}
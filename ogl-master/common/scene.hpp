@@ -0,0 +1,84 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+// Declarative scene description : meshes, materials, lights, rig templates and their
+// instances, read from a JSON file. No OpenGL involved : the caller creates the GPU
+// resources, once per mesh whatever the number of instances using it.
+//
+// {
+//   "meshes":    { "base": { "path": "../common/Base2.obj", "color": [1, 0, 0, 1] }, ... },
+//   "materials": { "red": { "diffuse": [1, 0.5, 0.5], "ambient": [1, 0.5, 0.5],
+//                           "specular": [0.1, 0.05, 0.05], "shininess": 20 } },
+//   "lights":    [ { "position": [-2, 5, 5], "diffuse": [1, 0.6, 0.6],
+//                    "ambient": [0.2, 0.2, 0.2], "specular": [0.8, 0.8, 0.8] } ],
+//   "rigs":      { "arm": [ { "name": "base", "mesh": "base", "material": "red" },
+//                           { "name": "top", "parent": "base", "mesh": "top", "offset": [0, 1, 0],
+//                             "axis": [0, 1, 0], "limits": [-180, 180] }, ... ] },
+//   "instances": [ { "rig": "arm", "position": [0, 0, 0], "yaw": 0 }, ... ]
+// }
+//
+// Rig nodes list their parent before themselves. Angles are in degrees. Mesh entries with
+// the same path and color are merged.
+
+struct SceneMesh {
+	std::string path;
+	glm::vec4 color;
+};
+
+struct SceneMaterial {
+	glm::vec3 diffuse;
+	glm::vec3 ambient;
+	glm::vec3 specular;
+	float shininess;
+};
+
+struct SceneLight {
+	glm::vec3 position;
+	glm::vec3 diffuse;
+	glm::vec3 ambient;
+	glm::vec3 specular;
+};
+
+struct SceneRigNode {
+	std::string name;
+	int parent;        // index in the rig, -1 for the root
+	int mesh;          // index in Scene::meshes, -1 for none
+	int material;      // index in Scene::materials
+	glm::vec3 offset;  // translation from the parent
+	glm::vec3 axis;    // joint rotation axis, and its range
+	float minAngle;
+	float maxAngle;
+	bool jointed;      // false for nodes the file gives neither an axis nor limits
+};
+
+struct SceneRig {
+	std::string name;
+	std::vector<SceneRigNode> nodes;
+};
+
+struct SceneInstance {
+	int rig;
+	glm::vec3 position;
+	float yaw;         // around +Y
+};
+
+struct Scene {
+	std::vector<SceneMesh> meshes;
+	std::vector<SceneMaterial> materials;
+	std::vector<SceneLight> lights;
+	std::vector<SceneRig> rigs;
+	std::vector<SceneInstance> instances;
+};
+
+// Prints the first error with its line number and returns false when the file can't be used
+bool loadScene(const char * path, Scene & scene);
+
+// Flattens every instance into one array, parents first, one subtree per instance :
+// local transforms at rest, parent indices, and the first node of each instance (ready
+// for multiplyByParentsParallel). Node i is node (i - instanceStart) of its instance's rig.
+void instantiateScene(const Scene & scene, std::vector<glm::mat4> & locals, std::vector<int> & parents, std::vector<size_t> & instanceStarts);
+
+// Index of the named node in the rig, or -1
+int findRigNode(const SceneRig & rig, const char * name);
+
+#endif
@@ -0,0 +1,338 @@
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include <LinearMath/btConvexHullComputer.h>
+
+#include "selfcollision.hpp"
+
+// GJK converges in a handful of iterations on hulls this small ; it only runs out of them
+// on shapes that touch, which counts as intersecting
+static const int MaxGjkIterations = 32;
+
+// Links this close to the ground at rest stand on it
+static const float GroundTolerance = 1e-3f;
+
+bool buildConvexHull(const std::vector<glm::vec3> & points, ConvexHull & hull){
+	hull.vertices.clear();
+	if (points.size() < 4)
+		return false;
+	btConvexHullComputer computer;
+	computer.compute(&points[0].x, sizeof(glm::vec3), (int)points.size(), 0.0f, 0.0f);
+	if (computer.vertices.size() < 4)
+		return false;
+
+	hull.vertices.resize(computer.vertices.size());
+	for (int i = 0; i < computer.vertices.size(); i++){
+		const btVector3 & v = computer.vertices[i];
+		hull.vertices[i] = glm::vec3(v.getX(), v.getY(), v.getZ());
+	}
+	hull.boundsMin = hull.boundsMax = hull.vertices[0];
+	for (const glm::vec3 & v : hull.vertices){
+		hull.boundsMin = glm::min(hull.boundsMin, v);
+		hull.boundsMax = glm::max(hull.boundsMax, v);
+	}
+	return true;
+}
+
+// Farthest vertex of the placed hull along direction. The direction is taken to mesh space
+// (the transpose of the linear part holds for scales and shears too) so that only the
+// winner gets transformed. Hulls of a few dozen vertices don't need hill climbing.
+static glm::vec3 support(const ConvexHull & hull, const glm::mat4 & world, const glm::vec3 & direction){
+	glm::vec3 local = glm::transpose(glm::mat3(world)) * direction;
+	const glm::vec3 * best = &hull.vertices[0];
+	float bestDistance = glm::dot(local, *best);
+	for (size_t i = 1; i < hull.vertices.size(); i++){
+		float distance = glm::dot(local, hull.vertices[i]);
+		if (distance > bestDistance){
+			bestDistance = distance;
+			best = &hull.vertices[i];
+		}
+	}
+	return glm::vec3(world * glm::vec4(*best, 1.0f));
+}
+
+float convexHullBottom(const ConvexHull & hull, const glm::mat4 & world){
+	return support(hull, world, glm::vec3(0.0f, -1.0f, 0.0f)).y;
+}
+
+// Closest points to the origin on the simplex features, from Ericson's Real-Time Collision
+// Detection (5.1). Each also reduces the simplex to the vertices of the feature the point
+// lies on, so that GJK only keeps what it needs.
+static glm::vec3 closestOnSegment(glm::vec3 * simplex, int & count){
+	glm::vec3 a = simplex[0], b = simplex[1];
+	glm::vec3 ab = b - a;
+	float t = glm::dot(-a, ab);
+	if (t <= 0.0f){
+		count = 1;
+		return a;
+	}
+	float length2 = glm::dot(ab, ab);
+	if (t >= length2){
+		simplex[0] = b;
+		count = 1;
+		return b;
+	}
+	count = 2;
+	return a + ab * (t / length2);
+}
+
+static glm::vec3 closestOnTriangle(glm::vec3 * simplex, int & count){
+	glm::vec3 a = simplex[0], b = simplex[1], c = simplex[2];
+	glm::vec3 ab = b - a, ac = c - a;
+
+	float d1 = glm::dot(ab, -a), d2 = glm::dot(ac, -a);
+	if (d1 <= 0.0f && d2 <= 0.0f){
+		count = 1;
+		return a;
+	}
+	float d3 = glm::dot(ab, -b), d4 = glm::dot(ac, -b);
+	if (d3 >= 0.0f && d4 <= d3){
+		simplex[0] = b;
+		count = 1;
+		return b;
+	}
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f){
+		count = 2;
+		return a + ab * (d1 / (d1 - d3));
+	}
+	float d5 = glm::dot(ab, -c), d6 = glm::dot(ac, -c);
+	if (d6 >= 0.0f && d5 <= d6){
+		simplex[0] = c;
+		count = 1;
+		return c;
+	}
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f){
+		simplex[1] = c;
+		count = 2;
+		return a + ac * (d2 / (d2 - d6));
+	}
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f){
+		simplex[0] = c;
+		count = 2;
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+	float denominator = 1.0f / (va + vb + vc);
+	count = 3;
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// Returns false when the origin is inside the tetrahedron. Otherwise the closest point is on
+// one of the faces the origin is in front of ; flat tetrahedra have it on any of them.
+static bool closestOnTetrahedron(glm::vec3 * simplex, int & count, glm::vec3 & closest){
+	static const int faces[4][4] = { { 0, 1, 2, 3 }, { 0, 2, 3, 1 }, { 0, 3, 1, 2 }, { 1, 3, 2, 0 } };
+	float bestDistance = -1.0f;
+	glm::vec3 best[3];
+	int bestCount = 0;
+	for (const int * face : faces){
+		glm::vec3 a = simplex[face[0]], b = simplex[face[1]], c = simplex[face[2]];
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float originSide = glm::dot(-a, normal);
+		float oppositeSide = glm::dot(simplex[face[3]] - a, normal);
+		if (originSide * oppositeSide > 0.0f || (oppositeSide != 0.0f && originSide == 0.0f))
+			continue;
+
+		glm::vec3 feature[3] = { a, b, c };
+		int featureCount;
+		glm::vec3 point = closestOnTriangle(feature, featureCount);
+		float distance = glm::dot(point, point);
+		if (bestDistance < 0.0f || distance < bestDistance){
+			bestDistance = distance;
+			closest = point;
+			std::copy(feature, feature + featureCount, best);
+			bestCount = featureCount;
+		}
+	}
+	if (bestDistance < 0.0f)
+		return false;
+	std::copy(best, best + bestCount, simplex);
+	count = bestCount;
+	return true;
+}
+
+bool convexHullsIntersect(const ConvexHull & a, const glm::mat4 & worldA, const ConvexHull & b, const glm::mat4 & worldB){
+	// Searching the Minkowski difference A - B for the origin, starting from the direction
+	// between the two boxes
+	glm::vec3 centerA = glm::vec3(worldA * glm::vec4((a.boundsMin + a.boundsMax) * 0.5f, 1.0f));
+	glm::vec3 centerB = glm::vec3(worldB * glm::vec4((b.boundsMin + b.boundsMax) * 0.5f, 1.0f));
+	glm::vec3 direction = centerA - centerB;
+	if (glm::dot(direction, direction) < 1e-12f)
+		direction = glm::vec3(1.0f, 0.0f, 0.0f);
+
+	glm::vec3 simplex[4];
+	simplex[0] = support(a, worldA, direction) - support(b, worldB, -direction);
+	int count = 1;
+	glm::vec3 closest = simplex[0];
+	for (int iteration = 0; iteration < MaxGjkIterations; iteration++){
+		float distance2 = glm::dot(closest, closest);
+		if (distance2 < 1e-12f)
+			return true; // the origin is on the simplex
+		glm::vec3 point = support(a, worldA, -closest) - support(b, worldB, closest);
+		if (glm::dot(point, closest) > 0.0f)
+			return false; // nothing of A - B gets past the origin : a separating plane
+		simplex[count++] = point;
+
+		if (count == 2)
+			closest = closestOnSegment(simplex, count);
+		else if (count == 3)
+			closest = closestOnTriangle(simplex, count);
+		else if (!closestOnTetrahedron(simplex, count, closest))
+			return true;
+	}
+	return true;
+}
+
+// Box around the placed box of the hull (Arvo's method)
+static void worldBounds(const ConvexHull & hull, const glm::mat4 & world, glm::vec3 & boundsMin, glm::vec3 & boundsMax){
+	glm::vec3 center = (hull.boundsMin + hull.boundsMax) * 0.5f;
+	glm::vec3 extent = (hull.boundsMax - hull.boundsMin) * 0.5f;
+	glm::vec3 worldCenter = glm::vec3(world * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent;
+	for (int i = 0; i < 3; i++)
+		worldExtent[i] = fabsf(world[0][i]) * extent.x + fabsf(world[1][i]) * extent.y + fabsf(world[2][i]) * extent.z;
+	boundsMin = worldCenter - worldExtent;
+	boundsMax = worldCenter + worldExtent;
+}
+
+// Splits the links at the median of their box centers along the longest axis. Parents come
+// before their children in the node array, so refitting can walk it backwards.
+static int buildBvh(CollisionRig & rig, int * links, int count, const glm::vec3 * centers){
+	int index = (int)rig.bvh.size();
+	rig.bvh.push_back(CollisionRig::BvhNode());
+	if (count == 1){
+		rig.bvh[index].left = rig.bvh[index].right = -1;
+		rig.bvh[index].link = links[0];
+		return index;
+	}
+
+	glm::vec3 centersMin = centers[links[0]], centersMax = centers[links[0]];
+	for (int i = 1; i < count; i++){
+		centersMin = glm::min(centersMin, centers[links[i]]);
+		centersMax = glm::max(centersMax, centers[links[i]]);
+	}
+	glm::vec3 size = centersMax - centersMin;
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+	std::sort(links, links + count, [&](int l, int r){ return centers[l][axis] < centers[r][axis]; });
+
+	int half = count / 2;
+	int left = buildBvh(rig, links, half, centers);
+	int right = buildBvh(rig, links + half, count - half, centers);
+	rig.bvh[index].left = left;
+	rig.bvh[index].right = right;
+	rig.bvh[index].link = -1;
+	return index;
+}
+
+void initCollisionRig(CollisionRig & rig, const ConvexHull * const * hulls, const int * parents, int linkCount,
+	const glm::mat4 * restWorlds, float groundHeight){
+	rig.linkCount = std::min(linkCount, MaxCollisionLinks);
+	rig.hulls.assign(hulls, hulls + rig.linkCount);
+	rig.groundHeight = groundHeight;
+
+	rig.pairIgnored.assign(rig.linkCount * rig.linkCount, 1);
+	rig.groundIgnored.assign(rig.linkCount, 1);
+	for (int i = 0; i < rig.linkCount; i++){
+		if (!rig.hulls[i])
+			continue;
+		rig.groundIgnored[i] = convexHullBottom(*rig.hulls[i], restWorlds[i]) <= groundHeight + GroundTolerance;
+		for (int j = i + 1; j < rig.linkCount; j++){
+			if (!rig.hulls[j] || parents[i] == j || parents[j] == i)
+				continue;
+			bool touching = convexHullsIntersect(*rig.hulls[i], restWorlds[i], *rig.hulls[j], restWorlds[j]);
+			rig.pairIgnored[i * rig.linkCount + j] = rig.pairIgnored[j * rig.linkCount + i] = touching;
+		}
+	}
+
+	std::vector<int> links;
+	std::vector<glm::vec3> centers(rig.linkCount);
+	for (int i = 0; i < rig.linkCount; i++){
+		if (!rig.hulls[i])
+			continue;
+		links.push_back(i);
+		glm::vec3 boundsMin, boundsMax;
+		worldBounds(*rig.hulls[i], restWorlds[i], boundsMin, boundsMax);
+		centers[i] = (boundsMin + boundsMax) * 0.5f;
+	}
+	rig.bvh.clear();
+	if (!links.empty())
+		buildBvh(rig, &links[0], (int)links.size(), &centers[0]);
+}
+
+static bool boxesOverlap(const glm::vec3 & minA, const glm::vec3 & maxA, const glm::vec3 & minB, const glm::vec3 & maxB){
+	return minA.x <= maxB.x && minB.x <= maxA.x && minA.y <= maxB.y && minB.y <= maxA.y && minA.z <= maxB.z && minB.z <= maxA.z;
+}
+
+bool findSelfCollision(const CollisionRig & rig, const glm::mat4 * worlds, int * linkA, int * linkB){
+	if (rig.bvh.empty())
+		return false;
+
+	// Refit, children first, testing the ground on the way
+	glm::vec3 boundsMin[2 * MaxCollisionLinks], boundsMax[2 * MaxCollisionLinks];
+	for (int n = (int)rig.bvh.size() - 1; n >= 0; n--){
+		const CollisionRig::BvhNode & node = rig.bvh[n];
+		if (node.link < 0){
+			boundsMin[n] = glm::min(boundsMin[node.left], boundsMin[node.right]);
+			boundsMax[n] = glm::max(boundsMax[node.left], boundsMax[node.right]);
+			continue;
+		}
+		const ConvexHull & hull = *rig.hulls[node.link];
+		worldBounds(hull, worlds[node.link], boundsMin[n], boundsMax[n]);
+		if (!rig.groundIgnored[node.link] && boundsMin[n].y < rig.groundHeight &&
+			convexHullBottom(hull, worlds[node.link]) < rig.groundHeight){
+			if (linkA) *linkA = node.link;
+			if (linkB) *linkB = -1;
+			return true;
+		}
+	}
+
+	// Every pair of leaves under the root, through the pairs of nodes whose boxes overlap.
+	// Each step pops one pair and pushes at most three, one level down.
+	struct NodePair { int a, b; };
+	NodePair stack[8 * MaxCollisionLinks];
+	int stackSize = 0;
+	stack[stackSize++] = { 0, 0 };
+	while (stackSize > 0){
+		NodePair pair = stack[--stackSize];
+		const CollisionRig::BvhNode & a = rig.bvh[pair.a];
+		const CollisionRig::BvhNode & b = rig.bvh[pair.b];
+		if (pair.a == pair.b){
+			if (a.link < 0){
+				stack[stackSize++] = { a.left, a.left };
+				stack[stackSize++] = { a.right, a.right };
+				stack[stackSize++] = { a.left, a.right };
+			}
+			continue;
+		}
+		if (!boxesOverlap(boundsMin[pair.a], boundsMax[pair.a], boundsMin[pair.b], boundsMax[pair.b]))
+			continue;
+
+		if (a.link >= 0 && b.link >= 0){
+			if (rig.pairIgnored[a.link * rig.linkCount + b.link])
+				continue;
+			if (convexHullsIntersect(*rig.hulls[a.link], worlds[a.link], *rig.hulls[b.link], worlds[b.link])){
+				if (linkA) *linkA = std::min(a.link, b.link);
+				if (linkB) *linkB = std::max(a.link, b.link);
+				return true;
+			}
+			continue;
+		}
+
+		// Descend into the inner node, or into the larger of two
+		glm::vec3 sizeA = boundsMax[pair.a] - boundsMin[pair.a];
+		glm::vec3 sizeB = boundsMax[pair.b] - boundsMin[pair.b];
+		bool descendA = b.link >= 0 || (a.link < 0 && sizeA.x * sizeA.y * sizeA.z > sizeB.x * sizeB.y * sizeB.z);
+		if (descendA){
+			stack[stackSize++] = { a.left, pair.b };
+			stack[stackSize++] = { a.right, pair.b };
+		}else{
+			stack[stackSize++] = { pair.a, b.left };
+			stack[stackSize++] = { pair.a, b.right };
+		}
+	}
+	return false;
+}
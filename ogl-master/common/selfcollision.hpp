@@ -0,0 +1,54 @@
+#ifndef SELFCOLLISION_HPP
+#define SELFCOLLISION_HPP
+
+// Self-collision of a rig's links, for the keyboard, inverse kinematics and motion planners :
+// each mesh is approximated by its convex hull (Bullet's btConvexHullComputer), pairs of
+// links are tested with GJK, and a small bounding volume hierarchy over the links culls the
+// pairs whose boxes don't overlap. The hierarchy's shape is chosen once, at rest ; each
+// query only refits its boxes to the pose. No OpenGL involved.
+//
+// Hulls cover concave meshes too, so an L shaped link collides a little early.
+
+struct ConvexHull {
+	std::vector<glm::vec3> vertices;
+	glm::vec3 boundsMin, boundsMax;  // box around the vertices, in mesh space
+};
+
+// From any number of points, duplicates included, such as loadOBJ's output. Returns false
+// when they are all in one plane.
+bool buildConvexHull(const std::vector<glm::vec3> & points, ConvexHull & hull);
+
+// GJK on the two hulls placed by any affine transforms. Touching counts as intersecting.
+bool convexHullsIntersect(const ConvexHull & a, const glm::mat4 & worldA, const ConvexHull & b, const glm::mat4 & worldB);
+
+// Lowest point of the placed hull
+float convexHullBottom(const ConvexHull & hull, const glm::mat4 & world);
+
+// Links past these aren't checked
+const int MaxCollisionLinks = 32;
+
+struct CollisionRig {
+	int linkCount;
+	std::vector<const ConvexHull *> hulls;    // per link, NULL for links without a mesh
+	std::vector<unsigned char> pairIgnored;   // linkCount * linkCount
+	std::vector<unsigned char> groundIgnored; // per link
+	float groundHeight;
+
+	// Bounding volume hierarchy : node 0 is the root, leaves hold one link each
+	struct BvhNode {
+		int left, right;  // children, -1 for leaves
+		int link;         // leaves only
+	};
+	std::vector<BvhNode> bvh;
+};
+
+// Links are the nodes of one rig, in any order, placed by restWorlds. A link and its parent
+// always touch, so they are never tested ; nor are the pairs already touching at rest, nor
+// the links already on the ground, below groundHeight.
+void initCollisionRig(CollisionRig & rig, const ConvexHull * const * hulls, const int * parents, int linkCount,
+	const glm::mat4 * restWorlds, float groundHeight);
+
+// First collision of the pose found, if any, in linkA and linkB (-1 for the ground)
+bool findSelfCollision(const CollisionRig & rig, const glm::mat4 * worlds, int * linkA = NULL, int * linkB = NULL);
+
+#endif
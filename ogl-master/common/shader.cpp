@@ -10,11 +10,32 @@ using namespace std;
 #include <stdlib.h>
 #include <string.h>
 
+#include <map>
+#include <set>
+
 #include <GL/glew.h>
 
+#include <GLFW/glfw3.h>
+
 #include "shader.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+// Programs CheckShadersAsync() deleted after a failed link, until GL hands out their name again
+static std::set<GLuint> FailedPrograms;
+
+// Inserts the permutation defines after the #version directive, which must stay first
+static void InjectDefines(std::string & code, const char * defines){
+	if (defines == NULL || defines[0] == '\0')
+		return;
+	size_t pos = 0;
+	size_t version = code.find("#version");
+	if (version != std::string::npos){
+		pos = code.find('\n', version);
+		pos = (pos == std::string::npos) ? code.size() : pos + 1;
+	}
+	code.insert(pos, defines);
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char * defines){
 
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
@@ -44,6 +65,9 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		FragmentShaderStream.close();
 	}
 
+	InjectDefines(VertexShaderCode, defines);
+	InjectDefines(FragmentShaderCode, defines);
+
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
@@ -85,6 +109,7 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	// Link the program
 	printf("Linking program\n");
 	GLuint ProgramID = glCreateProgram();
+	FailedPrograms.erase(ProgramID);
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
 	glLinkProgram(ProgramID);
@@ -109,3 +134,176 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 }
 
 
+
+// Same as GL_COMPLETION_STATUS_ARB ; the KHR version is not in our GLEW yet
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRY * PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) (GLuint count);
+
+struct PendingProgram {
+	GLuint VertexShaderID;
+	GLuint FragmentShaderID;
+	std::string vertex_file_path;
+	std::string fragment_file_path;
+};
+
+static std::map<GLuint, PendingProgram> PendingPrograms;
+static bool ParallelCompileChecked = false;
+static bool ParallelCompileSupported = false;
+
+static void EnableParallelShaderCompile(){
+	ParallelCompileChecked = true;
+	if (GLEW_ARB_parallel_shader_compile){
+		// 0xFFFFFFFF lets the driver pick the number of threads
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		ParallelCompileSupported = true;
+	}else if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")){
+		PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR =
+			(PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+		if (glMaxShaderCompilerThreadsKHR)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		ParallelCompileSupported = true;
+	}
+	printf("Parallel shader compilation %s\n", ParallelCompileSupported ? "enabled" : "not supported, compiling synchronously");
+}
+
+static bool ReadShaderFile(const char * file_path, std::string & code){
+	std::ifstream stream(file_path, std::ios::in);
+	if (!stream.is_open()){
+		printf("Impossible to open %s\n", file_path);
+		return false;
+	}
+	std::stringstream sstr;
+	sstr << stream.rdbuf();
+	code = sstr.str();
+	return true;
+}
+
+static void PrintShaderLog(GLuint ShaderID, const std::string & file_path){
+	int InfoLogLength;
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		printf("%s :\n%s\n", file_path.c_str(), &ShaderErrorMessage[0]);
+	}
+}
+
+GLuint LoadShadersAsync(const char * vertex_file_path,const char * fragment_file_path, const char * defines){
+
+	if (!ParallelCompileChecked)
+		EnableParallelShaderCompile();
+
+	std::string VertexShaderCode, FragmentShaderCode;
+	if (!ReadShaderFile(vertex_file_path, VertexShaderCode) || !ReadShaderFile(fragment_file_path, FragmentShaderCode))
+		return 0;
+	InjectDefines(VertexShaderCode, defines);
+	InjectDefines(FragmentShaderCode, defines);
+
+	PendingProgram pending;
+	pending.vertex_file_path = vertex_file_path;
+	pending.fragment_file_path = fragment_file_path;
+
+	// Kick off both compiles and the link without querying any status in between :
+	// any status query would make the driver wait for the compile to finish.
+	pending.VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	char const * VertexSourcePointer = VertexShaderCode.c_str();
+	glShaderSource(pending.VertexShaderID, 1, &VertexSourcePointer , NULL);
+	glCompileShader(pending.VertexShaderID);
+
+	pending.FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
+	glShaderSource(pending.FragmentShaderID, 1, &FragmentSourcePointer , NULL);
+	glCompileShader(pending.FragmentShaderID);
+
+	GLuint ProgramID = glCreateProgram();
+	FailedPrograms.erase(ProgramID);
+	glAttachShader(ProgramID, pending.VertexShaderID);
+	glAttachShader(ProgramID, pending.FragmentShaderID);
+	glLinkProgram(ProgramID);
+
+	PendingPrograms[ProgramID] = pending;
+	return ProgramID;
+}
+
+int CheckShadersAsync(GLuint ProgramID){
+
+	std::map<GLuint, PendingProgram>::iterator it = PendingPrograms.find(ProgramID);
+	if (it == PendingPrograms.end()) // Not pending : already checked
+		return ProgramID != 0 && FailedPrograms.count(ProgramID) == 0 ? 1 : -1;
+
+	GLint Result = GL_FALSE;
+	if (ParallelCompileSupported){
+		glGetProgramiv(ProgramID, GL_COMPLETION_STATUS_KHR, &Result);
+		if (Result == GL_FALSE)
+			return 0;
+	}
+
+	PendingProgram & pending = it->second;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	bool linked = (Result == GL_TRUE);
+	if (!linked){
+		printf("Shader program %s / %s failed to build, keeping the previous one\n",
+			pending.vertex_file_path.c_str(), pending.fragment_file_path.c_str());
+		PrintShaderLog(pending.VertexShaderID, pending.vertex_file_path);
+		PrintShaderLog(pending.FragmentShaderID, pending.fragment_file_path);
+
+		int InfoLogLength;
+		glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		if ( InfoLogLength > 0 ){
+			std::vector<char> ProgramErrorMessage(InfoLogLength+1);
+			glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+			printf("%s\n", &ProgramErrorMessage[0]);
+		}
+	}
+
+	glDetachShader(ProgramID, pending.VertexShaderID);
+	glDetachShader(ProgramID, pending.FragmentShaderID);
+	glDeleteShader(pending.VertexShaderID);
+	glDeleteShader(pending.FragmentShaderID);
+	PendingPrograms.erase(it);
+
+	if (!linked){
+		glDeleteProgram(ProgramID);
+		FailedPrograms.insert(ProgramID);
+		return -1;
+	}
+	return 1;
+}
+
+
+
+static std::map<std::string, GLuint> ShaderPermutations;
+
+static std::string PermutationKey(const char * vertex_file_path,const char * fragment_file_path, const char * defines){
+	std::string key(vertex_file_path);
+	key += '|';
+	key += fragment_file_path;
+	key += '|';
+	if (defines != NULL)
+		key += defines;
+	return key;
+}
+
+GLuint GetShaderPermutation(const char * vertex_file_path,const char * fragment_file_path, const char * defines){
+	std::string key = PermutationKey(vertex_file_path, fragment_file_path, defines);
+	std::map<std::string, GLuint>::iterator it = ShaderPermutations.find(key);
+	if (it != ShaderPermutations.end())
+		return it->second;
+
+	GLuint ProgramID = LoadShaders(vertex_file_path, fragment_file_path, defines);
+	ShaderPermutations[key] = ProgramID;
+	return ProgramID;
+}
+
+void ReplaceShaderPermutation(const char * vertex_file_path,const char * fragment_file_path, const char * defines, GLuint ProgramID){
+	GLuint & cached = ShaderPermutations[PermutationKey(vertex_file_path, fragment_file_path, defines)];
+	if (cached != 0 && cached != ProgramID)
+		glDeleteProgram(cached);
+	cached = ProgramID;
+}
+
+void DeleteShaderPermutations(){
+	for (std::map<std::string, GLuint>::iterator it = ShaderPermutations.begin(); it != ShaderPermutations.end(); ++it)
+		glDeleteProgram(it->second);
+	ShaderPermutations.clear();
+}
@@ -1,6 +1,29 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
+// defines, if given, is inserted right after the #version line of both shaders,
+// e.g. "#define USE_LIGHTING\n#define NUM_LIGHTS 2\n"
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char * defines = NULL);
+
+// Same as LoadShaders, but does not wait for the driver : with KHR/ARB_parallel_shader_compile
+// the compilation and linking happen on driver threads. Never blocks, even if a file is missing.
+// Returns the program ID to pass to CheckShadersAsync(), or 0 if a source file could not be read.
+GLuint LoadShadersAsync(const char * vertex_file_path,const char * fragment_file_path, const char * defines = NULL);
+
+// Returns 1 once the program is linked and usable, 0 while it is still compiling,
+// and -1 if compiling or linking failed. On failure the log is printed and the program deleted ;
+// later calls with the same ID keep returning -1.
+int CheckShadersAsync(GLuint ProgramID);
+
+// Returns the program specialized with the given defines. Each permutation is compiled
+// the first time it is asked for, and the same program is returned afterwards.
+GLuint GetShaderPermutation(const char * vertex_file_path,const char * fragment_file_path, const char * defines);
+
+// Puts an already linked program (e.g. from a hot-reload) in place of a cached permutation,
+// deleting the one it replaces.
+void ReplaceShaderPermutation(const char * vertex_file_path,const char * fragment_file_path, const char * defines, GLuint ProgramID);
+
+// Deletes every cached permutation program
+void DeleteShaderPermutations();
 
 #endif
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <vector>
 #include <cstring>
 
@@ -12,109 +13,188 @@ using namespace glm;
 
 #include "text2D.hpp"
 
+// One instance per glyph, interleaved : the vertex shader expands it to a quad
+struct Glyph {
+	float x, y, size;
+	unsigned int character;
+};
+
+// Glyphs of a frame live in one of FrameRegions slices of the buffer, so the CPU
+// can fill a slice while the GPU still reads the ones of the previous frames.
+static const unsigned int MaxGlyphsPerFrame = 16384;
+static const unsigned int FrameRegions = 3;
+
 unsigned int Text2DTextureID;
-unsigned int Text2DVertexBufferID;
-unsigned int Text2DUVBufferID;
+unsigned int Text2DVertexArrayID;
+unsigned int Text2DInstanceBufferID;
 unsigned int Text2DShaderID;
 unsigned int Text2DUniformID;
+unsigned int Text2DScreenSizeID;
+
+static Glyph * Text2DMappedGlyphs = NULL;    // persistent mapping of the whole buffer, if supported
+static std::vector<Glyph> Text2DClientGlyphs; // otherwise, uploaded once per frame
+static GLsync Text2DRegionFences[FrameRegions];
+static unsigned int Text2DRegion = 0;
+static unsigned int Text2DGlyphCount = 0;
+static bool Text2DRegionReady = false;
+static bool Text2DOverflowReported = false;
 
 void initText2D(const char * texturePath){
 
 	// Initialize texture
-	Text2DTextureID = loadDDS(texturePath);
+	initText2D(loadTexture(texturePath));
+}
+
+void initText2D(unsigned int textureID){
 
-	// Initialize VBO
-	glGenBuffers(1, &Text2DVertexBufferID);
-	glGenBuffers(1, &Text2DUVBufferID);
+	Text2DTextureID = textureID;
+
+	// Initialize VAO and the instance buffer
+	glGenVertexArrays(1, &Text2DVertexArrayID);
+	glBindVertexArray(Text2DVertexArrayID);
+	glGenBuffers(1, &Text2DInstanceBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, Text2DInstanceBufferID);
+
+	GLsizeiptr bufferSize = sizeof(Glyph) * MaxGlyphsPerFrame * FrameRegions;
+	if (GLEW_ARB_buffer_storage){
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, bufferSize, NULL, flags);
+		Text2DMappedGlyphs = (Glyph*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bufferSize, flags);
+	}else{
+		glBufferData(GL_ARRAY_BUFFER, bufferSize, NULL, GL_STREAM_DRAW);
+		Text2DClientGlyphs.reserve(MaxGlyphsPerFrame);
+	}
+	memset(Text2DRegionFences, 0, sizeof(Text2DRegionFences));
+
+	// 1rst attribute : x, y and size of the glyph ; 2nd attribute : the character.
+	// Both advance once per instance, see pointAttributesAt() for their offsets.
+	glEnableVertexAttribArray(0);
+	glVertexAttribDivisor(0, 1);
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+
+	glBindVertexArray(0);
 
 	// Initialize Shader
 	Text2DShaderID = LoadShaders( "TextVertexShader.vertexshader", "TextVertexShader.fragmentshader" );
 
 	// Initialize uniforms' IDs
 	Text2DUniformID = glGetUniformLocation( Text2DShaderID, "myTextureSampler" );
+	Text2DScreenSizeID = glGetUniformLocation( Text2DShaderID, "screenSize" );
+
+}
 
+// Waits for the GPU to be done with the region this frame writes to. With 3 regions
+// this is two frames old and normally finished already.
+static void beginRegion(){
+	GLsync & fence = Text2DRegionFences[Text2DRegion];
+	if (Text2DMappedGlyphs != NULL && fence != 0){
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		glDeleteSync(fence);
+		fence = 0;
+	}
+	Text2DClientGlyphs.clear();
+	Text2DRegionReady = true;
 }
 
 void printText2D(const char * text, int x, int y, int size){
 
+	if (!Text2DRegionReady)
+		beginRegion();
+
 	unsigned int length = strlen(text);
+	if (Text2DGlyphCount + length > MaxGlyphsPerFrame){
+		if (!Text2DOverflowReported)
+			printf("printText2D : more than %u glyphs in a frame, dropping the rest\n", MaxGlyphsPerFrame);
+		Text2DOverflowReported = true;
+		length = MaxGlyphsPerFrame - Text2DGlyphCount;
+	}
 
-	// Fill buffers
-	std::vector<glm::vec2> vertices;
-	std::vector<glm::vec2> UVs;
+	Glyph * glyphs = Text2DMappedGlyphs != NULL ? Text2DMappedGlyphs + Text2DRegion * MaxGlyphsPerFrame : NULL;
 	for ( unsigned int i=0 ; i<length ; i++ ){
-		
-		glm::vec2 vertex_up_left    = glm::vec2( x+i*size     , y+size );
-		glm::vec2 vertex_up_right   = glm::vec2( x+i*size+size, y+size );
-		glm::vec2 vertex_down_right = glm::vec2( x+i*size+size, y      );
-		glm::vec2 vertex_down_left  = glm::vec2( x+i*size     , y      );
-
-		vertices.push_back(vertex_up_left   );
-		vertices.push_back(vertex_down_left );
-		vertices.push_back(vertex_up_right  );
-
-		vertices.push_back(vertex_down_right);
-		vertices.push_back(vertex_up_right);
-		vertices.push_back(vertex_down_left);
-
-		char character = text[i];
-		float uv_x = (character%16)/16.0f;
-		float uv_y = (character/16)/16.0f;
-
-		glm::vec2 uv_up_left    = glm::vec2( uv_x           , uv_y );
-		glm::vec2 uv_up_right   = glm::vec2( uv_x+1.0f/16.0f, uv_y );
-		glm::vec2 uv_down_right = glm::vec2( uv_x+1.0f/16.0f, (uv_y + 1.0f/16.0f) );
-		glm::vec2 uv_down_left  = glm::vec2( uv_x           , (uv_y + 1.0f/16.0f) );
-		UVs.push_back(uv_up_left   );
-		UVs.push_back(uv_down_left );
-		UVs.push_back(uv_up_right  );
-
-		UVs.push_back(uv_down_right);
-		UVs.push_back(uv_up_right);
-		UVs.push_back(uv_down_left);
+		Glyph glyph = { (float)(x + i*size), (float)y, (float)size, (unsigned char)text[i] };
+		if (glyphs != NULL)
+			glyphs[Text2DGlyphCount + i] = glyph;
+		else
+			Text2DClientGlyphs.push_back(glyph);
+	}
+	Text2DGlyphCount += length;
+}
+
+// Points the instance attributes at the glyphs of a region. Cheaper and more portable
+// than a base instance (GL 4.2) for starting the draw in the middle of the buffer.
+static void pointAttributesAt(GLuint firstGlyph){
+	size_t offset = sizeof(Glyph) * firstGlyph;
+	glBindBuffer(GL_ARRAY_BUFFER, Text2DInstanceBufferID);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Glyph), (void*)offset);
+	glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(Glyph), (void*)(offset + 3 * sizeof(float)));
+}
+
+void drawText2D(){
+
+	if (Text2DGlyphCount == 0)
+		return;
+
+	GLuint firstGlyph = 0;
+	if (Text2DMappedGlyphs != NULL){
+		firstGlyph = Text2DRegion * MaxGlyphsPerFrame;
+	}else{
+		// Orphan the buffer so the driver doesn't wait for the previous frame's draw
+		glBindBuffer(GL_ARRAY_BUFFER, Text2DInstanceBufferID);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Glyph) * MaxGlyphsPerFrame * FrameRegions, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Glyph) * Text2DGlyphCount, &Text2DClientGlyphs[0]);
 	}
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), &vertices[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-	glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs[0], GL_STATIC_DRAW);
 
 	// Bind shader
 	glUseProgram(Text2DShaderID);
 
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glUniform2f(Text2DScreenSizeID, (float)viewport[2], (float)viewport[3]);
+
 	// Bind texture
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, Text2DTextureID);
 	// Set our "myTextureSampler" sampler to use Texture Unit 0
 	glUniform1i(Text2DUniformID, 0);
 
-	// 1rst attribute buffer : vertices
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
-
-	// 2nd attribute buffer : UVs
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
-
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// Draw call
-	glDrawArrays(GL_TRIANGLES, 0, vertices.size() );
+	// One draw call for the whole frame : 4 vertices per glyph, one instance per glyph
+	glBindVertexArray(Text2DVertexArrayID);
+	pointAttributesAt(firstGlyph);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, Text2DGlyphCount);
+	glBindVertexArray(0);
 
 	glDisable(GL_BLEND);
 
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
-
+	if (Text2DMappedGlyphs != NULL){
+		Text2DRegionFences[Text2DRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		Text2DRegion = (Text2DRegion + 1) % FrameRegions;
+	}
+	Text2DGlyphCount = 0;
+	Text2DRegionReady = false;
 }
 
 void cleanupText2D(){
 
+	for (unsigned int i = 0; i < FrameRegions; i++){
+		if (Text2DRegionFences[i] != 0)
+			glDeleteSync(Text2DRegionFences[i]);
+		Text2DRegionFences[i] = 0;
+	}
+
 	// Delete buffers
-	glDeleteBuffers(1, &Text2DVertexBufferID);
-	glDeleteBuffers(1, &Text2DUVBufferID);
+	if (Text2DMappedGlyphs != NULL){
+		glBindBuffer(GL_ARRAY_BUFFER, Text2DInstanceBufferID);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		Text2DMappedGlyphs = NULL;
+	}
+	glDeleteBuffers(1, &Text2DInstanceBufferID);
+	glDeleteVertexArrays(1, &Text2DVertexArrayID);
 
 	// Delete texture
 	glDeleteTextures(1, &Text2DTextureID);
@@ -2,7 +2,17 @@
 #define TEXT2D_HPP
 
 void initText2D(const char * texturePath);
+
+// Same, with a texture the caller loads, e.g. with streamTexture()
+void initText2D(unsigned int textureID);
+
+// Queues a string for this frame, in pixels from the bottom left corner of the viewport.
+// Nothing is drawn until drawText2D().
 void printText2D(const char * text, int x, int y, int size);
+
+// Draws every string queued since the last call, as instanced quads in a single draw call
+void drawText2D();
+
 void cleanupText2D();
 
-#endif
\ No newline at end of file
+#endif
@@ -1,11 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <vector>
 
 #include <GL/glew.h>
 
 #include <GLFW/glfw3.h>
 
+#include "image.hpp"
+
 
 GLuint loadBMP_custom(const char * imagepath){
 
@@ -150,21 +154,31 @@ GLuint loadDDS(const char * imagepath){
 
 	unsigned int height      = *(unsigned int*)&(header[8 ]);
 	unsigned int width	     = *(unsigned int*)&(header[12]);
-	unsigned int linearSize	 = *(unsigned int*)&(header[16]);
 	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
 	unsigned int fourCC      = *(unsigned int*)&(header[80]);
 
- 
-	unsigned char * buffer;
-	unsigned int bufsize;
+	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
+	unsigned int blockSize = (fourCC == FOURCC_DXT1) ? 8 : 16; 
+
 	/* how big is it going to be including all mipmaps? */ 
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize; 
+	unsigned char * buffer;
+	unsigned int bufsize = 0;
+	for (unsigned int level = 0, w = width, h = height; level < mipMapCount && (w || h); ++level) 
+	{ 
+		bufsize += ((w+3)/4)*((h+3)/4)*blockSize; 
+		w = w > 1 ? w / 2 : 1; 
+		h = h > 1 ? h / 2 : 1; 
+	} 
 	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char)); 
-	fread(buffer, 1, bufsize, fp); 
+	if (fread(buffer, 1, bufsize, fp) != bufsize) { 
+		printf("%s is truncated\n", imagepath); 
+		free(buffer); 
+		fclose(fp); 
+		return 0; 
+	} 
 	/* close the file pointer */ 
 	fclose(fp);
 
-	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
 	unsigned int format;
 	switch(fourCC) 
 	{ 
@@ -190,7 +204,6 @@ GLuint loadDDS(const char * imagepath){
 	glBindTexture(GL_TEXTURE_2D, textureID);
 	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
 	
-	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16; 
 	unsigned int offset = 0;
 
 	/* load the mipmaps */ 
@@ -215,4 +228,49 @@ GLuint loadDDS(const char * imagepath){
 	return textureID;
 
 
-}
\ No newline at end of file
+}
+
+
+
+GLuint loadTexture(const char * imagepath){
+
+	// Already compressed, with its mip chain : uploaded as it is
+	size_t length = strlen(imagepath);
+	if (length > 4 && (strcmp(imagepath + length - 4, ".DDS") == 0 || strcmp(imagepath + length - 4, ".dds") == 0))
+		return loadDDS(imagepath);
+
+	MipChain chain;
+	std::string cachepath = std::string(imagepath) + ".mips";
+	if (loadMipChain(cachepath.c_str(), imagepath, chain)){
+		printf("Reading image %s (cached mip chain)\n", imagepath);
+	}else{
+		printf("Reading image %s\n", imagepath);
+		int width, height;
+		unsigned char * pixels = loadImageRGBA(imagepath, width, height);
+		if (pixels == NULL)
+			return 0;
+		buildMipChain(pixels, width, height, chain);
+		freeImage(pixels);
+		saveMipChain(cachepath.c_str(), imagepath, chain);
+	}
+
+	// Create one OpenGL texture
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	// Every level comes from the CPU, no glGenerateMipmap
+	for (size_t level = 0; level < chain.levels.size(); level++){
+		const MipChainLevel & mip = chain.levels[level];
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &chain.pixels[mip.offset]);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, chain.levels.size() - 1);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+	return textureID;
+}
@@ -12,5 +12,10 @@ GLuint loadBMP_custom(const char * imagepath);
 // Load a .DDS file using GLFW's own loader
 GLuint loadDDS(const char * imagepath);
 
+// Load a .PNG, .JPG, .TGA, .BMP (or anything else stb_image reads) with a CPU-built mip chain.
+// The chain is cached next to the image in <imagepath>.mips and rebuilt when the image changes.
+// .DDS files go to loadDDS().
+GLuint loadTexture(const char * imagepath);
+
 
 #endif
\ No newline at end of file
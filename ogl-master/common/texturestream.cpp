@@ -0,0 +1,474 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <GL/glew.h>
+
+#include <GLFW/glfw3.h>
+
+#include "texturestream.hpp"
+
+#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
+#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
+#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+
+// Size of the persistently mapped staging ring. Textures that don't fit go through client memory.
+static const size_t StagingBufferSize = 32 * 1024 * 1024;
+
+struct MipLevel {
+	unsigned int width, height;
+	size_t offset, size; // relative to the start of the texture's texel data
+};
+
+struct TextureJob {
+	std::string path;
+	GLuint textureID;
+	bool failed;
+
+	// Filled in by the worker
+	bool compressed;
+	GLenum format;
+	std::vector<MipLevel> levels;
+	size_t dataSize;
+	size_t stagingOffset;     // in the staging ring, if inRing
+	bool inRing;
+	unsigned char * heapData; // otherwise
+	unsigned int nextLevel;   // first level not uploaded yet
+
+	double queuedTime, readTime, uploadTime;
+};
+
+struct StagingRange {
+	size_t offset, size;
+};
+
+static std::thread worker;
+static std::mutex streamMutex;
+static std::condition_variable workerWakeup;
+static bool stopWorker = false;
+
+static std::deque<TextureJob*> requestQueue; // waiting for the worker
+static std::deque<TextureJob*> readyQueue;   // read, waiting for uploads
+static size_t jobsInFlight = 0;
+
+// Staging ring, shared between the worker (allocates) and the render thread (releases)
+static GLuint stagingBufferID = 0;
+static unsigned char * stagingMemory = NULL;
+static size_t stagingHead = 0;
+static std::deque<StagingRange> stagingRanges; // allocation order == upload order
+
+struct PendingRelease {
+	GLsync fence;
+	size_t rangeCount;
+};
+static std::deque<PendingRelease> pendingReleases;
+
+static TextureStreamStats streamStats = {}; // render thread only
+
+// Compute the exact size of every mip level instead of guessing from the header
+static bool parseDDS(FILE * fp, TextureJob * job){
+	char filecode[4];
+	unsigned char header[124];
+	if (fread(filecode, 1, 4, fp) != 4 || strncmp(filecode, "DDS ", 4) != 0){
+		printf("%s is not a DDS file\n", job->path.c_str());
+		return false;
+	}
+	if (fread(header, 1, 124, fp) != 124){
+		printf("%s : truncated DDS header\n", job->path.c_str());
+		return false;
+	}
+
+	unsigned int height      = *(unsigned int*)&(header[8 ]);
+	unsigned int width       = *(unsigned int*)&(header[12]);
+	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
+	unsigned int fourCC      = *(unsigned int*)&(header[80]);
+
+	switch(fourCC){
+	case FOURCC_DXT1: job->format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+	case FOURCC_DXT3: job->format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; break;
+	case FOURCC_DXT5: job->format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+	default:
+		printf("%s : unsupported DDS format\n", job->path.c_str());
+		return false;
+	}
+	if (width == 0 || height == 0){
+		printf("%s : empty DDS image\n", job->path.c_str());
+		return false;
+	}
+	if (mipMapCount == 0)
+		mipMapCount = 1;
+
+	unsigned int blockSize = (job->format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
+	job->compressed = true;
+	job->dataSize = 0;
+	for (unsigned int level = 0; level < mipMapCount; ++level){
+		MipLevel mip;
+		mip.width = width;
+		mip.height = height;
+		mip.offset = job->dataSize;
+		mip.size = ((width+3)/4)*((height+3)/4)*blockSize;
+		job->levels.push_back(mip);
+		job->dataSize += mip.size;
+
+		if (width == 1 && height == 1)
+			break;
+		width  = width  > 1 ? width  / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return true;
+}
+
+static bool parseBMP(FILE * fp, TextureJob * job){
+	unsigned char header[54];
+	if (fread(header, 1, 54, fp) != 54 || header[0] != 'B' || header[1] != 'M'){
+		printf("%s is not a correct BMP file\n", job->path.c_str());
+		return false;
+	}
+	// Only 24bpp, uncompressed
+	if (*(int*)&(header[0x1E]) != 0 || *(short*)&(header[0x1C]) != 24){
+		printf("%s : only uncompressed 24bpp BMP files are supported\n", job->path.c_str());
+		return false;
+	}
+	unsigned int dataPos = *(int*)&(header[0x0A]);
+	int width            = *(int*)&(header[0x12]);
+	int height           = *(int*)&(header[0x16]);
+	if (width <= 0 || height <= 0){
+		printf("%s : unsupported BMP dimensions\n", job->path.c_str());
+		return false;
+	}
+	if (dataPos == 0)
+		dataPos = 54;
+	fseek(fp, dataPos, SEEK_SET);
+
+	// BMP rows are padded to 4 bytes, which matches GL_UNPACK_ALIGNMENT's default
+	MipLevel mip;
+	mip.width = width;
+	mip.height = height;
+	mip.offset = 0;
+	mip.size = (size_t)((width * 3 + 3) & ~3) * height;
+	job->levels.push_back(mip);
+	job->compressed = false;
+	job->format = GL_BGR;
+	job->dataSize = mip.size;
+	return true;
+}
+
+// Called with streamMutex held
+static bool allocateStaging(size_t size, size_t & offset){
+	if (stagingRanges.empty())
+		stagingHead = 0;
+	size_t tail = stagingRanges.empty() ? StagingBufferSize : stagingRanges.front().offset;
+	bool full = !stagingRanges.empty() && stagingHead == tail;
+
+	if (full)
+		return false;
+	if (stagingRanges.empty() || stagingHead > tail){
+		// Free space is [head, end) and [0, tail)
+		if (StagingBufferSize - stagingHead >= size)
+			offset = stagingHead;
+		else if (!stagingRanges.empty() && tail >= size)
+			offset = 0;
+		else
+			return false;
+	}else{
+		// Free space is [head, tail)
+		if (tail - stagingHead < size)
+			return false;
+		offset = stagingHead;
+	}
+
+	StagingRange range = { offset, size };
+	stagingRanges.push_back(range);
+	stagingHead = offset + size;
+	return true;
+}
+
+static void readTexture(TextureJob * job){
+	double start = glfwGetTime();
+
+	FILE * fp = fopen(job->path.c_str(), "rb");
+	if (fp == NULL){
+		printf("%s could not be opened\n", job->path.c_str());
+		job->failed = true;
+		return;
+	}
+
+	size_t length = job->path.size();
+	bool isDDS = length > 4 && (job->path.compare(length-4, 4, ".DDS") == 0 || job->path.compare(length-4, 4, ".dds") == 0);
+	bool ok = isDDS ? parseDDS(fp, job) : parseBMP(fp, job);
+
+	// The file must hold every level the header promises
+	long dataStart = ftell(fp);
+	fseek(fp, 0, SEEK_END);
+	long fileSize = ftell(fp);
+	fseek(fp, dataStart, SEEK_SET);
+	if (ok && (size_t)(fileSize - dataStart) < job->dataSize){
+		printf("%s : file is truncated (%ld bytes of texel data, %lu expected)\n",
+			job->path.c_str(), fileSize - dataStart, (unsigned long)job->dataSize);
+		ok = false;
+	}
+	if (!ok){
+		fclose(fp);
+		job->failed = true;
+		return;
+	}
+
+	// Read straight into the mapped staging buffer, waiting for the render thread to free space
+	unsigned char * destination;
+	if (stagingMemory != NULL && job->dataSize <= StagingBufferSize){
+		std::unique_lock<std::mutex> lock(streamMutex);
+		workerWakeup.wait(lock, [job]{ return stopWorker || allocateStaging(job->dataSize, job->stagingOffset); });
+		if (stopWorker){
+			fclose(fp);
+			job->failed = true;
+			return;
+		}
+		job->inRing = true;
+		destination = stagingMemory + job->stagingOffset;
+	}else{
+		job->heapData = (unsigned char*)malloc(job->dataSize);
+		if (job->heapData == NULL){
+			printf("%s : out of memory for %lu bytes of texel data\n", job->path.c_str(), (unsigned long)job->dataSize);
+			fclose(fp);
+			job->failed = true;
+			return;
+		}
+		destination = job->heapData;
+	}
+	// A read error, or a file that shrank since the size check. A failed job's staging range
+	// goes back in order with the others, once the render thread gets to it.
+	size_t read = fread(destination, 1, job->dataSize, fp);
+	fclose(fp);
+	if (read != job->dataSize){
+		printf("%s : read %lu bytes of texel data, %lu expected\n", job->path.c_str(), (unsigned long)read,
+			(unsigned long)job->dataSize);
+		job->failed = true;
+		return;
+	}
+
+	job->readTime = glfwGetTime() - start;
+}
+
+static void workerMain(){
+	for (;;){
+		TextureJob * job;
+		{
+			std::unique_lock<std::mutex> lock(streamMutex);
+			workerWakeup.wait(lock, []{ return stopWorker || !requestQueue.empty(); });
+			if (stopWorker)
+				return;
+			job = requestQueue.front();
+			requestQueue.pop_front();
+		}
+
+		readTexture(job);
+
+		std::lock_guard<std::mutex> lock(streamMutex);
+		readyQueue.push_back(job);
+	}
+}
+
+static void startTextureStream(){
+	// Persistent mapping lets the worker write while the GPU reads other ranges
+	if (GLEW_ARB_buffer_storage){
+		glGenBuffers(1, &stagingBufferID);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBufferID);
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, StagingBufferSize, NULL, flags);
+		stagingMemory = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, StagingBufferSize, flags);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}else{
+		printf("GL_ARB_buffer_storage not supported, textures will be uploaded from client memory\n");
+	}
+	stopWorker = false;
+	worker = std::thread(workerMain);
+}
+
+GLuint streamTexture(const char * imagepath){
+	if (!worker.joinable())
+		startTextureStream();
+
+	TextureJob * job = new TextureJob();
+	job->path = imagepath;
+	job->failed = false;
+	job->inRing = false;
+	job->heapData = NULL;
+	job->nextLevel = 0;
+	job->queuedTime = glfwGetTime();
+	job->readTime = job->uploadTime = 0.0;
+	glGenTextures(1, &job->textureID);
+
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+		requestQueue.push_back(job);
+		jobsInFlight++;
+	}
+	workerWakeup.notify_one();
+	return job->textureID;
+}
+
+static void finishJob(TextureJob * job){
+	if (job->failed){
+		printf("Streaming %s failed\n", job->path.c_str());
+		streamStats.failed++;
+	}else{
+		streamStats.streamed++;
+		streamStats.bytes += job->dataSize;
+		streamStats.readSeconds += job->readTime;
+		streamStats.uploadSeconds += job->uploadTime;
+		double latency = glfwGetTime() - job->queuedTime;
+		if (latency > streamStats.longestLatency)
+			streamStats.longestLatency = latency;
+	}
+	free(job->heapData);
+	delete job;
+	jobsInFlight--;
+}
+
+// Returns true once every level has been uploaded
+static bool uploadLevels(TextureJob * job, size_t & budget, bool & uploadedAny){
+	double start = glfwGetTime();
+
+	glBindTexture(GL_TEXTURE_2D, job->textureID);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->inRing ? stagingBufferID : 0);
+	const unsigned char * base = job->inRing ? (const unsigned char*)(size_t)job->stagingOffset : job->heapData;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, job->compressed ? 1 : 4);
+
+	while (job->nextLevel < job->levels.size()){
+		const MipLevel & mip = job->levels[job->nextLevel];
+		if (uploadedAny && mip.size > budget)
+			break;
+
+		if (job->compressed){
+			glCompressedTexImage2D(GL_TEXTURE_2D, job->nextLevel, job->format, mip.width, mip.height,
+				0, mip.size, base + mip.offset);
+		}else{
+			glTexImage2D(GL_TEXTURE_2D, job->nextLevel, GL_RGB, mip.width, mip.height, 0, GL_BGR, GL_UNSIGNED_BYTE, base + mip.offset);
+		}
+		budget = mip.size < budget ? budget - mip.size : 0;
+		uploadedAny = true;
+		job->nextLevel++;
+	}
+	bool done = job->nextLevel == job->levels.size();
+
+	if (done){
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		if (job->compressed){
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, job->levels.size() - 1);
+		}else{
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	job->uploadTime += glfwGetTime() - start;
+	return done;
+}
+
+void updateTextureStream(size_t maxUploadBytes){
+	if (!worker.joinable())
+		return;
+
+	// Give back staging space the GPU is done reading
+	size_t released = 0;
+	while (!pendingReleases.empty()){
+		GLenum status = glClientWaitSync(pendingReleases.front().fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(pendingReleases.front().fence);
+		released += pendingReleases.front().rangeCount;
+		pendingReleases.pop_front();
+	}
+
+	std::deque<TextureJob*> ready;
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+		for (size_t i = 0; i < released; i++)
+			stagingRanges.pop_front();
+		ready.swap(readyQueue);
+	}
+	if (released > 0)
+		workerWakeup.notify_one();
+
+	size_t budget = maxUploadBytes;
+	bool uploadedAny = false;
+	size_t rangesUploaded = 0;
+	while (!ready.empty()){
+		TextureJob * job = ready.front();
+		if (!job->failed && !uploadLevels(job, budget, uploadedAny))
+			break; // out of budget, continue next frame
+
+		ready.pop_front();
+		if (job->inRing)
+			rangesUploaded++;
+		finishJob(job);
+	}
+
+	if (rangesUploaded > 0){
+		PendingRelease release = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), rangesUploaded };
+		pendingReleases.push_back(release);
+	}
+
+	// Put back what didn't fit in this frame's budget, ahead of newer jobs
+	if (!ready.empty()){
+		std::lock_guard<std::mutex> lock(streamMutex);
+		readyQueue.insert(readyQueue.begin(), ready.begin(), ready.end());
+	}
+}
+
+bool isTextureStreamIdle(){
+	std::lock_guard<std::mutex> lock(streamMutex);
+	return jobsInFlight == 0;
+}
+
+TextureStreamStats getTextureStreamStats(){
+	return streamStats;
+}
+
+void cleanupTextureStream(){
+	if (!worker.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+		stopWorker = true;
+	}
+	workerWakeup.notify_all();
+	worker.join();
+
+	for (size_t i = 0; i < requestQueue.size(); i++){
+		glDeleteTextures(1, &requestQueue[i]->textureID);
+		delete requestQueue[i];
+	}
+	for (size_t i = 0; i < readyQueue.size(); i++){
+		glDeleteTextures(1, &readyQueue[i]->textureID);
+		free(readyQueue[i]->heapData);
+		delete readyQueue[i];
+	}
+	requestQueue.clear();
+	readyQueue.clear();
+	jobsInFlight = 0;
+
+	for (size_t i = 0; i < pendingReleases.size(); i++)
+		glDeleteSync(pendingReleases[i].fence);
+	pendingReleases.clear();
+	stagingRanges.clear();
+
+	if (stagingBufferID != 0){
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBufferID);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &stagingBufferID);
+		stagingBufferID = 0;
+		stagingMemory = NULL;
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef TEXTURESTREAM_HPP
+#define TEXTURESTREAM_HPP
+
+// Asynchronous texture loading. A worker thread reads and validates .DDS and .BMP files
+// straight into a persistently mapped pixel buffer ; the render thread only issues the uploads.
+
+// Queues a texture for streaming and returns its name right away. The texture has no data
+// until updateTextureStream() has uploaded it. Must be called from the render thread.
+GLuint streamTexture(const char * imagepath);
+
+// Call once per frame from the render thread. Uploads at most maxUploadBytes of texel data
+// (at least one mip level, so that large levels still make progress).
+void updateTextureStream(size_t maxUploadBytes);
+
+// True when every queued texture has been uploaded, or has failed to load
+bool isTextureStreamIdle();
+
+// Totals over the textures finished so far, uploaded or failed
+struct TextureStreamStats {
+	unsigned int streamed, failed;
+	size_t bytes;
+	double readSeconds, uploadSeconds;  // summed over the textures
+	double longestLatency;              // seconds from streamTexture() to the last upload
+};
+
+TextureStreamStats getTextureStreamStats();
+
+void cleanupTextureStream();
+
+#endif
@@ -0,0 +1,228 @@
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/dual_quaternion.hpp>
+
+#if GLM_ARCH & GLM_ARCH_SSE2
+#include <glm/gtx/simd_mat4.hpp>
+#define TRANSFORMBATCH_USE_SIMD
+#endif
+
+#include "jobsystem.hpp"
+#include "transformbatch.hpp"
+
+#ifdef TRANSFORMBATCH_USE_SIMD
+
+// Unaligned loads and stores cost nothing extra on aligned data, and keep misaligned callers safe
+static inline glm::simdMat4 loadMatrix(const glm::mat4 & m){
+	__m128 columns[4] = { _mm_loadu_ps(&m[0][0]), _mm_loadu_ps(&m[1][0]), _mm_loadu_ps(&m[2][0]), _mm_loadu_ps(&m[3][0]) };
+	return glm::simdMat4(columns);
+}
+
+static inline void storeMatrix(glm::mat4 & m, const glm::simdMat4 & s){
+	_mm_storeu_ps(&m[0][0], s.Data[0].Data);
+	_mm_storeu_ps(&m[1][0], s.Data[1].Data);
+	_mm_storeu_ps(&m[2][0], s.Data[2].Data);
+	_mm_storeu_ps(&m[3][0], s.Data[3].Data);
+}
+
+static void multiplyByParentsRange(const glm::mat4 * local, const int * parentIndex, size_t begin, size_t end, const glm::mat4 & root, glm::mat4 * world){
+	glm::simdMat4 rootMatrix = loadMatrix(root);
+	for (size_t i = begin; i < end; i++){
+		int parent = parentIndex[i];
+		glm::simdMat4 parentMatrix = parent >= 0 ? loadMatrix(world[parent]) : rootMatrix;
+		storeMatrix(world[i], parentMatrix * loadMatrix(local[i]));
+	}
+}
+
+static void multiplyBatchRange(const glm::mat4 & left, const glm::mat4 * right, size_t begin, size_t end, glm::mat4 * out){
+	glm::simdMat4 leftMatrix = loadMatrix(left);
+	for (size_t i = begin; i < end; i++)
+		storeMatrix(out[i], leftMatrix * loadMatrix(right[i]));
+}
+
+#else
+
+static void multiplyByParentsRange(const glm::mat4 * local, const int * parentIndex, size_t begin, size_t end, const glm::mat4 & root, glm::mat4 * world){
+	for (size_t i = begin; i < end; i++)
+		world[i] = (parentIndex[i] >= 0 ? world[parentIndex[i]] : root) * local[i];
+}
+
+static void multiplyBatchRange(const glm::mat4 & left, const glm::mat4 * right, size_t begin, size_t end, glm::mat4 * out){
+	for (size_t i = begin; i < end; i++)
+		out[i] = left * right[i];
+}
+
+#endif
+
+void multiplyByParents(const glm::mat4 * local, const int * parentIndex, size_t count, const glm::mat4 & root, glm::mat4 * world){
+	multiplyByParentsRange(local, parentIndex, 0, count, root, world);
+}
+
+void multiplyBatch(const glm::mat4 & left, const glm::mat4 * right, size_t count, glm::mat4 * out){
+	multiplyBatchRange(left, right, 0, count, out);
+}
+
+// Below this many nodes per job, queueing costs more than it saves
+static const size_t minNodesPerJob = 1024;
+
+struct HierarchyJob {
+	const glm::mat4 * local;
+	const int * parentIndex;
+	const glm::mat4 * root;
+	glm::mat4 * world;
+	std::vector<size_t> rangeStart; // node ranges made of whole subtrees, plus the end
+};
+
+static void runHierarchyJob(void * data, size_t begin, size_t end){
+	HierarchyJob & job = *(HierarchyJob *)data;
+	for (size_t r = begin; r < end; r++)
+		multiplyByParentsRange(job.local, job.parentIndex, job.rangeStart[r], job.rangeStart[r + 1], *job.root, job.world);
+}
+
+void multiplyByParentsParallel(const glm::mat4 * local, const int * parentIndex, size_t count, const size_t * subtreeStart, size_t subtreeCount, const glm::mat4 & root, glm::mat4 * world){
+	if (jobSystemThreadCount() <= 1 || count < 2 * minNodesPerJob || subtreeCount < 2){
+		multiplyByParentsRange(local, parentIndex, 0, count, root, world);
+		return;
+	}
+
+	// Group consecutive subtrees into ranges of at least minNodesPerJob nodes. A subtree only
+	// reads matrices of its own nodes, so the ranges are independent.
+	HierarchyJob job = { local, parentIndex, &root, world, std::vector<size_t>() };
+	job.rangeStart.push_back(0);
+	for (size_t s = 1; s < subtreeCount; s++){
+		if (subtreeStart[s] - job.rangeStart.back() >= minNodesPerJob)
+			job.rangeStart.push_back(subtreeStart[s]);
+	}
+	job.rangeStart.push_back(count);
+
+	parallelFor(job.rangeStart.size() - 1, 1, runHierarchyJob, &job);
+}
+
+struct BatchJob {
+	const glm::mat4 * left;
+	const glm::mat4 * right;
+	glm::mat4 * out;
+};
+
+static void runBatchJob(void * data, size_t begin, size_t end){
+	BatchJob & job = *(BatchJob *)data;
+	multiplyBatchRange(*job.left, job.right, begin, end, job.out);
+}
+
+void multiplyBatchParallel(const glm::mat4 & left, const glm::mat4 * right, size_t count, glm::mat4 * out){
+	BatchJob job = { &left, right, out };
+	parallelFor(count, minNodesPerJob, runBatchJob, &job);
+}
+
+glm::dualquat rigidFromMatrix(const glm::mat4 & matrix){
+	return glm::dualquat(glm::normalize(glm::quat_cast(glm::mat3(matrix))), glm::vec3(matrix[3]));
+}
+
+// Translation 2 dual conjugate(real)
+glm::mat4 matrixFromRigid(const glm::dualquat & rigid){
+	const glm::quat & r = rigid.real;
+	const glm::quat & d = rigid.dual;
+	float xx = r.x * r.x, yy = r.y * r.y, zz = r.z * r.z;
+	float xy = r.x * r.y, xz = r.x * r.z, yz = r.y * r.z;
+	float wx = r.w * r.x, wy = r.w * r.y, wz = r.w * r.z;
+	return glm::mat4(
+		1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f,
+		2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f,
+		2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f,
+		2.0f * (d.x * r.w - d.w * r.x + d.z * r.y - d.y * r.z),
+		2.0f * (d.y * r.w - d.w * r.y + d.x * r.z - d.z * r.x),
+		2.0f * (d.z * r.w - d.w * r.z + d.y * r.x - d.x * r.y), 1.0f);
+}
+
+#ifdef TRANSFORMBATCH_USE_SIMD
+
+// Hamilton product of quaternions stored x, y, z, w : p.w q, plus p.x, p.y and p.z times
+// shuffled and negated copies of q
+static inline __m128 quatProduct(__m128 p, __m128 q){
+	const __m128 signsX = _mm_setr_ps(1.0f, -1.0f, 1.0f, -1.0f);
+	const __m128 signsY = _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f);
+	const __m128 signsZ = _mm_setr_ps(-1.0f, 1.0f, 1.0f, -1.0f);
+	__m128 result = _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)), q);
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)),
+		_mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(0, 1, 2, 3)), signsX)));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)),
+		_mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(1, 0, 3, 2)), signsY)));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2)),
+		_mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(2, 3, 0, 1)), signsZ)));
+	return result;
+}
+
+static void composeByParentsRange(const glm::dualquat * local, const int * parentIndex, size_t begin, size_t end, const glm::dualquat & root, glm::dualquat * world){
+	__m128 rootReal = _mm_loadu_ps(&root.real.x), rootDual = _mm_loadu_ps(&root.dual.x);
+	for (size_t i = begin; i < end; i++){
+		int parent = parentIndex[i];
+		__m128 parentReal = parent >= 0 ? _mm_loadu_ps(&world[parent].real.x) : rootReal;
+		__m128 parentDual = parent >= 0 ? _mm_loadu_ps(&world[parent].dual.x) : rootDual;
+		__m128 localReal = _mm_loadu_ps(&local[i].real.x), localDual = _mm_loadu_ps(&local[i].dual.x);
+		_mm_storeu_ps(&world[i].real.x, quatProduct(parentReal, localReal));
+		_mm_storeu_ps(&world[i].dual.x, _mm_add_ps(quatProduct(parentReal, localDual), quatProduct(parentDual, localReal)));
+	}
+}
+
+#else
+
+static void composeByParentsRange(const glm::dualquat * local, const int * parentIndex, size_t begin, size_t end, const glm::dualquat & root, glm::dualquat * world){
+	for (size_t i = begin; i < end; i++)
+		world[i] = (parentIndex[i] >= 0 ? world[parentIndex[i]] : root) * local[i];
+}
+
+#endif
+
+void composeByParents(const glm::dualquat * local, const int * parentIndex, size_t count, const glm::dualquat & root, glm::dualquat * world){
+	composeByParentsRange(local, parentIndex, 0, count, root, world);
+}
+
+struct RigidHierarchyJob {
+	const glm::dualquat * local;
+	const int * parentIndex;
+	const glm::dualquat * root;
+	glm::dualquat * world;
+	std::vector<size_t> rangeStart;
+};
+
+static void runRigidHierarchyJob(void * data, size_t begin, size_t end){
+	RigidHierarchyJob & job = *(RigidHierarchyJob *)data;
+	for (size_t r = begin; r < end; r++)
+		composeByParentsRange(job.local, job.parentIndex, job.rangeStart[r], job.rangeStart[r + 1], *job.root, job.world);
+}
+
+void composeByParentsParallel(const glm::dualquat * local, const int * parentIndex, size_t count, const size_t * subtreeStart, size_t subtreeCount, const glm::dualquat & root, glm::dualquat * world){
+	if (jobSystemThreadCount() <= 1 || count < 2 * minNodesPerJob || subtreeCount < 2){
+		composeByParentsRange(local, parentIndex, 0, count, root, world);
+		return;
+	}
+
+	RigidHierarchyJob job = { local, parentIndex, &root, world, std::vector<size_t>() };
+	job.rangeStart.push_back(0);
+	for (size_t s = 1; s < subtreeCount; s++){
+		if (subtreeStart[s] - job.rangeStart.back() >= minNodesPerJob)
+			job.rangeStart.push_back(subtreeStart[s]);
+	}
+	job.rangeStart.push_back(count);
+
+	parallelFor(job.rangeStart.size() - 1, 1, runRigidHierarchyJob, &job);
+}
+
+struct RigidMatrixJob {
+	const glm::dualquat * rigid;
+	glm::mat4 * out;
+};
+
+static void runRigidMatrixJob(void * data, size_t begin, size_t end){
+	RigidMatrixJob & job = *(RigidMatrixJob *)data;
+	for (size_t i = begin; i < end; i++)
+		job.out[i] = matrixFromRigid(job.rigid[i]);
+}
+
+void matricesFromRigidParallel(const glm::dualquat * rigid, size_t count, glm::mat4 * out){
+	RigidMatrixJob job = { rigid, out };
+	parallelFor(count, minNodesPerJob, runRigidMatrixJob, &job);
+}
@@ -0,0 +1,43 @@
+#ifndef TRANSFORMBATCH_HPP
+#define TRANSFORMBATCH_HPP
+
+// Batched 4x4 matrix products for transform hierarchies. Runs on glm's SSE fmat4x4SIMD
+// when the compiler targets SSE2, on plain glm::mat4 otherwise. No OpenGL involved.
+//
+// Hierarchies are flattened into arrays holding one matrix per node, every parent before
+// its children : parentIndex[i] < i, or -1 for the roots. Keep the arrays 16 byte aligned
+// (std::vector and new are, on x86-64) so that no matrix straddles a cache line.
+
+// world[i] = world[parentIndex[i]] * local[i], and root * local[i] for the roots
+void multiplyByParents(const glm::mat4 * local, const int * parentIndex, size_t count, const glm::mat4 & root, glm::mat4 * world);
+
+// out[i] = left * right[i], e.g. every model-view-projection matrix from the view-projection one
+void multiplyBatch(const glm::mat4 & left, const glm::mat4 * right, size_t count, glm::mat4 * out);
+
+// Same as multiplyByParents, spread over the job system (common/jobsystem). subtreeStart
+// holds the first node of each independent subtree, in increasing order, starting with 0 :
+// the nodes from subtreeStart[s] up to the next start must only have parents among
+// themselves, or -1. Every node still goes through the same arithmetic, so the result is
+// the same bit for bit whatever the thread count. Small hierarchies stay on the caller.
+void multiplyByParentsParallel(const glm::mat4 * local, const int * parentIndex, size_t count, const size_t * subtreeStart, size_t subtreeCount, const glm::mat4 & root, glm::mat4 * world);
+
+void multiplyBatchParallel(const glm::mat4 & left, const glm::mat4 * right, size_t count, glm::mat4 * out);
+
+// Rigid transforms as unit dual quaternions (glm/gtx/dual_quaternion.hpp) : 32 bytes instead
+// of 64, half the memory traffic of the hierarchy pass, and nothing but rotations and
+// translations, so no shear or scale can creep in. Matrices are only needed at upload.
+
+// The rotation of the matrix, orthonormalized, and its translation
+glm::dualquat rigidFromMatrix(const glm::mat4 & matrix);
+
+glm::mat4 matrixFromRigid(const glm::dualquat & rigid);
+
+// Same as multiplyByParents and multiplyByParentsParallel, for rigid transforms
+void composeByParents(const glm::dualquat * local, const int * parentIndex, size_t count, const glm::dualquat & root, glm::dualquat * world);
+
+void composeByParentsParallel(const glm::dualquat * local, const int * parentIndex, size_t count, const size_t * subtreeStart, size_t subtreeCount, const glm::dualquat & root, glm::dualquat * world);
+
+// out[i] = matrixFromRigid(rigid[i]), on the job system
+void matricesFromRigidParallel(const glm::dualquat * rigid, size_t count, glm::mat4 * out);
+
+#endif
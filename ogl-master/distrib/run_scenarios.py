@@ -0,0 +1,97 @@
+# Runs the headless scenarios of misc05_picking_slow_easy in parallel processes, then compares
+# their captured frames against the golden images in misc05_picking/goldens/<scenario>/.
+#
+#   python run_scenarios.py [--jobs N] [--accept] [--perceptual] [scenario names...]
+#
+# --accept replaces the golden images with the new captures.
+# On machines without a GPU or a display, use Xvfb and Mesa's llvmpipe :
+#   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a python run_scenarios.py
+from __future__ import print_function
+import os
+import sys
+import shutil
+import subprocess
+from multiprocessing.pool import ThreadPool
+
+here = os.path.dirname(os.path.abspath(__file__))
+workingDir = os.path.join(here, '..', 'misc05_picking')
+executable = os.path.join(workingDir, 'misc05_picking_slow_easy')
+imageDiff = os.path.join(workingDir, 'misc05_image_diff')
+goldenDir = os.path.join(workingDir, 'goldens')
+outputDir = os.path.join(here, 'scenarios')
+if os.name == 'nt':
+	executable += '.exe'
+	imageDiff += '.exe'
+
+# name, scripted frames after the warm-up, captured frames (warm-up included)
+scenarios = [
+	('rig_start'      , 60  , [0, 10, 40]            ),
+	('rig_projectile' , 180 , [45, 60, 75, 100]      ),
+	('rig_orbit'      , 600 , [150, 300, 450, 609]   ),
+]
+
+def RunScenario(scenario):
+	name, frames, captures = scenario
+	directory = os.path.join(outputDir, name)
+	if os.path.exists(directory): shutil.rmtree(directory)
+	os.makedirs(directory)
+
+	stats = os.path.join(directory, 'frame_stats.txt')
+	command = [executable, '--headless', '--frames', str(frames), '--stats', stats,
+		'--capture', ','.join(str(c) for c in captures), '--capture-dir', directory]
+	with open(os.path.join(directory, 'log.txt'), 'w') as log:
+		code = subprocess.call(command, cwd=workingDir, stdout=log, stderr=subprocess.STDOUT)
+	return (name, code, directory)
+
+def CompareScenario(name, directory, perceptual):
+	ok = True
+	for image in sorted(os.listdir(directory)):
+		if not image.endswith('.png') or image.startswith('diff_'): continue
+		golden = os.path.join(goldenDir, name, image)
+		if not os.path.exists(golden):
+			print('  ' + image + ' : no golden image, run with --accept')
+			ok = False
+			continue
+		command = [imageDiff, os.path.join(directory, image), golden, '--diff', os.path.join(directory, 'diff_' + image)]
+		if perceptual: command.append('--perceptual')
+		output = subprocess.Popen(command, stdout=subprocess.PIPE).communicate()[0]
+		print('  ' + output.decode().strip())
+		ok = ok and output.decode().find('DIFFERENT') < 0
+	return ok
+
+def AcceptScenario(name, directory):
+	target = os.path.join(goldenDir, name)
+	if not os.path.exists(target): os.makedirs(target)
+	for image in os.listdir(directory):
+		if image.endswith('.png') and not image.startswith('diff_'):
+			shutil.copy(os.path.join(directory, image), os.path.join(target, image))
+	print('  accepted as golden images')
+
+def Main(arguments):
+	jobs = 4
+	accept = '--accept' in arguments
+	perceptual = '--perceptual' in arguments
+	if '--jobs' in arguments: jobs = int(arguments[arguments.index('--jobs') + 1])
+	selected = [s for s in scenarios if s[0] in arguments] or scenarios
+
+	results = ThreadPool(jobs).map(RunScenario, selected)
+
+	failures = 0
+	for name, code, directory in results:
+		stats = os.path.join(directory, 'frame_stats.txt')
+		print(name + ' :' + (' exit code ' + str(code) if code != 0 else ''))
+		if os.path.exists(stats):
+			print('  ' + ', '.join(line.strip() for line in open(stats) if not line.startswith('renderer')))
+		if code != 0:
+			print('  see ' + os.path.join(directory, 'log.txt'))
+			failures += 1
+		elif accept:
+			AcceptScenario(name, directory)
+		elif not CompareScenario(name, directory, perceptual):
+			failures += 1
+
+	print(str(len(results) - failures) + '/' + str(len(results)) + ' scenarios passed')
+	return 1 if failures else 0
+
+if __name__ == '__main__':
+	sys.exit(Main(sys.argv[1:]))
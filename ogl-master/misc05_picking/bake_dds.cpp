@@ -0,0 +1,83 @@
+// Offline texture baker : converts any image stb_image reads into a DXT1 or DXT5 .DDS
+// with a full mip chain, ready for loadDDS(). Reports encode throughput and PSNR.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+#include <common/image.hpp>
+#include <common/dxtcompress.hpp>
+
+// Peak signal to noise ratio over RGB (and alpha for BC3), in dB
+static double computePSNR(const unsigned char* reference, const unsigned char* decoded, size_t pixelCount, bool withAlpha) {
+	double squaredError = 0.0;
+	int channels = withAlpha ? 4 : 3;
+	for (size_t i = 0; i < pixelCount; i++) {
+		for (int c = 0; c < channels; c++) {
+			double d = (double)reference[i * 4 + c] - decoded[i * 4 + c];
+			squaredError += d * d;
+		}
+	}
+	double mse = squaredError / (pixelCount * channels);
+	return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+int main(int argc, char** argv) {
+	int format = 0; // 1 = DXT1, 5 = DXT5, 0 = DXT5 only if the image has alpha
+	unsigned int threads = 0;
+	const char* input = NULL;
+	const char* output = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--dxt1") == 0) format = 1;
+		else if (strcmp(argv[i], "--dxt5") == 0) format = 5;
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+		else if (input == NULL) input = argv[i];
+		else if (output == NULL) output = argv[i];
+	}
+	if (input == NULL || output == NULL) {
+		printf("Usage : %s [--dxt1 | --dxt5] [--threads N] input.png output.DDS\n", argv[0]);
+		return 1;
+	}
+
+	// .DDS files are stored top row first
+	int width, height;
+	unsigned char* pixels = loadImageRGBA(input, width, height, false);
+	if (pixels == NULL) return 1;
+
+	bool bc3 = format == 5;
+	if (format == 0) {
+		for (size_t i = 0; i < (size_t)width * height && !bc3; i++) bc3 = pixels[i * 4 + 3] != 255;
+	}
+
+	MipChain chain;
+	buildMipChain(pixels, width, height, chain, threads);
+	freeImage(pixels);
+
+	// Time the encode of the whole chain, and keep the blocks to measure the error and to save
+	std::vector<unsigned char> blocks;
+	auto start = std::chrono::high_resolution_clock::now();
+	compressMipChain(chain, bc3, blocks, threads);
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	size_t texels = 0, compressedBytes = blocks.size();
+	for (size_t i = 0; i < chain.levels.size(); i++) texels += (size_t)chain.levels[i].width * chain.levels[i].height;
+
+	// Level 0 comes first
+	const MipChainLevel& top = chain.levels[0];
+	std::vector<unsigned char> decoded((size_t)top.width * top.height * 4);
+	decompressDXT(&blocks[0], top.width, top.height, bc3, &decoded[0]);
+	double psnr = computePSNR(&chain.pixels[0], &decoded[0], (size_t)top.width * top.height, bc3);
+
+	if (!saveDDS(output, top.width, top.height, (unsigned int)chain.levels.size(), bc3, blocks)) return 1;
+
+	printf("%s -> %s : %dx%d, %s, %u levels, %lu KB (%.1f:1)\n", input, output, width, height, bc3 ? "DXT5" : "DXT1",
+		(unsigned int)chain.levels.size(), (unsigned long)(compressedBytes / 1024), (double)chain.pixels.size() / compressedBytes);
+	printf("  encode %.2f ms, %.1f Mpixels/s, %.1f MB/s of RGBA in\n", seconds * 1000.0,
+		texels / seconds / 1e6, texels * 4.0 / seconds / (1024.0 * 1024.0));
+	printf("  PSNR (level 0) %.2f dB\n", psnr);
+	return 0;
+}
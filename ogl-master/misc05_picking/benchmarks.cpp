@@ -0,0 +1,1135 @@
+// Command line micro-benchmarks for the rig's CPU side code paths.
+// Run without arguments to list them.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/dual_quaternion.hpp>
+
+#include <LinearMath/btQuickprof.h>
+
+#include <common/image.hpp>
+#include <common/jobsystem.hpp>
+#include <common/objloader.hpp>
+#include <common/vboindexer.hpp>
+#include <common/scene.hpp>
+#include <common/meshlod.hpp>
+#include <common/meshoptimize.hpp>
+#include <common/transformbatch.hpp>
+#include <common/selfcollision.hpp>
+#include <common/motionplanner.hpp>
+#include <common/kinematicsbatch.hpp>
+#include <common/profiler.hpp>
+using glm::quat;
+using glm::vec3;
+#include <common/quaternion_utils.hpp>
+
+static double secondsSince(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Decode + mip generation throughput, in MB of decoded RGBA per second.
+// Synthesizes a 2048x2048 image when no file is given, which only times the mip generation.
+static int benchMipmaps(int argc, char** argv) {
+	const int repeats = 5;
+	unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<const char*> files(argv, argv + argc);
+	if (files.empty()) files.push_back(NULL);
+
+	for (const char* file : files) {
+		int width = 2048, height = 2048;
+		unsigned char* pixels = NULL;
+		double decodeSeconds = 0.0;
+
+		if (file != NULL) {
+			for (int r = 0; r < repeats; r++) {
+				if (pixels) freeImage(pixels);
+				auto start = std::chrono::high_resolution_clock::now();
+				pixels = loadImageRGBA(file, width, height);
+				decodeSeconds += secondsSince(start);
+				if (pixels == NULL) return 1;
+			}
+			decodeSeconds /= repeats;
+		}
+		else {
+			pixels = (unsigned char*)malloc((size_t)width * height * 4);
+			for (size_t i = 0; i < (size_t)width * height * 4; i++) pixels[i] = (unsigned char)rand();
+		}
+
+		double megabytes = (double)width * height * 4 / (1024.0 * 1024.0);
+		printf("%s : %dx%d\n", file ? file : "synthetic image", width, height);
+		if (file != NULL) printf("  decode             %8.2f ms  %8.1f MB/s\n", decodeSeconds * 1000.0, megabytes / decodeSeconds);
+
+		for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+			MipChain chain;
+			double mipSeconds = 0.0;
+			for (int r = 0; r < repeats; r++) {
+				auto start = std::chrono::high_resolution_clock::now();
+				buildMipChain(pixels, width, height, chain, threads);
+				mipSeconds += secondsSince(start);
+			}
+			mipSeconds /= repeats;
+			printf("  mips, %2u thread(s) %8.2f ms  %8.1f MB/s", threads, mipSeconds * 1000.0, megabytes / mipSeconds);
+			if (file != NULL) printf("   decode+mips %8.1f MB/s", megabytes / (decodeSeconds + mipSeconds));
+			printf("\n");
+		}
+
+		if (file != NULL) freeImage(pixels);
+		else free(pixels);
+	}
+	return 0;
+}
+
+// Pointer based hierarchy, like the rig's Node, for the recursive reference path
+struct BenchNode {
+	glm::mat4 localTransform;
+	glm::mat4 globalTransform;
+	std::vector<BenchNode*> children;
+};
+
+static void updateRecursive(BenchNode* node, const glm::mat4& parentTransform) {
+	node->globalTransform = parentTransform * node->localTransform;
+	for (BenchNode* child : node->children) updateRecursive(child, node->globalTransform);
+}
+
+// Builds rigCount copies of a 7 node chain (base, top, arm1, joint, arm2, pen, projectile),
+// flattened parents first, with random local rotations and translations
+static void buildRigs(size_t rigCount, std::vector<glm::mat4>& locals, std::vector<int>& parents) {
+	const int chainLength = 7;
+	locals.resize(rigCount * chainLength);
+	parents.resize(rigCount * chainLength);
+	for (size_t r = 0; r < rigCount; r++) {
+		for (int j = 0; j < chainLength; j++) {
+			size_t i = r * chainLength + j;
+			glm::vec3 axis = glm::normalize(glm::vec3(rand() % 100 + 1, rand() % 100, rand() % 100));
+			glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), (rand() % 628) / 100.0f, axis);
+			locals[i] = glm::translate(glm::mat4(1.0f), glm::vec3((float)(r % 100), 0.3f * j, -0.5f)) * rotation;
+			parents[i] = j == 0 ? -1 : (int)i - 1;
+		}
+	}
+}
+
+static float maxDifference(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b) {
+	float worst = 0.0f;
+	for (size_t i = 0; i < a.size(); i++)
+		for (int c = 0; c < 4; c++)
+			for (int r = 0; r < 4; r++) worst = std::max(worst, fabsf(a[i][c][r] - b[i][c][r]));
+	return worst;
+}
+
+// Hierarchy update and MVP computation : recursive pointer walk, flat scalar glm loop,
+// and the batched SIMD kernels of common/transformbatch
+static int benchTransforms(int argc, char** argv) {
+	size_t rigCount = argc > 0 ? (size_t)atoi(argv[0]) : 10000;
+	const int repeats = 50;
+
+	std::vector<glm::mat4> locals, scalarWorlds, simdWorlds, scalarMVPs, simdMVPs;
+	std::vector<int> parents;
+	buildRigs(rigCount, locals, parents);
+	size_t count = locals.size();
+	scalarWorlds.resize(count);
+	simdWorlds.resize(count);
+	scalarMVPs.resize(count);
+	simdMVPs.resize(count);
+
+	std::vector<BenchNode> nodes(count);
+	std::vector<BenchNode*> roots;
+	for (size_t i = 0; i < count; i++) {
+		nodes[i].localTransform = locals[i];
+		if (parents[i] >= 0) nodes[parents[i]].children.push_back(&nodes[i]);
+		else roots.push_back(&nodes[i]);
+	}
+
+	glm::mat4 root(1.0f);
+	glm::mat4 viewProjection = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 100.0f) *
+		glm::lookAt(glm::vec3(10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		for (BenchNode* node : roots) updateRecursive(node, root);
+	double recursiveSeconds = secondsSince(start) / repeats;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		for (size_t i = 0; i < count; i++) scalarWorlds[i] = (parents[i] >= 0 ? scalarWorlds[parents[i]] : root) * locals[i];
+	double scalarSeconds = secondsSince(start) / repeats;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		multiplyByParents(&locals[0], &parents[0], count, root, &simdWorlds[0]);
+	double simdSeconds = secondsSince(start) / repeats;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		for (size_t i = 0; i < count; i++) scalarMVPs[i] = viewProjection * scalarWorlds[i];
+	double scalarMVPSeconds = secondsSince(start) / repeats;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		multiplyBatch(viewProjection, &simdWorlds[0], count, &simdMVPs[0]);
+	double simdMVPSeconds = secondsSince(start) / repeats;
+
+	printf("%lu rigs, %lu nodes\n", (unsigned long)rigCount, (unsigned long)count);
+	printf("  hierarchy, recursive glm  %8.3f ms  %6.2f ns/node\n", recursiveSeconds * 1000.0, recursiveSeconds * 1e9 / count);
+	printf("  hierarchy, flat glm       %8.3f ms  %6.2f ns/node\n", scalarSeconds * 1000.0, scalarSeconds * 1e9 / count);
+	printf("  hierarchy, batched SIMD   %8.3f ms  %6.2f ns/node  (%.2fx the recursive path)\n", simdSeconds * 1000.0,
+		simdSeconds * 1e9 / count, recursiveSeconds / simdSeconds);
+	printf("  MVP, glm                  %8.3f ms  %6.2f ns/node\n", scalarMVPSeconds * 1000.0, scalarMVPSeconds * 1e9 / count);
+	printf("  MVP, batched SIMD         %8.3f ms  %6.2f ns/node  (%.2fx)\n", simdMVPSeconds * 1000.0,
+		simdMVPSeconds * 1e9 / count, scalarMVPSeconds / simdMVPSeconds);
+	printf("  max difference : worlds %g, MVPs %g\n", maxDifference(scalarWorlds, simdWorlds), maxDifference(scalarMVPs, simdMVPs));
+	return 0;
+}
+
+// The hierarchy pass in unit dual quaternions against matrices, conversions included, and
+// how far each drifts from a rigid transform under many small incremental turns
+static int benchRigid(int argc, char** argv) {
+	size_t rigCount = argc > 0 ? (size_t)atoi(argv[0]) : 10000;
+	const int repeats = 50;
+
+	std::vector<glm::mat4> locals, worlds, rigidWorldMatrices;
+	std::vector<int> parents;
+	buildRigs(rigCount, locals, parents);
+	size_t count = locals.size();
+	worlds.resize(count);
+	rigidWorldMatrices.resize(count);
+	std::vector<glm::dualquat> rigidLocals(count), rigidWorlds(count);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		multiplyByParents(&locals[0], &parents[0], count, glm::mat4(1.0f), &worlds[0]);
+	double matrixSeconds = secondsSince(start) / repeats;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		for (size_t i = 0; i < count; i++) rigidLocals[i] = rigidFromMatrix(locals[i]);
+	double fromMatrixSeconds = secondsSince(start) / repeats;
+
+	glm::dualquat identity(glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.0f));
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		composeByParents(&rigidLocals[0], &parents[0], count, identity, &rigidWorlds[0]);
+	double rigidSeconds = secondsSince(start) / repeats;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		for (size_t i = 0; i < count; i++) rigidWorldMatrices[i] = matrixFromRigid(rigidWorlds[i]);
+	double toMatrixSeconds = secondsSince(start) / repeats;
+
+	printf("%lu rigs, %lu nodes ; %lu bytes per transform as a matrix, %lu as a dual quaternion\n", (unsigned long)rigCount,
+		(unsigned long)count, (unsigned long)sizeof(glm::mat4), (unsigned long)sizeof(glm::dualquat));
+	printf("  hierarchy, batched SIMD mat4  %8.3f ms  %6.2f ns/node\n", matrixSeconds * 1000.0, matrixSeconds * 1e9 / count);
+	printf("  hierarchy, dual quaternions   %8.3f ms  %6.2f ns/node  (%.2fx)\n", rigidSeconds * 1000.0, rigidSeconds * 1e9 / count,
+		matrixSeconds / rigidSeconds);
+	printf("  locals from matrices          %8.3f ms  %6.2f ns/node\n", fromMatrixSeconds * 1000.0, fromMatrixSeconds * 1e9 / count);
+	printf("  worlds to matrices            %8.3f ms  %6.2f ns/node\n", toMatrixSeconds * 1000.0, toMatrixSeconds * 1e9 / count);
+	printf("  max difference of the worlds %g\n", maxDifference(worlds, rigidWorldMatrices));
+
+	// A joint turned a little every frame, the way the keyboard turns them
+	const int turns = 100000;
+	const glm::vec3 axis = glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f));
+	glm::mat4 matrix = locals[1];
+	glm::dualquat rigid = rigidFromMatrix(matrix);
+	glm::dualquat turn = rigidFromMatrix(glm::rotate(glm::mat4(1.0f), 0.01f, axis));
+	for (int t = 0; t < turns; t++) {
+		matrix = glm::rotate(matrix, 0.01f, axis);
+		rigid = glm::normalize(rigid * turn);
+	}
+	glm::mat3 rotations[2] = { glm::mat3(matrix), glm::mat3(matrixFromRigid(rigid)) };
+	float drift[2] = { 0.0f, 0.0f };
+	for (int k = 0; k < 2; k++) {
+		glm::mat3 gram = glm::transpose(rotations[k]) * rotations[k];
+		for (int c = 0; c < 3; c++)
+			for (int r = 0; r < 3; r++) drift[k] = std::max(drift[k], fabsf(gram[c][r] - (c == r ? 1.0f : 0.0f)));
+	}
+	printf("  after %d turns, largest entry of R^T R - I : mat4 %g, dual quaternion %g\n", turns, drift[0], drift[1]);
+	return 0;
+}
+
+// Scaling of the job system's parallel hierarchy and MVP updates over 1 to 16 threads,
+// checked bit for bit against the single threaded kernels
+static int benchHierarchy(int argc, char** argv) {
+	size_t rigCount = argc > 0 ? (size_t)atoi(argv[0]) : 50000;
+	const int repeats = 50;
+
+	std::vector<glm::mat4> locals, serialWorlds, serialMVPs, worlds, mvps;
+	std::vector<int> parents;
+	buildRigs(rigCount, locals, parents);
+	size_t count = locals.size();
+	serialWorlds.resize(count);
+	serialMVPs.resize(count);
+	std::vector<size_t> subtreeStarts;
+	for (size_t i = 0; i < count; i++) {
+		if (parents[i] < 0) subtreeStarts.push_back(i);
+	}
+
+	glm::mat4 root(1.0f);
+	glm::mat4 viewProjection = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 100.0f) *
+		glm::lookAt(glm::vec3(10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++) {
+		multiplyByParents(&locals[0], &parents[0], count, root, &serialWorlds[0]);
+		multiplyBatch(viewProjection, &serialWorlds[0], count, &serialMVPs[0]);
+	}
+	double serialSeconds = secondsSince(start) / repeats;
+
+	printf("%lu rigs, %lu nodes, %u hardware threads\n", (unsigned long)rigCount, (unsigned long)count, std::thread::hardware_concurrency());
+	printf("  serial kernels  %8.3f ms\n", serialSeconds * 1000.0);
+
+	const unsigned int threadCounts[] = { 1, 2, 4, 8, 16 };
+	for (unsigned int threads : threadCounts) {
+		initJobSystem(threads);
+		worlds.assign(count, glm::mat4(0.0f));
+		mvps.assign(count, glm::mat4(0.0f));
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int r = 0; r < repeats; r++) {
+			multiplyByParentsParallel(&locals[0], &parents[0], count, &subtreeStarts[0], subtreeStarts.size(), root, &worlds[0]);
+			multiplyBatchParallel(viewProjection, &worlds[0], count, &mvps[0]);
+		}
+		double seconds = secondsSince(start) / repeats;
+
+		bool identical = memcmp(&worlds[0], &serialWorlds[0], count * sizeof(glm::mat4)) == 0 &&
+			memcmp(&mvps[0], &serialMVPs[0], count * sizeof(glm::mat4)) == 0;
+		printf("  %2u threads      %8.3f ms  %5.2fx  %s\n", threads, seconds * 1000.0, serialSeconds / seconds,
+			identical ? "identical" : "MISMATCH");
+	}
+	cleanupJobSystem();
+	return 0;
+}
+
+// Scene loading : copies the scene file with its instances replaced by a grid of rigs, then
+// times parsing and instancing it, and the mesh loads left once meshes are shared
+static int benchScene(int argc, char** argv) {
+	const char* source = argc > 0 ? argv[0] : "rig.scene.json";
+	int instanceCount = argc > 1 ? atoi(argv[1]) : 5000;
+	const char* generated = "scene_benchmark.json";
+	const int repeats = 5;
+
+	Scene scene;
+	if (!loadScene(source, scene)) return 1;
+	if (scene.rigs.empty()) {
+		printf("%s : no rigs\n", source);
+		return 1;
+	}
+
+	// The "instances" array must be the last member of the scene
+	FILE* file = fopen(source, "rb");
+	std::string text;
+	char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, read);
+	fclose(file);
+	size_t instances = text.rfind("\"instances\"");
+	if (instances == std::string::npos) {
+		printf("%s : no \"instances\" array\n", source);
+		return 1;
+	}
+	file = fopen(generated, "wb");
+	if (file == NULL) {
+		printf("Impossible to open %s\n", generated);
+		return 1;
+	}
+	fwrite(text.data(), 1, instances, file);
+	fprintf(file, "\"instances\": [\n");
+	int side = (int)ceil(sqrt((double)instanceCount));
+	for (int i = 0; i < instanceCount; i++) {
+		fprintf(file, "\t\t{ \"rig\": \"%s\", \"position\": [%d, 0, %d], \"yaw\": %d }%s\n", scene.rigs[i % scene.rigs.size()].name.c_str(),
+			(i % side) * 3, (i / side) * 3, (i * 37) % 360, i + 1 < instanceCount ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	fclose(file);
+
+	double parseSeconds = 0.0, instanceSeconds = 0.0;
+	std::vector<glm::mat4> locals;
+	std::vector<int> parents;
+	std::vector<size_t> instanceStarts;
+	for (int r = 0; r < repeats; r++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!loadScene(generated, scene)) return 1;
+		parseSeconds += secondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		instantiateScene(scene, locals, parents, instanceStarts);
+		instanceSeconds += secondsSince(start);
+	}
+	parseSeconds /= repeats;
+	instanceSeconds /= repeats;
+
+	// Each mesh is loaded once ; without sharing, every node would load its own
+	size_t meshReferences = 0;
+	for (const SceneInstance& instance : scene.instances)
+		for (const SceneRigNode& node : scene.rigs[instance.rig].nodes)
+			if (node.mesh >= 0) meshReferences++;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (const SceneMesh& mesh : scene.meshes) {
+		std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
+		std::vector<unsigned short> indices;
+		if (!loadOBJ(mesh.path.c_str(), vertices, normals)) return 1;
+		indexVBO(vertices, normals, indices, indexedVertices, indexedNormals);
+	}
+	double meshSeconds = secondsSince(start);
+
+	printf("%s : %lu rigs, %lu nodes, %lu meshes for %lu mesh references\n", generated, (unsigned long)scene.instances.size(),
+		(unsigned long)locals.size(), (unsigned long)scene.meshes.size(), (unsigned long)meshReferences);
+	printf("  parse            %8.2f ms\n", parseSeconds * 1000.0);
+	printf("  instantiate      %8.2f ms\n", instanceSeconds * 1000.0);
+	printf("  shared meshes    %8.2f ms  (about %.0f ms if every node loaded its own)\n", meshSeconds * 1000.0,
+		scene.meshes.empty() ? 0.0 : meshSeconds * 1000.0 * meshReferences / scene.meshes.size());
+	printf("  total            %8.2f ms\n", (parseSeconds + instanceSeconds + meshSeconds) * 1000.0);
+	return 0;
+}
+
+// Levels of detail : builds them for the scene's meshes, then counts the triangles a grid of rigs
+// needs over a camera fly-by, at full detail against the levels picked per node from their
+// size on screen, and how often nodes change level with and without hysteresis
+static int benchLod(int argc, char** argv) {
+	const char* source = argc > 0 ? argv[0] : "rig.scene.json";
+	int rigCount = argc > 1 ? atoi(argv[1]) : 500;
+	const int frames = 600;
+	const float switchRadii[] = { 40.0f, 20.0f, 10.0f };	// as in the viewer
+	const float hysteresis = 0.1f;
+	const float screenHeight = 768.0f;
+
+	Scene scene;
+	if (!loadScene(source, scene)) return 1;
+	if (scene.rigs.empty()) {
+		printf("%s : no rigs\n", source);
+		return 1;
+	}
+
+	struct LodMesh {
+		MeshLodChain chain;
+		glm::vec3 center;
+		float radius;
+	};
+	std::vector<LodMesh> meshes(scene.meshes.size());
+	printf("%-22s %6s  %-22s %9s %9s\n", "mesh", "verts", "triangles per level", "build", "cached");
+	for (size_t m = 0; m < scene.meshes.size(); m++) {
+		const char* path = scene.meshes[m].path.c_str();
+		std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
+		std::vector<unsigned short> indices;
+		if (!loadOBJ(path, vertices, normals)) return 1;
+		indexVBO(vertices, normals, indices, indexedVertices, indexedNormals);
+
+		LodMesh& mesh = meshes[m];
+		auto start = std::chrono::high_resolution_clock::now();
+		buildMeshLods(indices, indexedVertices, indexedNormals, 4, 0.5f, mesh.chain);
+		double buildSeconds = secondsSince(start);
+		// Not the viewer's cache : those levels also come in vertex cache order
+		const char* cachepath = "lod_benchmark.lods";
+		saveMeshLods(cachepath, path, indexedVertices.size(), mesh.chain);
+		start = std::chrono::high_resolution_clock::now();
+		MeshLodChain cached;
+		bool loaded = loadMeshLods(cachepath, path, indexedVertices.size(), cached);
+		double cachedSeconds = secondsSince(start);
+		remove(cachepath);
+
+		glm::vec3 boundsMin = indexedVertices[0], boundsMax = indexedVertices[0];
+		for (const glm::vec3& p : indexedVertices) {
+			boundsMin = glm::min(boundsMin, p);
+			boundsMax = glm::max(boundsMax, p);
+		}
+		mesh.center = (boundsMin + boundsMax) * 0.5f;
+		mesh.radius = 0.0f;
+		for (const glm::vec3& p : indexedVertices) mesh.radius = std::max(mesh.radius, glm::length(p - mesh.center));
+
+		std::string levels;
+		for (const MeshLodLevel& level : mesh.chain.levels) {
+			char count[24];	// a separator and up to 20 digits
+			snprintf(count, sizeof(count), "%s%lu", levels.empty() ? "" : "/", (unsigned long)(level.indexCount / 3));
+			levels += count;
+		}
+		printf("%-22s %6lu  %-22s %6.2f ms %6.3f ms%s\n", path, (unsigned long)indexedVertices.size(), levels.c_str(),
+			buildSeconds * 1000.0, cachedSeconds * 1000.0, loaded && cached.indices == mesh.chain.indices ? "" : "  (cache MISMATCH)");
+	}
+
+	// A grid of rigs, like the scene benchmark
+	scene.instances.clear();
+	int side = (int)ceil(sqrt((double)rigCount));
+	for (int i = 0; i < rigCount; i++) {
+		SceneInstance instance = { (int)(i % scene.rigs.size()), glm::vec3((i % side) * 3.0f, 0.0f, (i / side) * 3.0f), (float)((i * 37) % 360) };
+		scene.instances.push_back(instance);
+	}
+	std::vector<glm::mat4> locals, worlds;
+	std::vector<int> parents, nodeMeshes;
+	std::vector<size_t> instanceStarts;
+	instantiateScene(scene, locals, parents, instanceStarts);
+	worlds.resize(locals.size());
+	multiplyByParents(&locals[0], &parents[0], locals.size(), glm::mat4(1.0f), &worlds[0]);
+	for (size_t r = 0; r < instanceStarts.size(); r++) {
+		const SceneRig& rig = scene.rigs[scene.instances[r].rig];
+		for (const SceneRigNode& node : rig.nodes) nodeMeshes.push_back(node.mesh);
+	}
+
+	// Fly-by : circles the grid, swinging between close and far
+	glm::mat4 projection = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+	float pixelsPerUnit = projection[1][1] * screenHeight * 0.5f;
+	glm::vec3 gridCenter(side * 1.5f, 0.0f, side * 1.5f);
+	std::vector<unsigned int> levels(locals.size(), 0), levelsNoHysteresis(locals.size(), 0);
+	unsigned long long fullTriangles = 0, lodTriangles = 0, switches = 0, switchesNoHysteresis = 0;
+	unsigned long long levelNodes[4] = { 0, 0, 0, 0 };
+	double selectSeconds = 0.0;
+	for (int frame = 0; frame < frames; frame++) {
+		float angle = 6.2831853f * frame / frames;
+		float distance = side * 1.5f + 20.0f + 15.0f * sinf(3.0f * angle);
+		glm::vec3 eye = gridCenter + glm::vec3(cosf(angle) * distance, 8.0f + 4.0f * sinf(5.0f * angle), sinf(angle) * distance);
+		glm::mat4 view = glm::lookAt(eye, gridCenter, glm::vec3(0.0f, 1.0f, 0.0f));
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < locals.size(); i++) {
+			if (nodeMeshes[i] < 0) continue;
+			const LodMesh& mesh = meshes[nodeMeshes[i]];
+			glm::vec4 viewCenter = view * worlds[i] * glm::vec4(mesh.center, 1.0f);
+			float screenRadius = mesh.radius * pixelsPerUnit / std::max(-viewCenter.z, 0.1f);
+			unsigned int levelCount = (unsigned int)mesh.chain.levels.size();
+			unsigned int level = selectMeshLod(screenRadius, switchRadii, levelCount, levels[i], hysteresis);
+			if (frame > 0 && level != levels[i]) switches++;
+			levels[i] = level;
+		}
+		selectSeconds += secondsSince(start);
+
+		for (size_t i = 0; i < locals.size(); i++) {
+			if (nodeMeshes[i] < 0) continue;
+			const LodMesh& mesh = meshes[nodeMeshes[i]];
+			glm::vec4 viewCenter = view * worlds[i] * glm::vec4(mesh.center, 1.0f);
+			float screenRadius = mesh.radius * pixelsPerUnit / std::max(-viewCenter.z, 0.1f);
+			unsigned int level = selectMeshLod(screenRadius, switchRadii, (unsigned int)mesh.chain.levels.size(), levelsNoHysteresis[i], 0.0f);
+			if (frame > 0 && level != levelsNoHysteresis[i]) switchesNoHysteresis++;
+			levelsNoHysteresis[i] = level;
+
+			fullTriangles += mesh.chain.levels[0].indexCount / 3;
+			lodTriangles += mesh.chain.levels[levels[i]].indexCount / 3;
+			levelNodes[levels[i]]++;
+		}
+	}
+
+	unsigned long long nodeFrames = levelNodes[0] + levelNodes[1] + levelNodes[2] + levelNodes[3];
+	printf("%d rigs, %lu nodes, %d frames\n", rigCount, (unsigned long)locals.size(), frames);
+	printf("  full detail      %10.0f triangles/frame\n", (double)fullTriangles / frames);
+	printf("  levels of detail %10.0f triangles/frame  (%.1f%% fewer)\n", (double)lodTriangles / frames,
+		fullTriangles ? 100.0 * (1.0 - (double)lodTriangles / fullTriangles) : 0.0);
+	printf("  nodes per level  %.1f%% / %.1f%% / %.1f%% / %.1f%%\n", 100.0 * levelNodes[0] / nodeFrames, 100.0 * levelNodes[1] / nodeFrames,
+		100.0 * levelNodes[2] / nodeFrames, 100.0 * levelNodes[3] / nodeFrames);
+	printf("  level changes    %8.1f/frame with %.0f%% hysteresis, %.1f/frame without\n", (double)switches / frames, hysteresis * 100.0f,
+		(double)switchesNoHysteresis / frames);
+	printf("  selection        %8.3f ms/frame\n", selectSeconds * 1000.0 / frames);
+	return 0;
+}
+
+// Vertex cache ordering : ACMR and ATVR before and after, for the scene's meshes and for a grid
+// of 255x255 quads whose triangles come shuffled, as large meshes often do out of exporters
+static int benchVertexCache(int argc, char** argv) {
+	const char* source = argc > 0 ? argv[0] : "rig.scene.json";
+
+	Scene scene;
+	if (!loadScene(source, scene)) return 1;
+
+	struct CacheMesh {
+		std::string name;
+		std::vector<unsigned short> indices;
+		size_t vertexCount;
+	};
+	std::vector<CacheMesh> meshes;
+	for (const SceneMesh& sceneMesh : scene.meshes) {
+		std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
+		CacheMesh mesh;
+		if (!loadOBJ(sceneMesh.path.c_str(), vertices, normals)) return 1;
+		indexVBO(vertices, normals, mesh.indices, indexedVertices, indexedNormals);
+		mesh.name = sceneMesh.path;
+		mesh.vertexCount = indexedVertices.size();
+		meshes.push_back(mesh);
+	}
+
+	const int side = 256;
+	CacheMesh grid;
+	grid.name = "shuffled grid";
+	grid.vertexCount = side * side;
+	std::vector<unsigned int> quads((side - 1) * (side - 1));
+	for (size_t i = 0; i < quads.size(); i++) quads[i] = (unsigned int)i;
+	unsigned int seed = 1;
+	for (size_t i = quads.size() - 1; i > 0; i--) {
+		seed = seed * 1664525u + 1013904223u;
+		std::swap(quads[i], quads[(seed >> 8) % (i + 1)]);
+	}
+	for (unsigned int quad : quads) {
+		unsigned short a = (unsigned short)(quad / (side - 1) * side + quad % (side - 1));
+		unsigned short b = a + 1, c = a + side, d = a + side + 1;
+		unsigned short corners[6] = { a, c, b, b, c, d };
+		grid.indices.insert(grid.indices.end(), corners, corners + 6);
+	}
+	meshes.push_back(grid);
+
+	printf("%-22s %7s  %-20s %-20s %-20s %8s\n", "mesh", "tris", "ACMR 16 before/after", "ACMR 32 before/after", "ATVR 16 before/after", "time");
+	for (CacheMesh& mesh : meshes) {
+		float acmrBefore, atvrBefore, acmr32Before, atvr32Before;
+		analyzeVertexCache(&mesh.indices[0], mesh.indices.size(), mesh.vertexCount, 16, acmrBefore, atvrBefore);
+		analyzeVertexCache(&mesh.indices[0], mesh.indices.size(), mesh.vertexCount, 32, acmr32Before, atvr32Before);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<unsigned short> order;
+		optimizeVertexCache(mesh.indices, mesh.vertexCount);
+		optimizeVertexFetch(mesh.indices, mesh.vertexCount, order);
+		double seconds = secondsSince(start);
+
+		float acmr, atvr, acmr32, atvr32;
+		analyzeVertexCache(&mesh.indices[0], mesh.indices.size(), order.size(), 16, acmr, atvr);
+		analyzeVertexCache(&mesh.indices[0], mesh.indices.size(), order.size(), 32, acmr32, atvr32);
+		printf("%-22s %7lu  %6.3f / %6.3f     %6.3f / %6.3f     %6.3f / %6.3f     %6.2f ms\n", mesh.name.c_str(), (unsigned long)(mesh.indices.size() / 3),
+			acmrBefore, acmr, acmr32Before, acmr32, atvrBefore, atvr, seconds * 1000.0);
+	}
+	return 0;
+}
+
+// Mesh import : loadOBJ and indexVBO against loadAssImp, stage by stage, for the scene's meshes
+// or the given files. Both end with the indexed arrays the mesh registry uploads.
+static int benchImport(int argc, char** argv) {
+#ifndef USE_ASSIMP
+	(void)argc;
+	(void)argv;
+	printf("Built without Assimp (USE_ASSIMP)\n");
+	return 1;
+#else
+	std::vector<std::string> paths;
+	for (int i = 0; i < argc; i++) paths.push_back(argv[i]);
+	if (paths.empty()) {
+		Scene scene;
+		if (!loadScene("rig.scene.json", scene)) return 1;
+		for (const SceneMesh& mesh : scene.meshes) paths.push_back(mesh.path);
+	}
+	const int repeats = 20;
+
+	for (const std::string& path : paths) {
+		std::vector<unsigned short> indices;
+		std::vector<glm::vec3> indexedVertices, indexedNormals;
+		printf("%s\n", path.c_str());
+
+		// The hand-written loader only reads .obj
+		if (path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0) {
+			double loadSeconds = 0.0, indexSeconds = 0.0;
+			for (int r = 0; r < repeats; r++) {
+				std::vector<glm::vec3> vertices, normals;
+				indices.clear();
+				indexedVertices.clear();
+				indexedNormals.clear();
+				auto start = std::chrono::high_resolution_clock::now();
+				if (!loadOBJ(path.c_str(), vertices, normals)) return 1;
+				loadSeconds += secondsSince(start);
+				start = std::chrono::high_resolution_clock::now();
+				indexVBO(vertices, normals, indices, indexedVertices, indexedNormals);
+				indexSeconds += secondsSince(start);
+			}
+			printf("  loadOBJ + indexVBO  parse %7.3f ms  index %7.3f ms                   total %7.3f ms  %6lu vertices %6lu triangles\n",
+				loadSeconds * 1000.0 / repeats, indexSeconds * 1000.0 / repeats, (loadSeconds + indexSeconds) * 1000.0 / repeats,
+				(unsigned long)indexedVertices.size(), (unsigned long)(indices.size() / 3));
+		}
+
+		AssImpTimings total = { 0.0, 0.0, 0.0 };
+		for (int r = 0; r < repeats; r++) {
+			AssImpTimings timings;
+			if (!loadAssImp(path.c_str(), indices, indexedVertices, indexedNormals, &timings)) return 1;
+			total.read += timings.read;
+			total.postProcess += timings.postProcess;
+			total.convert += timings.convert;
+		}
+		printf("  loadAssImp          read  %7.3f ms  post  %7.3f ms  convert %7.3f ms  total %7.3f ms  %6lu vertices %6lu triangles\n",
+			total.read * 1000.0 / repeats, total.postProcess * 1000.0 / repeats, total.convert * 1000.0 / repeats,
+			(total.read + total.postProcess + total.convert) * 1000.0 / repeats,
+			(unsigned long)indexedVertices.size(), (unsigned long)(indices.size() / 3));
+	}
+	return 0;
+#endif
+}
+
+// The first rig of a scene, for the collision and planning benchmarks : convex hulls of its
+// meshes, its joints, and the pairs of links left to test from its rest pose
+struct BenchArm {
+	Scene scene;
+	std::vector<ConvexHull> hulls;
+	std::vector<std::string> linkNames;
+	JointChain chain;
+	CollisionRig collision;
+};
+
+static bool loadBenchArm(const char* source, BenchArm& arm) {
+	if (!loadScene(source, arm.scene)) return false;
+	if (arm.scene.rigs.empty()) {
+		printf("%s : no rigs\n", source);
+		return false;
+	}
+	const SceneRig& rig = arm.scene.rigs[arm.scene.instances.empty() ? 0 : arm.scene.instances[0].rig];
+	int linkCount = (int)rig.nodes.size();
+	if (linkCount > MaxCollisionLinks) {
+		printf("%s : rigs of more than %d nodes aren't supported\n", source, MaxCollisionLinks);
+		return false;
+	}
+
+	arm.hulls.resize(arm.scene.meshes.size());
+	for (size_t m = 0; m < arm.scene.meshes.size(); m++) {
+		const char* path = arm.scene.meshes[m].path.c_str();
+		std::vector<glm::vec3> vertices, normals;
+		if (!loadOBJ(path, vertices, normals)) return false;
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!buildConvexHull(vertices, arm.hulls[m])) {
+			printf("%s : flat, no hull\n", path);
+			return false;
+		}
+		printf("%-22s %6lu points  %4lu hull vertices  %6.3f ms\n", path, (unsigned long)vertices.size(),
+			(unsigned long)arm.hulls[m].vertices.size(), secondsSince(start) * 1000.0);
+	}
+
+	std::vector<glm::mat4> bases(linkCount);
+	std::vector<int> parents(linkCount);
+	std::vector<glm::vec3> axes(linkCount);
+	std::vector<float> minAngles(linkCount), maxAngles(linkCount);
+	std::vector<const ConvexHull*> linkHulls(linkCount);
+	for (int n = 0; n < linkCount; n++) {
+		const SceneRigNode& node = rig.nodes[n];
+		arm.linkNames.push_back(node.name);
+		bases[n] = glm::translate(glm::mat4(1.0f), node.offset);
+		parents[n] = node.parent;
+		axes[n] = node.jointed ? node.axis : glm::vec3(0.0f);
+		minAngles[n] = glm::radians(node.minAngle);
+		maxAngles[n] = glm::radians(node.maxAngle);
+		linkHulls[n] = node.mesh >= 0 ? &arm.hulls[node.mesh] : NULL;
+	}
+	initJointChain(arm.chain, &bases[0], &parents[0], &axes[0], &minAngles[0], &maxAngles[0], linkCount);
+
+	std::vector<float> rest(arm.chain.jointCount(), 0.0f);
+	std::vector<glm::mat4> restWorlds(linkCount);
+	forwardKinematics(arm.chain, rest.data(), &restWorlds[0]);
+	initCollisionRig(arm.collision, &linkHulls[0], &parents[0], linkCount, &restWorlds[0], 0.0f);
+	return true;
+}
+
+// Random angles within the joint limits
+static void randomPose(const JointChain& chain, float* angles) {
+	for (int j = 0; j < chain.jointCount(); j++) {
+		angles[j] = chain.minAngles[j] + (chain.maxAngles[j] - chain.minAngles[j]) * rand() / (float)RAND_MAX;
+	}
+}
+
+// Self-collision queries over random poses of the first rig of the scene, within its joint
+// limits : the bounding volume hierarchy against testing every pair, which must agree
+static int benchCollision(int argc, char** argv) {
+	const char* source = argc > 0 ? argv[0] : "rig.scene.json";
+	int poseCount = argc > 1 ? atoi(argv[1]) : 100000;
+	const int repeats = 5;
+
+	BenchArm arm;
+	if (!loadBenchArm(source, arm)) return 1;
+	const CollisionRig& collision = arm.collision;
+	int linkCount = arm.chain.linkCount;
+	int testedPairs = 0;
+	for (int a = 0; a < linkCount; a++) {
+		for (int b = a + 1; b < linkCount; b++) {
+			if (collision.pairIgnored[a * linkCount + b]) continue;
+			printf("  tested : %s - %s\n", arm.linkNames[a].c_str(), arm.linkNames[b].c_str());
+			testedPairs++;
+		}
+		if (collision.hulls[a] && !collision.groundIgnored[a]) printf("  tested : %s - ground\n", arm.linkNames[a].c_str());
+	}
+
+	std::vector<glm::mat4> worlds((size_t)poseCount * linkCount);
+	std::vector<float> angles(arm.chain.jointCount());
+	srand(1);
+	for (int p = 0; p < poseCount; p++) {
+		randomPose(arm.chain, angles.data());
+		forwardKinematics(arm.chain, angles.data(), &worlds[(size_t)p * linkCount]);
+	}
+
+	std::vector<char> bvhResults(poseCount), pairResults(poseCount);
+	double bvhSeconds = 1e30, pairSeconds = 1e30;
+	for (int r = 0; r < repeats; r++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int p = 0; p < poseCount; p++) {
+			bvhResults[p] = findSelfCollision(collision, &worlds[(size_t)p * linkCount]);
+		}
+		bvhSeconds = std::min(bvhSeconds, secondsSince(start));
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int p = 0; p < poseCount; p++) {
+			const glm::mat4* pose = &worlds[(size_t)p * linkCount];
+			bool colliding = false;
+			for (int a = 0; a < linkCount && !colliding; a++) {
+				const ConvexHull* hull = collision.hulls[a];
+				if (!hull) continue;
+				if (!collision.groundIgnored[a] && convexHullBottom(*hull, pose[a]) < collision.groundHeight) colliding = true;
+				for (int b = a + 1; b < linkCount && !colliding; b++) {
+					if (collision.pairIgnored[a * linkCount + b]) continue;
+					colliding = convexHullsIntersect(*hull, pose[a], *collision.hulls[b], pose[b]);
+				}
+			}
+			pairResults[p] = colliding;
+		}
+		pairSeconds = std::min(pairSeconds, secondsSince(start));
+	}
+
+	int collisions = 0, disagreements = 0;
+	for (int p = 0; p < poseCount; p++) {
+		collisions += bvhResults[p];
+		disagreements += bvhResults[p] != pairResults[p];
+	}
+	printf("%d poses, %d link pairs tested, %.1f%% colliding\n", poseCount, testedPairs, 100.0 * collisions / poseCount);
+	printf("  every pair, GJK  %7.3f us per pose\n", pairSeconds * 1e6 / poseCount);
+	printf("  BVH, then GJK    %7.3f us per pose\n", bvhSeconds * 1e6 / poseCount);
+	printf("  %d disagreements\n", disagreements);
+	return disagreements == 0 ? 0 : 1;
+}
+
+// RRT-Connect over a fixed suite of collision free start and goal poses, on 1 to 8 threads :
+// plans per second, and path lengths against the straight line.
+// Links block each other, so some pairs have no solution ; those cost the whole sample
+// budget and are timed apart. Plans must not depend on the thread count.
+static int benchPlanner(int argc, char** argv) {
+	const char* source = argc > 0 ? argv[0] : "rig.scene.json";
+	int pairCount = argc > 1 ? atoi(argv[1]) : 200;
+
+	BenchArm arm;
+	if (!loadBenchArm(source, arm)) return 1;
+	int dof = arm.chain.jointCount();
+	std::vector<glm::mat4> worlds(arm.chain.linkCount);
+	std::vector<float> poses;
+	std::vector<float> angles(dof);
+	srand(7);
+	while ((int)poses.size() < 2 * pairCount * dof) {
+		randomPose(arm.chain, angles.data());
+		forwardKinematics(arm.chain, angles.data(), &worlds[0]);
+		if (!findSelfCollision(arm.collision, &worlds[0])) poses.insert(poses.end(), angles.begin(), angles.end());
+	}
+
+	MotionPlannerSettings settings;
+	unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+	printf("%d start and goal pairs, %d joints, %u hardware threads, at most %d samples per plan\n", pairCount, dof,
+		hardwareThreads, settings.maxSamples);
+	printf("  %-7s %7s %8s %9s %9s %9s %9s %8s %8s %9s\n", "threads", "solved", "plans/s", "ms/plan", "ms/fail",
+		"samples", "checks", "length", "straight", "waypoints");
+	std::vector<float> firstLengths;
+	bool deterministic = true;
+	const unsigned int threadCounts[] = { 1, 2, 4, 8 };
+	for (unsigned int threads : threadCounts) {
+		initJobSystem(threads);
+		std::vector<float> lengths;
+		double solvedSeconds = 0.0, failedSeconds = 0.0, samples = 0.0, checks = 0.0, straight = 0.0, length = 0.0, waypoints = 0.0;
+		int solved = 0;
+		for (int p = 0; p < pairCount; p++) {
+			const float* from = &poses[(size_t)(2 * p) * dof];
+			const float* to = from + dof;
+			std::vector<float> path;
+			MotionPlanStats stats;
+			settings.seed = p + 1;
+			bool found = planMotion(arm.chain, arm.collision, from, to, settings, path, &stats);
+			lengths.push_back(stats.pathLength);
+			if (!found) {
+				failedSeconds += stats.seconds;
+				continue;
+			}
+			solved++;
+			solvedSeconds += stats.seconds;
+			samples += stats.samples;
+			checks += stats.collisionChecks;
+			length += stats.pathLength;
+			waypoints += path.size() / dof;
+			float direct = 0.0f;
+			for (int j = 0; j < dof; j++) direct += (to[j] - from[j]) * (to[j] - from[j]);
+			straight += sqrtf(direct);
+		}
+		if (firstLengths.empty()) firstLengths = lengths;
+		else deterministic = deterministic && lengths == firstLengths;
+		int failed = pairCount - solved;
+		solved = std::max(solved, 1);
+		printf("  %-7u %6.1f%% %8.1f %9.3f %9.3f %9.1f %9.1f %8.3f %8.3f %9.2f\n", threads, 100.0 * (pairCount - failed) / pairCount,
+			solved / solvedSeconds, solvedSeconds * 1000.0 / solved, failed ? failedSeconds * 1000.0 / failed : 0.0,
+			samples / solved, checks / solved, length / solved, straight / solved, waypoints / solved);
+	}
+	printf("  means over the solved pairs, lengths in joint space radians ; %s across thread counts\n",
+		deterministic ? "identical plans" : "plans DIFFER");
+
+	// The app's budget : how many plans fit, and how far past it the slowest runs
+	initJobSystem(hardwareThreads);
+	settings.maxSeconds = 0.05;
+	int solved = 0, outOfTime = 0;
+	double slowest = 0.0;
+	for (int p = 0; p < pairCount; p++) {
+		const float* from = &poses[(size_t)(2 * p) * dof];
+		std::vector<float> path;
+		MotionPlanStats stats;
+		settings.seed = p + 1;
+		if (planMotion(arm.chain, arm.collision, from, from + dof, settings, path, &stats)) solved++;
+		if (stats.outOfTime) outOfTime++;
+		slowest = std::max(slowest, stats.seconds);
+	}
+	cleanupJobSystem();
+	printf("  within %.0f ms on %u threads : %.1f%% solved, %d out of time, slowest %.3f ms\n", settings.maxSeconds * 1000.0,
+		hardwareThreads, 100.0 * solved / pairCount, outOfTime, slowest * 1000.0);
+	return deterministic ? 0 : 1;
+}
+
+// Pen tip positions of random poses of the first rig of the scene : forwardKinematics() over
+// the whole chain against the batched kernels, on 1 to 8 threads
+static int benchKinematics(int argc, char** argv) {
+	const char* source = argc > 0 ? argv[0] : "rig.scene.json";
+	size_t poseCount = argc > 1 ? (size_t)atoi(argv[1]) : 1 << 20;
+	const int repeats = 5;
+
+	BenchArm arm;
+	if (!loadBenchArm(source, arm)) return 1;
+	const SceneRig& rig = arm.scene.rigs[arm.scene.instances.empty() ? 0 : arm.scene.instances[0].rig];
+	int pen = findRigNode(rig, "pen");
+	if (pen < 0) {
+		printf("%s : no \"pen\" node\n", source);
+		return 1;
+	}
+	const glm::vec3 tipPoint(0.0f, 0.5f, 0.0f);
+	TipKinematics kinematics;
+	initTipKinematics(kinematics, arm.chain, pen, tipPoint);
+
+	int dof = arm.chain.jointCount();
+	std::vector<float> angles((size_t)dof * poseCount), pose(dof);
+	srand(5);
+	for (size_t i = 0; i < poseCount; i++) {
+		randomPose(arm.chain, pose.data());
+		for (int j = 0; j < dof; j++) angles[j * poseCount + i] = pose[j];
+	}
+
+	std::vector<float> reference(3 * poseCount);
+	std::vector<glm::mat4> worlds(arm.chain.linkCount);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < poseCount; i++) {
+		for (int j = 0; j < dof; j++) pose[j] = angles[j * poseCount + i];
+		forwardKinematics(arm.chain, pose.data(), &worlds[0]);
+		glm::vec4 tip = worlds[pen] * glm::vec4(tipPoint, 1.0f);
+		for (int r = 0; r < 3; r++) reference[r * poseCount + i] = tip[r];
+	}
+	double chainSeconds = secondsSince(start);
+
+	TipPosePath best = bestTipPosePath();
+	printf("%lu poses, %d joints, %lu on the path to the pen ; %s path\n", (unsigned long)poseCount, dof,
+		(unsigned long)kinematics.joints.size(), best == TipPoseAvx2 ? "AVX2" : "scalar");
+	printf("  forwardKinematics        %8.3f ms  %8.1f M poses/s\n", chainSeconds * 1000.0, poseCount / chainSeconds * 1e-6);
+
+	std::vector<float> positions(3 * poseCount), rotations(9 * poseCount), firstPositions;
+	const TipPosePath paths[] = { TipPoseScalar, TipPoseAvx2 };
+	const char* pathNames[] = { "scalar", "AVX2" };
+	float worst = 0.0f;
+	bool identical = true;
+	for (TipPosePath path : paths) {
+		if (path > best) continue;
+		start = std::chrono::high_resolution_clock::now();
+		for (int r = 0; r < repeats; r++)
+			tipPosesBatch(kinematics, &angles[0], poseCount, &positions[0], &rotations[0], path);
+		double seconds = secondsSince(start) / repeats;
+		printf("  batch, %-6s            %8.3f ms  %8.1f M poses/s  (%.1fx)\n", pathNames[path], seconds * 1000.0,
+			poseCount / seconds * 1e-6, chainSeconds / seconds);
+		for (size_t i = 0; i < positions.size(); i++) worst = std::max(worst, fabsf(positions[i] - reference[i]));
+
+		firstPositions = positions;
+		const unsigned int threadCounts[] = { 1, 2, 4, 8 };
+		for (unsigned int threads : threadCounts) {
+			initJobSystem(threads);
+			start = std::chrono::high_resolution_clock::now();
+			for (int r = 0; r < repeats; r++)
+				tipPosesBatchParallel(kinematics, &angles[0], poseCount, &positions[0], &rotations[0], path);
+			seconds = secondsSince(start) / repeats;
+			printf("  batch, %-6s %u threads  %8.3f ms  %8.1f M poses/s\n", pathNames[path], threads, seconds * 1000.0,
+				poseCount / seconds * 1e-6);
+			identical = identical && positions == firstPositions;
+		}
+		cleanupJobSystem();
+	}
+	printf("  max distance to forwardKinematics %g ; threaded results %s\n", worst, identical ? "identical" : "DIFFER");
+	return identical ? 0 : 1;
+}
+
+struct SlerpJob {
+	const quat* from;
+	const quat* to;
+	const float* t;
+	quat* out;
+};
+
+static void runSlerpJob(void* data, size_t begin, size_t end) {
+	SlerpJob* job = (SlerpJob*)data;
+	SlerpBatch(job->from + begin, job->to + begin, job->t + begin, job->out + begin, end - begin);
+}
+
+// Link rotations of many rigs blended by slerp, then joint space splines sampled for each rig
+static int benchInterpolation(int argc, char** argv) {
+	size_t rigCount = argc > 0 ? (size_t)atoi(argv[0]) : 4096;
+	const size_t linksPerRig = 6;
+	const int repeats = 50;
+
+	size_t count = rigCount * linksPerRig;
+	std::vector<quat> from(count), to(count), reference(count), scalar(count), batched(count), parallel(count);
+	std::vector<float> t(count);
+	srand(11);
+	for (size_t i = 0; i < count; i++) {
+		from[i] = glm::normalize(quat(rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f,
+			rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f));
+		to[i] = glm::normalize(quat(rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f,
+			rand() / (float)RAND_MAX - 0.5f, rand() / (float)RAND_MAX - 0.5f));
+		t[i] = rand() / (float)RAND_MAX;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		for (size_t i = 0; i < count; i++) reference[i] = glm::slerp(from[i], glm::dot(from[i], to[i]) < 0.0f ? -to[i] : to[i], t[i]);
+	double glmSeconds = secondsSince(start) / repeats;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		for (size_t i = 0; i < count; i++) scalar[i] = FastSlerp(from[i], to[i], t[i]);
+	double scalarSeconds = secondsSince(start) / repeats;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		SlerpBatch(&from[0], &to[0], &t[0], &batched[0], count);
+	double batchSeconds = secondsSince(start) / repeats;
+
+	unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+	initJobSystem(threads);
+	SlerpJob job = { &from[0], &to[0], &t[0], &parallel[0] };
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		parallelFor(count, 1024, runSlerpJob, &job);
+	double parallelSeconds = secondsSince(start) / repeats;
+
+	float slerpError = 0.0f;
+	bool identical = true;
+	for (size_t i = 0; i < count; i++) {
+		for (int k = 0; k < 4; k++) slerpError = std::max(slerpError, fabsf(batched[i][k] - reference[i][k]));
+		identical = identical && batched[i] == parallel[i];
+	}
+
+	printf("%lu rigs, %lu link rotations\n", (unsigned long)rigCount, (unsigned long)count);
+	printf("  glm::slerp               %8.3f ms  %8.1f M/s\n", glmSeconds * 1000.0, count / glmSeconds * 1e-6);
+	printf("  FastSlerp                %8.3f ms  %8.1f M/s\n", scalarSeconds * 1000.0, count / scalarSeconds * 1e-6);
+	printf("  SlerpBatch               %8.3f ms  %8.1f M/s  (%.2fx glm)\n", batchSeconds * 1000.0,
+		count / batchSeconds * 1e-6, glmSeconds / batchSeconds);
+	printf("  SlerpBatch, %2u threads   %8.3f ms  %8.1f M/s\n", threads, parallelSeconds * 1000.0, count / parallelSeconds * 1e-6);
+	printf("  max difference to glm::slerp %g ; threaded results %s\n", slerpError, identical ? "identical" : "DIFFER");
+
+	// A trajectory of random waypoints per rig, sampled once per frame at 60 Hz
+	const int dof = 4, waypoints = 5;
+	const float maxJointSpeed = glm::radians(90.0f);
+	std::vector<JointTrajectory> trajectories(rigCount);
+	for (size_t r = 0; r < rigCount; r++) {
+		std::vector<float> path(dof * waypoints);
+		for (float& angle : path) angle = (rand() / (float)RAND_MAX - 0.5f) * 3.0f;
+		timeParameterize(path, dof, maxJointSpeed, trajectories[r]);
+	}
+	std::vector<float> angles(rigCount * dof), previous(rigCount * dof);
+	const float frame = 1.0f / 60.0f;
+	int frames = 0;
+	double splineSeconds = 0.0;
+	float fastest = 0.0f;
+	for (bool moving = true; moving; frames++) {
+		previous = angles;
+		moving = false;
+		start = std::chrono::high_resolution_clock::now();
+		for (size_t r = 0; r < rigCount; r++)
+			moving = sampleTrajectory(trajectories[r], frames * frame, &angles[r * dof]) || moving;
+		splineSeconds += secondsSince(start);
+		if (frames > 0)
+			for (size_t i = 0; i < angles.size(); i++) fastest = std::max(fastest, fabsf(angles[i] - previous[i]) / frame);
+	}
+	printf("  joint splines, %d joints  %8.3f ms per frame  %8.1f M joint angles/s over %d frames\n", dof,
+		splineSeconds * 1000.0 / frames, (double)frames * rigCount * dof / splineSeconds * 1e-6, frames);
+	printf("  fastest joint %.1f degrees/s, for at most %.1f\n", glm::degrees(fastest), glm::degrees(maxJointSpeed));
+	cleanupJobSystem();
+	return identical ? 0 : 1;
+}
+
+// Cost of a profiler scope, and the nesting of btQuickprof samples (BT_PROFILE, as used
+// inside Bullet) under the profiler's scopes. Without a GL context, CPU times only.
+static int benchProfiler(int argc, char** argv) {
+	int frames = argc > 0 ? atoi(argv[0]) : 200;
+	const int scopesPerFrame = 1000;
+
+	initProfiler();
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int f = 0; f < frames; f++) {
+		beginProfilerFrame();
+		for (int s = 0; s < scopesPerFrame; s++) {
+			PROFILE_SCOPE("scope");
+		}
+		{
+			PROFILE_SCOPE("outer");
+			{
+				BT_PROFILE("bullet");
+				{
+					BT_PROFILE("inner");
+				}
+			}
+			{
+				BT_PROFILE("bullet");
+			}
+		}
+		endProfilerFrame();
+	}
+	double seconds = secondsSince(start);
+
+	// Over the frames kept in the history : "bullet" twice per "outer", "inner" once
+	unsigned int keptFrames = profileScopeCalls("Frame");
+	unsigned int outer = profileScopeCalls("Frame/outer");
+	unsigned int bullet = profileScopeCalls("Frame/outer/bullet");
+	unsigned int inner = profileScopeCalls("Frame/outer/bullet/inner");
+	bool nested = keptFrames > 0 && outer == keptFrames && bullet == 2 * outer && inner == outer &&
+		profileScopeCalls("Frame/scope") == keptFrames * scopesPerFrame;
+	cleanupProfiler();
+
+	printf("%d frames of %d scopes, the last %u kept\n", frames, scopesPerFrame, keptFrames);
+	printf("  %.1f ns per scope, begin to end\n", seconds * 1e9 / ((double)frames * scopesPerFrame));
+	printf("  btQuickprof samples per frame : %.2f under outer, %.2f under them ; %s\n", keptFrames ? (double)bullet / keptFrames : 0.0,
+		keptFrames ? (double)inner / keptFrames : 0.0, nested ? "nested as expected" : "NOT NESTED");
+	return nested ? 0 : 1;
+}
+
+struct Benchmark {
+	const char* name;
+	const char* usage;
+	int (*run)(int argc, char** argv);
+};
+
+static const Benchmark benchmarks[] = {
+	{ "mipmaps", "[image files...]  stb_image decode and CPU mip chain generation", benchMipmaps },
+	{ "transforms", "[rig count]  hierarchy and MVP updates, scalar glm against the batched SIMD kernels", benchTransforms },
+	{ "hierarchy", "[rig count]  work stealing job system scaling of the hierarchy and MVP updates", benchHierarchy },
+	{ "rigid", "[rig count]  hierarchy pass in dual quaternions against mat4, and drift under incremental turns", benchRigid },
+	{ "scene", "[scene.json] [rig count]  scene file parsing, instancing and shared mesh loading", benchScene },
+	{ "vcache", "[scene.json]  vertex cache and fetch ordering, ACMR and ATVR before and after", benchVertexCache },
+	{ "import", "[mesh files...]  loadOBJ and indexVBO against loadAssImp, stage by stage", benchImport },
+	{ "lod", "[scene.json] [rig count]  mesh simplification, and triangles saved by levels of detail over a fly-by", benchLod },
+	{ "collision", "[scene.json] [pose count]  self-collision queries over random poses, with and without the BVH", benchCollision },
+	{ "planner", "[scene.json] [pair count]  RRT-Connect plans per second and path lengths, on 1 to 8 threads", benchPlanner },
+	{ "kinematics", "[scene.json] [pose count]  pen tip forward kinematics, per pose against the SoA batch, scalar and AVX2", benchKinematics },
+	{ "interpolation", "[rig count]  quaternion slerp, glm against the SSE batch, and joint spline sampling per frame", benchInterpolation },
+	{ "profiler", "[frame count]  cost of a profiler scope, and btQuickprof samples nesting under the scopes", benchProfiler },
+};
+
+int main(int argc, char** argv) {
+	if (argc >= 2) {
+		for (const Benchmark& benchmark : benchmarks) {
+			if (strcmp(argv[1], benchmark.name) == 0) return benchmark.run(argc - 2, argv + 2);
+		}
+	}
+
+	printf("Usage : %s <benchmark> [arguments]\n", argv[0]);
+	for (const Benchmark& benchmark : benchmarks) {
+		printf("  %-12s %s\n", benchmark.name, benchmark.usage);
+	}
+	return 1;
+}
@@ -0,0 +1,111 @@
+// Compares a captured frame against a golden image, for the headless regression runs.
+// Exits with 0 when the images match within tolerance, 1 when they differ, 2 on errors.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include <common/image.hpp>
+
+int main(int argc, char** argv) {
+	int tolerance = 2;               // per channel, or on luma with --perceptual
+	double maxDifferentPercent = 0.1;
+	bool perceptual = false;
+	const char* diffPath = NULL;
+	const char* paths[2] = { NULL, NULL };
+	int pathCount = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) tolerance = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--max-different") == 0 && i + 1 < argc) maxDifferentPercent = atof(argv[++i]);
+		else if (strcmp(argv[i], "--perceptual") == 0) perceptual = true;
+		else if (strcmp(argv[i], "--diff") == 0 && i + 1 < argc) diffPath = argv[++i];
+		else if (pathCount < 2) paths[pathCount++] = argv[i];
+	}
+	if (pathCount != 2) {
+		printf("Usage : %s [--tolerance T] [--max-different percent] [--perceptual] [--diff diff.png] image.png golden.png\n", argv[0]);
+		printf("  --perceptual compares the luma of 2x2 averaged pixels, which ignores single pixel\n");
+		printf("  rasterization differences between drivers (e.g. llvmpipe against a GPU)\n");
+		return 2;
+	}
+
+	int width[2], height[2];
+	unsigned char* pixels[2];
+	for (int i = 0; i < 2; i++) {
+		pixels[i] = loadImageRGBA(paths[i], width[i], height[i], false);
+		if (pixels[i] == NULL) return 2;
+	}
+	if (width[0] != width[1] || height[0] != height[1]) {
+		printf("%s : %dx%d, but %s is %dx%d\n", paths[0], width[0], height[0], paths[1], width[1], height[1]);
+		return 1;
+	}
+
+	// With --perceptual, compare the first mip level instead of the full images
+	MipChain chains[2];
+	const unsigned char* compared[2] = { pixels[0], pixels[1] };
+	int w = width[0], h = height[0];
+	if (perceptual && w > 1 && h > 1) {
+		for (int i = 0; i < 2; i++) {
+			buildMipChain(pixels[i], width[i], height[i], chains[i]);
+			compared[i] = &chains[i].pixels[chains[i].levels[1].offset];
+		}
+		w = chains[0].levels[1].width;
+		h = chains[0].levels[1].height;
+	}
+
+	// Per pixel error : largest channel difference, or luma difference (Rec. 601 weights)
+	size_t pixelCount = (size_t)w * h;
+	std::vector<unsigned char> errors(pixelCount);
+	double squaredError = 0.0;
+	int maxError = 0;
+	size_t differentPixels = 0;
+	for (size_t p = 0; p < pixelCount; p++) {
+		const unsigned char* a = compared[0] + p * 4;
+		const unsigned char* b = compared[1] + p * 4;
+		int error = 0;
+		if (perceptual) {
+			double lumaA = 0.299 * a[0] + 0.587 * a[1] + 0.114 * a[2];
+			double lumaB = 0.299 * b[0] + 0.587 * b[1] + 0.114 * b[2];
+			error = (int)(fabs(lumaA - lumaB) + 0.5);
+		}
+		else {
+			for (int c = 0; c < 3; c++) error = std::max(error, abs(a[c] - b[c]));
+		}
+		for (int c = 0; c < 3; c++) squaredError += (double)(a[c] - b[c]) * (a[c] - b[c]);
+		errors[p] = (unsigned char)error;
+		maxError = std::max(maxError, error);
+		if (error > tolerance) differentPixels++;
+	}
+
+	double mse = squaredError / (pixelCount * 3);
+	double psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+	double differentPercent = 100.0 * differentPixels / pixelCount;
+	bool match = differentPercent <= maxDifferentPercent;
+
+	printf("%s : %s, max error %d, PSNR %.2f dB, %lu pixels (%.3f%%) over tolerance %d%s\n", paths[0],
+		match ? "match" : "DIFFERENT", maxError, psnr, (unsigned long)differentPixels, differentPercent, tolerance,
+		perceptual ? " (perceptual)" : "");
+
+	// Heat map : grey copy of the golden image, with out of tolerance pixels in red
+	if (diffPath != NULL) {
+		std::vector<unsigned char> diff(pixelCount * 4);
+		for (size_t p = 0; p < pixelCount; p++) {
+			const unsigned char* g = compared[1] + p * 4;
+			unsigned char grey = (unsigned char)((g[0] + g[1] + g[2]) / 12);
+			bool over = errors[p] > tolerance;
+			diff[p * 4 + 0] = over ? (unsigned char)std::min(255, 128 + errors[p] * 4) : grey;
+			diff[p * 4 + 1] = over ? 0 : grey;
+			diff[p * 4 + 2] = over ? 0 : grey;
+			diff[p * 4 + 3] = 255;
+		}
+		savePNG(diffPath, &diff[0], w, h, false, false);
+	}
+
+	freeImage(pixels[0]);
+	freeImage(pixels[1]);
+	return match ? 0 : 1;
+}
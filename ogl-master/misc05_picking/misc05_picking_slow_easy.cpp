@@ -1,10 +1,15 @@
 // Include standard headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
 #include <vector>
 #include <array>
 #include <stack>   
 #include <sstream>
+#include <iomanip>
+#include <algorithm>
 // Include GLEW
 #include <GL/glew.h>
 // Include GLFW
@@ -14,12 +19,27 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <glm/gtx/dual_quaternion.hpp>
 using namespace glm;
 
 #include <common/shader.hpp>
 #include <common/controls.hpp>
 #include <common/objloader.hpp>
 #include <common/vboindexer.hpp>
+#include <common/filewatch.hpp>
+#include <common/texturestream.hpp>
+#include <common/text2D.hpp>
+#include <common/profiler.hpp>
+#include <common/framecapture.hpp>
+#include <common/jobsystem.hpp>
+#include <common/scene.hpp>
+#include <common/meshregistry.hpp>
+#include <common/meshlod.hpp>
+#include <common/glstate.hpp>
+#include <common/transformbatch.hpp>
+#include <common/selfcollision.hpp>
+#include <common/motionplanner.hpp>
+#include <common/kinematicsbatch.hpp>
 
 const int window_width = 1024, window_height = 768;
 
@@ -49,33 +69,103 @@ typedef struct Vertex {
 struct Node {
 	glm::mat4 localTransform;
 	glm::mat4 globalTransform;
-	GLuint VAO;
-	GLsizei numIndices;
+	int mesh = -1;	// handle from the mesh registry, -1 for none
 	std::vector<Node*> children;
 	bool isSelected = false;
+	int flatIndex = -1;	// into the flattened hierarchy below
+	int material = 0;	// into scene.materials
+	glm::vec3 jointAxis;	// joint description from the scene file
+	float minAngle, maxAngle;
+	float jointAngle = 0.0f;	// radians, turned by the keyboard and planned motions
+	unsigned int lod = 0;	// level of detail drawn, from selectNodeLods()
 
 	void addChild(Node* child) {
 		children.push_back(child);
 	}
 };
 
-void updateTransforms(Node* node, const glm::mat4& parentTransform) {
-	node->globalTransform = parentTransform * node->localTransform;
-
+// Every rig instance of the scene, one root each
+std::vector<Node> sceneNodes;
+std::vector<Node*> sceneRoots;
+
+// The hierarchy flattened parents first, for the batched SIMD matrix kernels. Each root
+// starts a subtree that the job system may update on its own thread.
+std::vector<Node*> flatNodes;
+std::vector<int> flatParents;
+std::vector<size_t> flatSubtreeStarts;
+std::vector<glm::mat4> flatLocals;
+std::vector<glm::mat4> flatWorlds;
+std::vector<glm::mat4> flatMVPs;
+
+// --rigid or F6 run the hierarchy pass in unit dual quaternions, half the size of matrices,
+// and only turn the worlds back into matrices for drawing. The locals that changed since
+// the last pass are orthonormalized on the way in, so no shear or scale builds up in them.
+bool rigidTransforms = false;
+std::vector<glm::dualquat> flatRigidLocals;
+std::vector<glm::dualquat> flatRigidWorlds;
+bool flatRigidLocalsCurrent = false;	// with flatLocals
+
+void flattenHierarchy(Node* node, int parent) {
+	node->flatIndex = (int)flatNodes.size();
+	if (parent < 0) {
+		flatSubtreeStarts.push_back(flatNodes.size());
+	}
+	flatNodes.push_back(node);
+	flatParents.push_back(parent);
 	for (Node* child : node->children) {
-		updateTransforms(child, node->globalTransform);
+		flattenHierarchy(child, node->flatIndex);
+	}
+}
+
+void updateTransforms(void) {
+	PROFILE_SCOPE("updateTransforms");
+	if (flatNodes.empty()) {
+		for (Node* root : sceneRoots) {
+			flattenHierarchy(root, -1);
+		}
+		flatLocals.resize(flatNodes.size());
+		flatWorlds.resize(flatNodes.size());
+		flatMVPs.resize(flatNodes.size());
+	}
+
+	if (rigidTransforms) {
+		flatRigidLocals.resize(flatNodes.size());
+		flatRigidWorlds.resize(flatNodes.size());
+		for (size_t i = 0; i < flatNodes.size(); i++) {
+			if (flatRigidLocalsCurrent && flatNodes[i]->localTransform == flatLocals[i]) continue;
+			flatRigidLocals[i] = rigidFromMatrix(flatNodes[i]->localTransform);
+			flatLocals[i] = flatNodes[i]->localTransform = matrixFromRigid(flatRigidLocals[i]);
+		}
+		flatRigidLocalsCurrent = true;
+		composeByParentsParallel(&flatRigidLocals[0], &flatParents[0], flatNodes.size(), &flatSubtreeStarts[0],
+			flatSubtreeStarts.size(), glm::dualquat(glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.0f)), &flatRigidWorlds[0]);
+		matricesFromRigidParallel(&flatRigidWorlds[0], flatNodes.size(), &flatWorlds[0]);
+	}
+	else {
+		for (size_t i = 0; i < flatNodes.size(); i++) {
+			flatLocals[i] = flatNodes[i]->localTransform;
+		}
+		flatRigidLocalsCurrent = false;
+		multiplyByParentsParallel(&flatLocals[0], &flatParents[0], flatNodes.size(),
+			&flatSubtreeStarts[0], flatSubtreeStarts.size(), glm::mat4(1.0f), &flatWorlds[0]);
+	}
+	for (size_t i = 0; i < flatNodes.size(); i++) {
+		flatNodes[i]->globalTransform = flatWorlds[i];
 	}
 }
 
 // function prototypes
 int initWindow(void);
-void initOpenGL(void);
+int initOpenGL(void);
 void createVAOs(Vertex[], GLushort[], int);
-void loadObject(char*, glm::vec4, Vertex*&, GLushort*&, int);
-void createObjects(void);
+bool createObjects(void);
+void getUniformLocations(void);
+void reloadChangedShaders(void);
 void pickObject(void);
+void updateScene(void);
 void renderScene(void);
 void cleanup(void);
+int runHeadless(void);
 static void keyCallback(GLFWwindow*, int, int, int, int);
 static void mouseCallback(GLFWwindow*, int, int, int);
 
@@ -88,8 +178,82 @@ glm::mat4 gViewMatrix;
 GLuint gPickedIndex = -1;
 std::string gMessage;
 
-GLuint programID;
+// Specialized builds of StandardShading, selected per draw instead of branching on uniforms
+enum StandardVariant {
+	UNLIT_VARIANT,
+	LIT_VARIANT,
+	LIT_SELECTED_VARIANT,
+	LIT_MULTIDRAW_VARIANT,	// model matrices from the instance attributes of a multi-draw
+	LIT_SELECTED_MULTIDRAW_VARIANT,
+	NumStandardVariants
+};
+
+const int NumLights = 2;
+
+struct ShaderVariant {
+	std::string defines;
+	GLuint programID = 0;
+	GLuint pendingProgramID = 0;	// hot-reloaded build waiting to link
+
+	GLint MatrixID;
+	GLint ModelMatrixID;
+	GLint ViewMatrixID;
+	GLint ProjMatrixID;
+	GLint lightPosID;
+	GLint lightDiffuseID;
+	GLint lightAmbientID;
+	GLint lightSpecularID;
+	GLint materialDiffuseID;
+	GLint materialAmbientID;
+	GLint materialSpecularID;
+	GLint materialShininessID;
+	GLint viewPositionID;
+};
+
+ShaderVariant standardVariants[NumStandardVariants];
+
 GLuint pickingProgramID;
+const char* pickingDefines = "#define PICKING\n";
+
+// Shader hot-reload : the old program stays bound until its replacement has linked
+const char* standardVertexShader = "StandardShading.vertexshader";
+const char* standardFragmentShader = "StandardShading.fragmentshader";
+const char* pickingVertexShader = "Picking.vertexshader";
+const char* pickingFragmentShader = "Picking.fragmentshader";
+GLuint pendingPickingProgramID = 0;
+std::vector<int> standardShaderWatches;
+std::vector<int> pickingShaderWatches;
+bool standardShadersChanged = false;
+bool pickingShadersChanged = false;
+
+// Texel bytes uploaded per frame by the texture streamer
+const size_t textureUploadBudget = 4 * 1024 * 1024;
+
+// Profiler HUD, only available when its font is present. F1 toggles it,
+// F11 writes per scope percentiles, F12 writes a trace.
+const char* hudFontPath = "Holstein.DDS";
+const char* profilerReportPath = "profile_report.csv";
+const char* profilerTracePath = "profile_trace.json";
+const int hudTextSize = 12;
+bool hudAvailable = false;
+bool showProfilerHUD = true;
+
+// Headless mode (--headless --frames N) : an invisible window, a scripted session rendered
+// into an offscreen framebuffer, and frame time statistics written to frameStatsPath.
+// Without a display, run it under Xvfb ; Mesa's llvmpipe does the rendering.
+bool headless = false;
+int headlessFrames = 600;
+const int headlessWarmupFrames = 10;	// shader builds and texture uploads, not timed
+const float scriptedDeltaTime = 1.0f / 60.0f;
+const char* frameStatsPath = "frame_stats.txt";
+// --capture 30,60,90 writes those frames of the script (warm-up included) as
+// <captureDirectory>/frame_0030.png, ... for image regression tests
+std::vector<int> captureFrames;
+const char* captureDirectory = ".";
+std::string captureImagePath;	// set while renderScene() draws a frame to capture
+GLuint offscreenFramebufferID = 0;
+GLuint offscreenColorBufferID = 0;
+GLuint offscreenDepthBufferID = 0;
 
 bool cameraSelected = false;
 bool penSelected = false;
@@ -112,58 +276,117 @@ float t = 0.0f;
 float stylusLength = 1.2f;
 glm::vec3 gravity(0.0f, -9.81f, 0.0f);
 
-glm::vec3 lightPos1 = glm::vec3(-2.0f, 5.0f, 5.0f);
-glm::vec3 lightDiffuseColor1 = glm::vec3(1.0f, 0.6f, 0.6f);
-glm::vec3 lightAmbientColor1 = glm::vec3(0.2f, 0.2f, 0.2f);
-glm::vec3 lightSpecularColor1 = glm::vec3(0.8f, 0.8f, 0.8f);
-
-glm::vec3 lightPos2 = glm::vec3(2.0f, 5.0f, -5.0f);
-glm::vec3 lightDiffuseColor2 = glm::vec3(0.2f, 0.8f, 1.0f);
-glm::vec3 lightAmbientColor2 = glm::vec3(0.2f, 0.2f, 0.2f);
-glm::vec3 lightSpecularColor2 = glm::vec3(0.8f, 0.8f, 0.8f);
-
-glm::vec3 objectColor = glm::vec3(1.0f, 0.5f, 0.5f);
+// Meshes, materials, lights and rigs, from the scene file (--scene)
+const char* sceneFile = "rig.scene.json";
+Scene scene;
+
+// Lights not given by the scene file keep these
+glm::vec3 lightPositions[NumLights] = { glm::vec3(-2.0f, 5.0f, 5.0f), glm::vec3(2.0f, 5.0f, -5.0f) };
+glm::vec3 lightDiffuseColors[NumLights] = { glm::vec3(1.0f, 0.6f, 0.6f), glm::vec3(0.2f, 0.8f, 1.0f) };
+glm::vec3 lightAmbientColors[NumLights] = { glm::vec3(0.2f, 0.2f, 0.2f), glm::vec3(0.2f, 0.2f, 0.2f) };
+glm::vec3 lightSpecularColors[NumLights] = { glm::vec3(0.8f, 0.8f, 0.8f), glm::vec3(0.8f, 0.8f, 0.8f) };
+
+// Scene nodes in submission order : sorted by shader variant, then vertex array, then
+// material, then mesh, so that consecutive draws change as little state as possible
+struct DrawItem {
+	uint64_t key;
+	int flatIndex;
+	bool operator<(const DrawItem& other) const { return key < other.key; }
+};
+std::vector<DrawItem> drawList;
+
+// Widths of the sort key fields, from the lowest bits up. Meshes and materials that don't fit
+// are refused when the scene loads, see fitsSortKey().
+const int SortKeyLodBits = 4;
+const int SortKeyMeshBits = 20;
+const int SortKeyMaterialBits = 24;
+const int SortKeyVertexArrayBits = 8;
+const int SortKeyVariantBits = 8;
+static_assert(SortKeyLodBits + SortKeyMeshBits + SortKeyMaterialBits + SortKeyVertexArrayBits + SortKeyVariantBits <= 64,
+	"the draw sort key fields don't fit in 64 bits");
+
+bool fitsSortKey(int value, int bits) { return value >= 0 && (uint64_t)value < (uint64_t)1 << bits; }
+
+uint64_t drawSortKey(int variant, int vertexArray, int material, int mesh, unsigned int lod) {
+	uint64_t key = (uint64_t)variant;
+	key = key << SortKeyVertexArrayBits | (uint64_t)vertexArray;
+	key = key << SortKeyMaterialBits | (uint64_t)material;
+	key = key << SortKeyMeshBits | (uint64_t)mesh;
+	return key << SortKeyLodBits | lod;
+}
 
-glm::vec3 materialDiffuse = objectColor;
-glm::vec3 materialAmbient = objectColor;
-glm::vec3 materialSpecular = materialDiffuse * 0.1f;
-float materialShininess = 20.0f;
+// A registry mesh whose index or levels of detail don't fit the sort key is refused
+bool meshFitsSortKey(int mesh, const char* path) {
+	if (fitsSortKey(mesh, SortKeyMeshBits) && fitsSortKey((int)meshLodCount(mesh) - 1, SortKeyLodBits)) return true;
+	printf("%s : mesh %d with %u levels of detail is past the draw sort key's %d and %d bits\n", path, mesh,
+		meshLodCount(mesh), SortKeyMeshBits, SortKeyLodBits);
+	return false;
+}
 
-const GLuint NumObjects = 11;	// CHANGE AS YOU ADD NEW OBJECTS
+// Axes and grid. The meshes live in the mesh registry.
+const GLuint NumObjects = 2;
 GLuint VertexArrayId[NumObjects];
 GLuint VertexBufferId[NumObjects];
 GLuint IndexBufferId[NumObjects];
-GLuint GridArrayId[NumObjects];
-GLuint GridBufferId[NumObjects];
 
 // TL
 size_t VertexBufferSize[NumObjects];
 size_t IndexBufferSize[NumObjects];
-size_t NumIdcs[NumObjects];
 size_t NumVerts[NumObjects];
 
-GLuint MatrixID;
-GLuint ModelMatrixID;
-GLuint ViewMatrixID;
-GLuint ProjMatrixID;
+// GPU memory for meshes ; unused ones beyond it are evicted (--mesh-budget, in MB).
+// F10 prints the resident bytes of each mesh.
+size_t meshBudgetBytes = 64 * 1024 * 1024;
+std::vector<int> sceneMeshes;	// registry handle of each scene mesh
+
+// Submit the scene nodes with one glMultiDrawElementsIndirect per shader variant and material
+// when the driver supports it. --no-multidraw or F9 go back to one draw per node.
+bool useMultiDraw = true;
+std::vector<std::vector<int>> multiDrawBatches;	// flat node indices, per lit variant and material
+unsigned int frameDrawCalls = 0;	// mesh draw calls of the last frame
+unsigned int frameGLCallsIssued = 0;	// state changes of the last frame that reached GL,
+unsigned int frameGLCallsSkipped = 0;	// and those the glstate shadows found redundant
+
+// Level of detail of each node, from the radius in pixels of its bounding sphere : under each
+// of these radii the next coarser level takes over, once 10% past it either way so that
+// levels don't flicker. --no-lod or F8 draw every node at full detail.
+bool useLods = true;
+const float lodSwitchRadii[] = { 40.0f, 20.0f, 10.0f };
+const float lodHysteresis = 0.1f;
+size_t frameTriangles = 0;	// triangles drawn in the last frame
+
+// Keyboard moves and inverse kinematics steps that would make the rig under control hit
+// itself or the ground are undone. --no-collision or F7 let it through anything.
+bool checkCollisions = true;
+std::vector<ConvexHull> sceneHulls;	// of each scene mesh
+std::vector<Node*> armLinks;	// nodes of the first instance, in rig order
+CollisionRig armCollision;
+
+// When the projectile lands, the pen's target pose comes from inverse kinematics in the joint
+// space of the rig under control, and a collision free motion to it from the planner. The
+// motion plays back with each joint turning at most armJointSpeed.
+JointChain armChain;
+JointTrajectory armMotion;
+MotionPlannerSettings armPlannerSettings;
+const double armPlanSeconds = 0.05;	// the plan runs within the frame the projectile lands in
+const float armJointSpeed = glm::radians(90.0f);	// per second
+float armMotionTime = 0.0f;
+bool armMoving = false;
+
+// When inverse kinematics gets stuck away from the target, it starts again from the nearest
+// of ikRestartPoses random poses, whose pen positions come from the batched kinematics
+TipKinematics armTip;
+const size_t ikRestartPoses = 4096;
+
 GLuint PickingMatrixID;
 GLuint pickingColorID;
-GLuint LightID;
-
-GLuint baseObjectID = 2;
-GLuint topObjectID = 3;
-GLuint arm1ObjectID = 4;
-GLuint jointObjectID = 5;
-GLuint arm2ObjectID = 6;
-GLuint penObjectID = 7;
-GLuint projectileObjectID = 8;
 
 // Declare global objects
 const size_t CoordVertsCount = 6;
 Vertex CoordVerts[CoordVertsCount];
 
 const size_t gridSize = 44;
-Vertex* gridVerts = new Vertex[gridSize];
+Vertex gridVerts[gridSize];
 
 float horizAngle = 3.14f / 2.0f;
 float vertAngle = 0.0f;
@@ -180,21 +403,14 @@ float topRotationSpeed = 5.0f;
 bool arm2Selected = false;
 float arm2RotationAngle = 0.0f;
 
-// make graph hierarchy
-Node* baseNode = new Node();
-Node* topNode = new Node();
-Node* arm1Node = new Node();
-Node* jointNode = new Node();
-Node* arm2Node = new Node();
-Node* penNode = new Node();
+// Parts of the first rig of the scene, which the keyboard and the script control
+Node* baseNode = NULL;
+Node* topNode = NULL;
+Node* arm1Node = NULL;
+Node* jointNode = NULL;
+Node* arm2Node = NULL;
+Node* penNode = NULL;
 Node* projectileNode = new Node();
-
-glm::vec3 basePosition = glm::vec3(0.0f, 0.0f, 0.0f);
-glm::vec3 topOffset = glm::vec3(0.0f, 1.0f, 0.0f);
-glm::vec3 arm1Offset = glm::vec3(0.0f, 0.2f, 0.0f);
-glm::vec3 jointOffset = glm::vec3(0.0f, 0.0f, -1.2f);
-glm::vec3 arm2Offset = glm::vec3(0.0f, 0.0f, -0.03f);
-glm::vec3 penOffset = glm::vec3(0.0f, -0.7f, 0.71f);
 glm::vec3 projectileOffset = glm::vec3(0.0f, 0.0f, 0.9f);
 
 int initWindow(void) {
@@ -208,6 +424,7 @@ int initWindow(void) {
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, headless ? GL_FALSE : GL_TRUE);
 
 	// Open a window and create its OpenGL context
 	window = glfwCreateWindow(window_width, window_height, "Bosworth,Kinnara (71760772)", NULL, NULL);
@@ -233,7 +450,7 @@ int initWindow(void) {
 	return 0;
 }
 
-void initOpenGL(void) {
+int initOpenGL(void) {
 	// Enable depth test
 	glEnable(GL_DEPTH_TEST);
 	// Accept fragment if it closer to the camera than the former one
@@ -251,29 +468,126 @@ void initOpenGL(void) {
 		glm::vec3(0.0, 1.0, 0.0));	// up
 
 	// Create and compile our GLSL program from the shaders
-	programID = LoadShaders("StandardShading.vertexshader", "StandardShading.fragmentshader");
-	pickingProgramID = LoadShaders("Picking.vertexshader", "Picking.fragmentshader");
-
-	// Get a handle for our "MVP" uniform
-	MatrixID = glGetUniformLocation(programID, "MVP");
-	ModelMatrixID = glGetUniformLocation(programID, "M");
-	ViewMatrixID = glGetUniformLocation(programID, "V");
-	ProjMatrixID = glGetUniformLocation(programID, "P");
+	for (int i = 0; i < NumStandardVariants; i++) {
+		ShaderVariant& variant = standardVariants[i];
+		std::ostringstream defines;
+		if (i != UNLIT_VARIANT) defines << "#define USE_LIGHTING\n";
+		if (i == LIT_SELECTED_VARIANT || i == LIT_SELECTED_MULTIDRAW_VARIANT) defines << "#define IS_SELECTED\n";
+		if (i == LIT_MULTIDRAW_VARIANT || i == LIT_SELECTED_MULTIDRAW_VARIANT) defines << "#define MULTI_DRAW\n";
+		defines << "#define NUM_LIGHTS " << NumLights << "\n";
+		variant.defines = defines.str();
+		variant.programID = GetShaderPermutation(standardVertexShader, standardFragmentShader, variant.defines.c_str());
+	}
+	pickingProgramID = GetShaderPermutation(pickingVertexShader, pickingFragmentShader, pickingDefines);
+	getUniformLocations();
 
-	PickingMatrixID = glGetUniformLocation(pickingProgramID, "MVP");
-	// Get a handle for our "pickingColorID" uniform
-	pickingColorID = glGetUniformLocation(pickingProgramID, "PickingColor");
-	// Get a handle for our "LightPosition" uniform
-	LightID = glGetUniformLocation(programID, "LightPosition_worldspace");
+	// Recompile the shaders whenever their sources are saved
+	standardShaderWatches.push_back(addFileWatch(standardVertexShader));
+	standardShaderWatches.push_back(addFileWatch(standardFragmentShader));
+	pickingShaderWatches.push_back(addFileWatch(pickingVertexShader));
+	pickingShaderWatches.push_back(addFileWatch(pickingFragmentShader));
 
 	// Define objects
-	createObjects();
+	if (!createObjects()) return -1;
+	useMultiDraw = useMultiDraw && isMeshMultiDrawSupported();
+	printf("Scene nodes submitted with %s\n", useMultiDraw ? "glMultiDrawElementsIndirect" : "one draw call each");
 
 	// ATTN: create VAOs for each of the newly created objects here:
 	VertexBufferSize[0] = sizeof(CoordVerts);
 	NumVerts[0] = CoordVertsCount;
 
 	createVAOs(CoordVerts, NULL, 0);
+
+	initProfiler();
+	initJobSystem();
+
+	// The font streams in over the first frames ; without the file there is no HUD at all
+	FILE* font = fopen(hudFontPath, "rb");
+	if (font != NULL) {
+		fclose(font);
+		initText2D(streamTexture(hudFontPath));
+		hudAvailable = true;
+	}
+	else {
+		printf("%s not found, the profiler HUD is disabled\n", hudFontPath);
+	}
+	return 0;
+}
+
+void getUniformLocations(void) {
+	for (ShaderVariant& variant : standardVariants) {
+		GLuint program = variant.programID;
+		// Get a handle for our "MVP" uniform
+		variant.MatrixID = glGetUniformLocation(program, "MVP");
+		variant.ModelMatrixID = glGetUniformLocation(program, "M");
+		variant.ViewMatrixID = glGetUniformLocation(program, "V");
+		variant.ProjMatrixID = glGetUniformLocation(program, "P");
+
+		// Lights and material only exist in the lit variants (-1 otherwise, which GL ignores)
+		variant.lightPosID = glGetUniformLocation(program, "lightPos");
+		variant.lightDiffuseID = glGetUniformLocation(program, "lightDiffuse");
+		variant.lightAmbientID = glGetUniformLocation(program, "lightAmbient");
+		variant.lightSpecularID = glGetUniformLocation(program, "lightSpecular");
+		variant.materialDiffuseID = glGetUniformLocation(program, "materialDiffuse");
+		variant.materialAmbientID = glGetUniformLocation(program, "materialAmbient");
+		variant.materialSpecularID = glGetUniformLocation(program, "materialSpecular");
+		variant.materialShininessID = glGetUniformLocation(program, "materialShininess");
+		variant.viewPositionID = glGetUniformLocation(program, "viewPosition");
+	}
+
+	PickingMatrixID = glGetUniformLocation(pickingProgramID, "MVP");
+	// Get a handle for our "pickingColorID" uniform
+	pickingColorID = glGetUniformLocation(pickingProgramID, "PickingColor");
+}
+
+static bool watchesChanged(const std::vector<int>& watches, const std::vector<int>& changed) {
+	for (int id : watches) {
+		if (std::find(changed.begin(), changed.end(), id) != changed.end()) return true;
+	}
+	return false;
+}
+
+// Swap a finished program in place of the current one; a failed build keeps the current one
+static void swapPendingProgram(GLuint& pending, GLuint& current, const char* vertexShader, const char* fragmentShader, const char* defines) {
+	if (pending == 0) return;
+
+	int status = CheckShadersAsync(pending);
+	if (status == 0) return; // still compiling, try again next frame
+
+	if (status > 0) {
+		ReplaceShaderPermutation(vertexShader, fragmentShader, defines, pending);
+		current = pending;
+		invalidateGLState();
+		getUniformLocations();
+		printf("Shader program reloaded\n");
+	}
+	pending = 0;
+}
+
+void reloadChangedShaders(void) {
+	std::vector<int> changed;
+	pollFileWatches(changed);
+	if (watchesChanged(standardShaderWatches, changed)) standardShadersChanged = true;
+	if (watchesChanged(pickingShaderWatches, changed)) pickingShadersChanged = true;
+
+	bool standardBuildsPending = false;
+	for (ShaderVariant& variant : standardVariants) {
+		swapPendingProgram(variant.pendingProgramID, variant.programID, standardVertexShader, standardFragmentShader, variant.defines.c_str());
+		if (variant.pendingProgramID != 0) standardBuildsPending = true;
+	}
+	swapPendingProgram(pendingPickingProgramID, pickingProgramID, pickingVertexShader, pickingFragmentShader, pickingDefines);
+
+	// Saves that land while a build is in flight are picked up once it finishes
+	if (standardShadersChanged && !standardBuildsPending) {
+		for (ShaderVariant& variant : standardVariants) {
+			variant.pendingProgramID = LoadShadersAsync(standardVertexShader, standardFragmentShader, variant.defines.c_str());
+		}
+		standardShadersChanged = false;
+	}
+	if (pickingShadersChanged && pendingPickingProgramID == 0) {
+		pendingPickingProgramID = LoadShadersAsync(pickingVertexShader, pickingFragmentShader, pickingDefines);
+		pickingShadersChanged = false;
+	}
 }
 
 void createVAOs(Vertex Vertices[], unsigned short Indices[], int ObjectId) {
@@ -284,7 +598,7 @@ void createVAOs(Vertex Vertices[], unsigned short Indices[], int ObjectId) {
 
 	// Create Vertex Array Object
 	glGenVertexArrays(1, &VertexArrayId[ObjectId]);
-	glBindVertexArray(VertexArrayId[ObjectId]);
+	bindVertexArray(VertexArrayId[ObjectId]);
 
 	// Create Buffer for vertex data
 	glGenBuffers(1, &VertexBufferId[ObjectId]);
@@ -308,7 +622,7 @@ void createVAOs(Vertex Vertices[], unsigned short Indices[], int ObjectId) {
 	glEnableVertexAttribArray(2);	// normal
 
 	// Disable Vertex Buffer Object 
-	glBindVertexArray(0);
+	bindVertexArray(0);
 
 	ErrorCheckValue = glGetError();
 	if (ErrorCheckValue != GL_NO_ERROR)
@@ -322,41 +636,20 @@ void createVAOs(Vertex Vertices[], unsigned short Indices[], int ObjectId) {
 }
 
 
-void loadObject(char* file, glm::vec4 color, Vertex*& out_Vertices, GLushort*& out_Indices, int ObjectId) {
-	// Read our .obj file
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
+// Vertex positions of a mesh file, for its convex hull
+bool loadMeshPoints(const std::string& path, std::vector<glm::vec3>& points) {
 	std::vector<glm::vec3> normals;
-	bool res = loadOBJ(file, vertices, normals);
-
-	std::vector<GLushort> indices;
-	std::vector<glm::vec3> indexed_vertices;
-	std::vector<glm::vec2> indexed_uvs;
-	std::vector<glm::vec3> indexed_normals;
-	indexVBO(vertices, normals, indices, indexed_vertices, indexed_normals);
-
-	const size_t vertCount = indexed_vertices.size();
-	const size_t idxCount = indices.size();
-
-	// populate output arrays
-	out_Vertices = new Vertex[vertCount];
-	for (int i = 0; i < vertCount; i++) {
-		out_Vertices[i].SetPosition(&indexed_vertices[i].x);
-		out_Vertices[i].SetNormal(&indexed_normals[i].x);
-		out_Vertices[i].SetColor(&color[0]);
-	}
-	out_Indices = new GLushort[idxCount];
-	for (int i = 0; i < idxCount; i++) {
-		out_Indices[i] = indices[i];
-	}
-
-	// set global variables!!
-	NumIdcs[ObjectId] = idxCount;
-	VertexBufferSize[ObjectId] = sizeof(out_Vertices[0]) * vertCount;
-	IndexBufferSize[ObjectId] = sizeof(GLushort) * idxCount;
+	if (path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0) return loadOBJ(path.c_str(), points, normals);
+#ifdef USE_ASSIMP
+	std::vector<unsigned short> indices;
+	return loadAssImp(path.c_str(), indices, points, normals);
+#else
+	printf("%s : built without Assimp, only .obj meshes can be loaded\n", path.c_str());
+	return false;
+#endif
 }
 
-void createObjects(void) {
+bool createObjects(void) {
 	//-- COORDINATE AXES --//
 	CoordVerts[0] = { { 0.0, 0.0, 0.0, 1.0 }, { 1.0, 0.0, 0.0, 1.0 }, { 0.0, 0.0, 1.0 } };
 	CoordVerts[1] = { { 5.0, 0.0, 0.0, 1.0 }, { 1.0, 0.0, 0.0, 1.0 }, { 0.0, 0.0, 1.0 } };
@@ -379,69 +672,101 @@ void createObjects(void) {
 	NumVerts[1] = gridSize;
 	createVAOs(gridVerts, nullptr, 1);
 
-	//-- .OBJs --//
-
-	Vertex* baseVerts;
-	GLushort* baseIndices;
-	loadObject("../common/Base2.obj", glm::vec4(1.0, 0.0, 0.0, 1.0), baseVerts, baseIndices, baseObjectID);
-	createVAOs(baseVerts, baseIndices, baseObjectID);
-	baseNode->VAO = VertexArrayId[baseObjectID];
-	baseNode->numIndices = NumIdcs[baseObjectID];
-	baseNode->localTransform = glm::translate(glm::mat4(1.0f), basePosition);
-
-	Vertex* topVerts;
-	GLushort* topIndices;
-	loadObject("../common/Top.obj", glm::vec4(1.0, 0.0, 0.0, 1.0), topVerts, topIndices, topObjectID);
-	createVAOs(topVerts, topIndices, topObjectID);
-	topNode->VAO = VertexArrayId[topObjectID];
-	topNode->numIndices = NumIdcs[topObjectID];
-	topNode->localTransform = glm::translate(glm::mat4(1.0f), topOffset);
-
-	Vertex* arm1Verts;
-	GLushort* arm1Indices;
-	loadObject("../common/Arm1.obj", glm::vec4(1.0, 0.0, 0.0, 1.0), arm1Verts, arm1Indices, arm1ObjectID);
-	createVAOs(arm1Verts, arm1Indices, arm1ObjectID);
-	arm1Node->VAO = VertexArrayId[arm1ObjectID];
-	arm1Node->numIndices = NumIdcs[arm1ObjectID];
-	arm1Node->localTransform = glm::translate(glm::mat4(1.0f), arm1Offset);
-
-	Vertex* jointVerts;
-	GLushort* jointIndices;
-	loadObject("../common/Joint.obj", glm::vec4(1.0, 0.0, 0.0, 1.0), jointVerts, jointIndices, jointObjectID);
-	createVAOs(jointVerts, jointIndices, jointObjectID);
-	jointNode->VAO = VertexArrayId[jointObjectID];
-	jointNode->numIndices = NumIdcs[jointObjectID];
-	jointNode->localTransform = glm::translate(glm::mat4(1.0f), jointOffset);
-
-	Vertex* arm2Verts;
-	GLushort* arm2Indices;
-	loadObject("../common/Arm2.obj", glm::vec4(1.0, 0.0, 0.0, 1.0), arm2Verts, arm2Indices, arm2ObjectID);
-	createVAOs(arm2Verts, arm2Indices, arm2ObjectID);
-	arm2Node->VAO = VertexArrayId[arm2ObjectID];
-	arm2Node->numIndices = NumIdcs[arm2ObjectID];
-	arm2Node->localTransform = glm::translate(glm::mat4(1.0f), arm2Offset);
-
-	Vertex* penVerts;
-	GLushort* penIndices;
-	loadObject("../common/Pen.obj", glm::vec4(1.0, 0.0, 0.0, 1.0), penVerts, penIndices, penObjectID);
-	createVAOs(penVerts, penIndices, penObjectID);
-	penNode->VAO = VertexArrayId[penObjectID];
-	penNode->numIndices = NumIdcs[penObjectID];
-	penNode->localTransform = glm::translate(glm::mat4(1.0f), penOffset);
-
-	Vertex* projectileVerts;
-	GLushort* projectileIndices;
-	loadObject("../common/Object.obj", glm::vec4(1.0, 0.0, 0.0, 1.0), projectileVerts, projectileIndices, projectileObjectID);
-	createVAOs(projectileVerts, projectileIndices, projectileObjectID);
-	projectileNode->VAO = VertexArrayId[projectileObjectID];
-	projectileNode->numIndices = NumIdcs[projectileObjectID];
+	//-- PROJECTILE --//
+	initMeshRegistry(meshBudgetBytes);
+	projectileNode->mesh = acquireMesh("../common/Object.obj", glm::vec4(1.0, 0.0, 0.0, 1.0));
+	if (projectileNode->mesh < 0 || !meshFitsSortKey(projectileNode->mesh, "../common/Object.obj")) return false;
 	projectileNode->localTransform = glm::translate(glm::mat4(1.0f), projectileOffset);
 
-	baseNode->addChild(topNode);
-	topNode->addChild(arm1Node);
-	arm1Node->addChild(jointNode);
-	jointNode->addChild(arm2Node);
-	arm2Node->addChild(penNode);
+	//-- SCENE --//
+	double loadStart = glfwGetTime();
+	if (!loadScene(sceneFile, scene)) return false;
+	if (scene.instances.empty()) {
+		printf("%s : no rig instances\n", sceneFile);
+		return false;
+	}
+	if (!fitsSortKey((int)scene.materials.size() - 1, SortKeyMaterialBits)) {
+		printf("%s : %d materials, past the draw sort key's %d bits\n", sceneFile, (int)scene.materials.size(), SortKeyMaterialBits);
+		return false;
+	}
+
+	// Each mesh once, however many instances use it. The scene holds one reference to each.
+	for (const SceneMesh& mesh : scene.meshes) {
+		sceneMeshes.push_back(acquireMesh(mesh.path.c_str(), mesh.color));
+		if (sceneMeshes.back() < 0 || !meshFitsSortKey(sceneMeshes.back(), mesh.path.c_str())) return false;
+	}
+
+	for (size_t i = 0; i < scene.lights.size() && i < NumLights; i++) {
+		lightPositions[i] = scene.lights[i].position;
+		lightDiffuseColors[i] = scene.lights[i].diffuse;
+		lightAmbientColors[i] = scene.lights[i].ambient;
+		lightSpecularColors[i] = scene.lights[i].specular;
+	}
+
+	// Nodes of every instance, linked to their parents
+	std::vector<glm::mat4> locals;
+	std::vector<int> parents;
+	std::vector<size_t> instanceStarts;
+	instantiateScene(scene, locals, parents, instanceStarts);
+	sceneNodes.resize(locals.size());
+	for (size_t i = 0; i < scene.instances.size(); i++) {
+		const SceneRig& rig = scene.rigs[scene.instances[i].rig];
+		size_t start = instanceStarts[i];
+		for (size_t n = 0; n < rig.nodes.size(); n++) {
+			const SceneRigNode& description = rig.nodes[n];
+			Node& node = sceneNodes[start + n];
+			node.localTransform = locals[start + n];
+			node.mesh = description.mesh >= 0 ? sceneMeshes[description.mesh] : -1;
+			node.material = description.material;
+			node.jointAxis = description.axis;
+			node.minAngle = description.minAngle;
+			node.maxAngle = description.maxAngle;
+			if (parents[start + n] >= 0) sceneNodes[parents[start + n]].addChild(&node);
+			else sceneRoots.push_back(&node);
+		}
+	}
+	printf("Loaded %s : %d rigs, %d nodes, %d meshes in %.1f ms\n", sceneFile, (int)scene.instances.size(),
+		(int)sceneNodes.size(), (int)scene.meshes.size(), (glfwGetTime() - loadStart) * 1000.0);
+
+	// The first instance is the one under control
+	const SceneRig& rig = scene.rigs[scene.instances[0].rig];
+	const char* partNames[] = { "base", "top", "arm1", "joint", "arm2", "pen" };
+	Node** parts[] = { &baseNode, &topNode, &arm1Node, &jointNode, &arm2Node, &penNode };
+	for (int p = 0; p < 6; p++) {
+		int index = findRigNode(rig, partNames[p]);
+		if (index < 0) {
+			printf("%s : the rig of the first instance has no \"%s\" node\n", sceneFile, partNames[p]);
+			return false;
+		}
+		*parts[p] = &sceneNodes[index];
+	}
+
+	// Its self-collision, with the pairs of links that touch at rest left out
+	double hullStart = glfwGetTime();
+	sceneHulls.resize(scene.meshes.size());
+	for (size_t m = 0; m < scene.meshes.size(); m++) {
+		std::vector<glm::vec3> points;
+		if (!loadMeshPoints(scene.meshes[m].path, points)) return false;
+		if (!buildConvexHull(points, sceneHulls[m])) {
+			printf("%s : flat, no convex hull\n", scene.meshes[m].path.c_str());
+			return false;
+		}
+	}
+	std::vector<const ConvexHull*> linkHulls;
+	std::vector<int> linkParents;
+	std::vector<glm::mat4> restWorlds;
+	for (size_t n = 0; n < rig.nodes.size(); n++) {
+		const SceneRigNode& description = rig.nodes[n];
+		armLinks.push_back(&sceneNodes[instanceStarts[0] + n]);
+		linkHulls.push_back(description.mesh >= 0 ? &sceneHulls[description.mesh] : NULL);
+		linkParents.push_back(description.parent);
+		const glm::mat4& local = locals[instanceStarts[0] + n];
+		restWorlds.push_back(description.parent >= 0 ? restWorlds[description.parent] * local : local);
+	}
+	initCollisionRig(armCollision, &linkHulls[0], &linkParents[0], (int)rig.nodes.size(), &restWorlds[0], 0.0f);
+	armPlannerSettings.maxSeconds = armPlanSeconds;
+	printf("Convex hulls and collision pairs in %.1f ms\n", (glfwGetTime() - hullStart) * 1000.0);
+	return true;
 }
 
 void pickObject(void) {
@@ -449,17 +774,14 @@ void pickObject(void) {
 	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glUseProgram(pickingProgramID);
+	useProgram(pickingProgramID);
 	{
 		glm::mat4 ModelMatrix = glm::mat4(1.0); // TranslationMatrix * RotationMatrix;
 		glm::mat4 MVP = gProjectionMatrix * gViewMatrix * ModelMatrix;
 
 		// Send our transformation to the currently bound shader, in the "MVP" uniform
-		glUniformMatrix4fv(PickingMatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-		glBindVertexArray(0);
+		setUniformMatrix4fv(PickingMatrixID, 1, &MVP[0][0]);
 	}
-	glUseProgram(0);
 
 
 	glFlush();
@@ -501,60 +823,228 @@ void updateCamera() {
 	);
 }
 
-// Render each node in the rig heirarchy
-void renderNode(Node* node) {
-	glm::mat4 mvp = gProjectionMatrix * gViewMatrix * node->globalTransform;
-	glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &mvp[0][0]);
-	glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &node->globalTransform[0][0]);
+// Bind a shader variant ; glstate skips the call when it is already bound
+const ShaderVariant& useVariant(int variant) {
+	useProgram(standardVariants[variant].programID);
+	return standardVariants[variant];
+}
 
-	glUniform1i(glGetUniformLocation(programID, "isSelected"), node->isSelected ? 1 : 0);
+// Upload a scene material to a lit variant. Values already there are skipped by glstate.
+void setMaterial(int variantIndex, int material) {
+	const ShaderVariant& variant = useVariant(variantIndex);
+	const SceneMaterial& m = scene.materials[material];
+	setUniform3f(variant.materialDiffuseID, m.diffuse.x, m.diffuse.y, m.diffuse.z);
+	setUniform3f(variant.materialAmbientID, m.ambient.x, m.ambient.y, m.ambient.z);
+	setUniform3f(variant.materialSpecularID, m.specular.x, m.specular.y, m.specular.z);
+	setUniform1f(variant.materialShininessID, m.shininess);
+}
 
-	glBindVertexArray(node->VAO);
-	glDrawElements(GL_TRIANGLES, node->numIndices, GL_UNSIGNED_SHORT, 0);
-	glBindVertexArray(0);
+// Upload the uniforms shared by every draw of the frame
+void setFrameUniforms(int variantIndex) {
+	const ShaderVariant& variant = useVariant(variantIndex);
 
-	for (Node* child : node->children) {
-		if (child == projectileNode && !projectileLaunched) {
-			continue;
-		}
-		renderNode(child);
+	glm::mat4x4 ModelMatrix = glm::mat4(1.0);
+	setUniformMatrix4fv(variant.ViewMatrixID, 1, &gViewMatrix[0][0]);
+	setUniformMatrix4fv(variant.ProjMatrixID, 1, &gProjectionMatrix[0][0]);
+	setUniformMatrix4fv(variant.ModelMatrixID, 1, &ModelMatrix[0][0]);
+
+	if (variantIndex == UNLIT_VARIANT) return;
+
+	// lights
+	setUniform3fv(variant.lightPosID, NumLights, &lightPositions[0].x);
+	setUniform3fv(variant.lightDiffuseID, NumLights, &lightDiffuseColors[0].x);
+	setUniform3fv(variant.lightAmbientID, NumLights, &lightAmbientColors[0].x);
+	setUniform3fv(variant.lightSpecularID, NumLights, &lightSpecularColors[0].x);
+
+	setUniform3f(variant.viewPositionID, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+}
+
+// Render every scene node with a mesh, one draw each in render state order, with the mesh
+// arena bound
+void renderNodes() {
+	PROFILE_GPU_SCOPE("renderNodes");
+	drawList.clear();
+	for (size_t i = 0; i < flatNodes.size(); i++) {
+		const Node* node = flatNodes[i];
+		if (node->mesh < 0) continue;
+		// Every mesh shares the registry's arena, so the vertex array field is 0 for now ;
+		// meshes kept outside it would give it their own slot.
+		int variantIndex = node->isSelected ? LIT_SELECTED_VARIANT : LIT_VARIANT;
+		int vertexArray = 0;
+		DrawItem item = { drawSortKey(variantIndex, vertexArray, node->material, node->mesh, node->lod), (int)i };
+		drawList.push_back(item);
+	}
+	std::sort(drawList.begin(), drawList.end());
+
+	for (const DrawItem& item : drawList) {
+		const Node* node = flatNodes[item.flatIndex];
+		int variantIndex = node->isSelected ? LIT_SELECTED_VARIANT : LIT_VARIANT;
+		const ShaderVariant& variant = useVariant(variantIndex);
+		setMaterial(variantIndex, node->material);
+
+		setUniformMatrix4fv(variant.MatrixID, 1, &flatMVPs[item.flatIndex][0][0]);
+		setUniformMatrix4fv(variant.ModelMatrixID, 1, &flatWorlds[item.flatIndex][0][0]);
+		drawMesh(node->mesh, node->lod);
 	}
 }
 
-// Move arm to impact point of the projectile
-void adjustArmToTarget(const glm::vec3& impactPoint) {
-	glm::vec3 penTipPos = glm::vec3(penNode->globalTransform[3]);
+// Local transforms and joint angles of the rig under control
+struct ArmPose {
+	std::vector<glm::mat4> locals;
+	std::vector<float> angles;
+	bool operator!=(const ArmPose& other) const { return locals != other.locals || angles != other.angles; }
+};
 
-	float tolerance = 0.01f;
-	for (int i = 0; i < 10; ++i) {
-		penTipPos = glm::vec3(penNode->globalTransform[3]);
-		if (glm::length(impactPoint - penTipPos) < tolerance) break;
+ArmPose armPose() {
+	ArmPose pose;
+	for (const Node* link : armLinks) {
+		pose.locals.push_back(link->localTransform);
+		pose.angles.push_back(link->jointAngle);
+	}
+	return pose;
+}
 
-		glm::vec3 toTarget = impactPoint - penTipPos;
-		glm::vec3 toPen = penTipPos - glm::vec3(arm2Node->globalTransform[3]);
-		glm::vec3 axis = glm::cross(toPen, toTarget);
-		float angle = glm::acos(glm::dot(glm::normalize(toPen), glm::normalize(toTarget)));
+// After a move and updateTransforms() : puts the rig under control back in previousPose when
+// it collides, and returns whether it did
+bool undoCollidingPose(const ArmPose& previousPose) {
+	if (!checkCollisions) return false;
+	PROFILE_SCOPE("findSelfCollision");
+	glm::mat4 worlds[MaxCollisionLinks];
+	for (int i = 0; i < armCollision.linkCount; i++) worlds[i] = flatWorlds[armLinks[i]->flatIndex];
+	int linkA, linkB;
+	if (!findSelfCollision(armCollision, worlds, &linkA, &linkB)) return false;
+
+	const SceneRig& rig = scene.rigs[scene.instances[0].rig];
+	printf("Blocked : %s would hit %s\n", rig.nodes[linkA].name.c_str(), linkB >= 0 ? rig.nodes[linkB].name.c_str() : "the ground");
+	for (size_t i = 0; i < armLinks.size(); i++) {
+		armLinks[i]->localTransform = previousPose.locals[i];
+		armLinks[i]->jointAngle = previousPose.angles[i];
+	}
+	updateTransforms();
+	return true;
+}
 
-		if (glm::length(axis) > 0.001f) {
-			arm2Node->localTransform = glm::rotate(glm::mat4(1.0f), angle, axis) * arm2Node->localTransform;
-			updateTransforms(baseNode, glm::mat4(1.0f));
-		}
+// Turns a joint of the rig under control about its axis, within its limits
+void turnJoint(Node* node, float degrees) {
+	float angle = glm::clamp(node->jointAngle + glm::radians(degrees), glm::radians(node->minAngle), glm::radians(node->maxAngle));
+	node->localTransform = glm::rotate(node->localTransform, angle - node->jointAngle, node->jointAxis);
+	node->jointAngle = angle;
+}
 
-		penTipPos = glm::vec3(penNode->globalTransform[3]);
-		toTarget = impactPoint - penTipPos;
-		toPen = penTipPos - glm::vec3(arm1Node->globalTransform[3]);
-		axis = glm::cross(toPen, toTarget);
-		angle = glm::acos(glm::dot(glm::normalize(toPen), glm::normalize(toTarget)));
+// The joint space of the rig under control, around its current pose : each link's local
+// transform is its base, then the rotation by its joint angle
+void buildArmChain(JointChain& chain) {
+	const SceneRig& rig = scene.rigs[scene.instances[0].rig];
+	size_t linkCount = armLinks.size();
+	std::vector<glm::mat4> bases(linkCount);
+	std::vector<int> parents(linkCount);
+	std::vector<glm::vec3> axes(linkCount);
+	std::vector<float> minAngles(linkCount), maxAngles(linkCount);
+	for (size_t n = 0; n < linkCount; n++) {
+		const Node* link = armLinks[n];
+		bool jointed = rig.nodes[n].jointed;
+		bases[n] = jointed ? link->localTransform * glm::rotate(glm::mat4(1.0f), -link->jointAngle, link->jointAxis) : link->localTransform;
+		parents[n] = rig.nodes[n].parent;
+		axes[n] = jointed ? link->jointAxis : glm::vec3(0.0f);
+		minAngles[n] = glm::radians(link->minAngle);
+		maxAngles[n] = glm::radians(link->maxAngle);
+	}
+	initJointChain(chain, &bases[0], &parents[0], &axes[0], &minAngles[0], &maxAngles[0], (int)linkCount);
+}
 
-		if (glm::length(axis) > 0.001f) {
-			arm1Node->localTransform = glm::rotate(glm::mat4(1.0f), angle, axis) * arm1Node->localTransform;
-			updateTransforms(baseNode, glm::mat4(1.0f));
+// Poses the rig under control along its planned motion
+void updateArmMotion(float deltaTime) {
+	if (!armMoving) return;
+	PROFILE_SCOPE("updateArmMotion");
+	armMotionTime += deltaTime;
+	std::vector<float> angles(armChain.jointCount());
+	armMoving = sampleTrajectory(armMotion, armMotionTime, angles.data());
+	for (int j = 0; j < armChain.jointCount(); j++) {
+		int link = armChain.jointLinks[j];
+		armLinks[link]->localTransform = armChain.bases[link] * glm::rotate(glm::mat4(1.0f), angles[j], armChain.axes[j]);
+		armLinks[link]->jointAngle = angles[j];
+	}
+}
+
+// Angles that bring the pen to target, from angles on, or as close as they could get
+void solveArmInverseKinematics(const glm::vec3& target, float* angles) {
+	PROFILE_SCOPE("solveArmInverseKinematics");
+	const int iterations = 30;
+	const float tolerance = 0.01f;
+	const SceneRig& rig = scene.rigs[scene.instances[0].rig];
+	int pen = findRigNode(rig, "pen");
+	if (solveInverseKinematics(armChain, pen, target, angles, iterations, tolerance)) return;
+
+	int dof = armChain.jointCount();
+	std::vector<float> samples(dof * ikRestartPoses), positions(3 * ikRestartPoses);
+	for (size_t i = 0; i < ikRestartPoses; i++) {
+		for (int j = 0; j < dof; j++) {
+			float t = rand() / (float)RAND_MAX;
+			samples[j * ikRestartPoses + i] = armChain.minAngles[j] + (armChain.maxAngles[j] - armChain.minAngles[j]) * t;
+		}
+	}
+	initTipKinematics(armTip, armChain, pen, glm::vec3(0.0f));
+	tipPosesBatchParallel(armTip, &samples[0], ikRestartPoses, &positions[0], NULL);
+	size_t nearest = 0;
+	float nearestDistance = FLT_MAX;
+	for (size_t i = 0; i < ikRestartPoses; i++) {
+		glm::vec3 position(positions[i], positions[ikRestartPoses + i], positions[2 * ikRestartPoses + i]);
+		float distance = glm::distance(position, target);
+		if (distance < nearestDistance) {
+			nearest = i;
+			nearestDistance = distance;
 		}
 	}
+
+	// Keep whichever of the two ends up closer
+	std::vector<float> restart(dof);
+	for (int j = 0; j < dof; j++) restart[j] = samples[j * ikRestartPoses + nearest];
+	solveInverseKinematics(armChain, pen, target, restart.data(), iterations, tolerance);
+	std::vector<glm::mat4> worlds(armChain.linkCount);
+	forwardKinematics(armChain, angles, &worlds[0]);
+	float stuckDistance = glm::distance(glm::vec3(worlds[pen][3]), target);
+	forwardKinematics(armChain, restart.data(), &worlds[0]);
+	if (glm::distance(glm::vec3(worlds[pen][3]), target) < stuckDistance) std::copy(restart.begin(), restart.end(), angles);
+}
+
+// Plans a collision free motion of the arm that brings the pen to the impact point of the
+// projectile, or as close as the joint limits allow. updateArmMotion() plays it back.
+void adjustArmToTarget(const glm::vec3& impactPoint) {
+	PROFILE_SCOPE("adjustArmToTarget");
+	buildArmChain(armChain);
+	int dof = armChain.jointCount();
+	std::vector<float> start(dof), goal(dof);
+	for (int j = 0; j < dof; j++) start[j] = goal[j] = armLinks[armChain.jointLinks[j]]->jointAngle;
+	solveArmInverseKinematics(impactPoint, goal.data());
+
+	std::vector<float> path;
+	MotionPlanStats stats;
+	if (!checkCollisions) {
+		path = start;
+		path.insert(path.end(), goal.begin(), goal.end());
+	}
+	else if (!planMotion(armChain, armCollision, start.data(), goal.data(), armPlannerSettings, path, &stats)) {
+		printf("No collision free motion to the target (%d samples, %.1f ms%s)\n", stats.samples, stats.seconds * 1000.0,
+			stats.outOfTime ? ", out of time" : "");
+		return;
+	}
+	else {
+		printf("Planned %d waypoints, %.2f radians, in %.1f ms (%d samples, %d poses checked)\n", (int)path.size() / dof,
+			stats.pathLength, stats.seconds * 1000.0, stats.samples, stats.collisionChecks);
+	}
+	timeParameterize(path, dof, armJointSpeed, armMotion);
+	// The splines cut the corners of the planned path : stop at each waypoint when that collides
+	if (checkCollisions && !trajectoryCollisionFree(armChain, armCollision, armMotion, armPlannerSettings.checkResolution)) {
+		printf("Stopping at each waypoint, the smooth motion would collide\n");
+		timeParameterize(path, dof, armJointSpeed, armMotion, true);
+	}
+	armMotionTime = 0.0f;
+	armMoving = true;
 }
 
 // Update position of projectile over time
 void updateProjectile(float deltaTime) {
+	PROFILE_SCOPE("updateProjectile");
 	if (projectileLaunched) {
 		t = std::min(t + deltaTime * 1.5f, 1.0f);
 
@@ -596,85 +1086,145 @@ void launchProjectile() {
 }
 
 
-// Render projectile after launch
+// Every scene node in one indirect multi-draw per variant and material, with the mesh arena bound
+void renderNodesMultiDraw() {
+	PROFILE_GPU_SCOPE("renderNodesMultiDraw");
+	size_t materialCount = scene.materials.size();
+	multiDrawBatches.resize(2 * materialCount);
+	for (std::vector<int>& batch : multiDrawBatches) {
+		batch.clear();
+	}
+	for (size_t i = 0; i < flatNodes.size(); i++) {
+		const Node* node = flatNodes[i];
+		if (node->mesh < 0) continue;
+		multiDrawBatches[(node->isSelected ? materialCount : 0) + node->material].push_back((int)i);
+	}
+
+	for (size_t b = 0; b < multiDrawBatches.size(); b++) {
+		if (multiDrawBatches[b].empty()) continue;
+		int variantIndex = b < materialCount ? LIT_MULTIDRAW_VARIANT : LIT_SELECTED_MULTIDRAW_VARIANT;
+		useVariant(variantIndex);
+		setMaterial(variantIndex, (int)(b % materialCount));
+		for (int i : multiDrawBatches[b]) {
+			queueMeshDraw(flatNodes[i]->mesh, flatWorlds[i], flatNodes[i]->lod);
+		}
+		submitMeshDraws();
+	}
+}
+
+// Render projectile after launch, with the mesh arena bound
 void renderProjectile() {
 	if (projectileLaunched) {
 		glm::mat4 projectileTransform = glm::translate(glm::mat4(1.0f), projectilePosition);
 		glm::mat4 mvp = gProjectionMatrix * gViewMatrix * projectileTransform;
 
-		glUseProgram(programID);
-		glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &mvp[0][0]);
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &projectileTransform[0][0]);
+		const ShaderVariant& variant = useVariant(LIT_VARIANT);
+		setMaterial(LIT_VARIANT, 0);
+		setUniformMatrix4fv(variant.MatrixID, 1, &mvp[0][0]);
+		setUniformMatrix4fv(variant.ModelMatrixID, 1, &projectileTransform[0][0]);
 
-		glBindVertexArray(projectileNode->VAO);
-		glDrawElements(GL_TRIANGLES, projectileNode->numIndices, GL_UNSIGNED_SHORT, 0);
-		glBindVertexArray(0);
+		drawMesh(projectileNode->mesh);
 	}
 }
 
 
+// Pick each node's level of detail from the size of its bounding sphere on screen
+void selectNodeLods(void) {
+	PROFILE_SCOPE("selectNodeLods");
+	float pixelsPerUnit = gProjectionMatrix[1][1] * window_height * 0.5f;	// at a distance of 1
+	for (size_t i = 0; i < flatNodes.size(); i++) {
+		Node* node = flatNodes[i];
+		if (node->mesh < 0) continue;
+		if (!useLods) {
+			node->lod = 0;
+			continue;
+		}
+		glm::vec3 center;
+		float radius;
+		meshBounds(node->mesh, center, radius);
+		glm::vec4 viewCenter = gViewMatrix * flatWorlds[i] * glm::vec4(center, 1.0f);
+		float distance = std::max(-viewCenter.z, 0.1f);
+		node->lod = selectMeshLod(radius * pixelsPerUnit / distance, lodSwitchRadii, meshLodCount(node->mesh), node->lod, lodHysteresis);
+	}
+}
+
+// World and MVP matrices of every node, computed on the job system, and levels of detail,
+// before renderScene()
+void updateScene(void) {
+	PROFILE_SCOPE("updateScene");
+	updateTransforms();
+	multiplyBatchParallel(gProjectionMatrix * gViewMatrix, &flatWorlds[0], flatWorlds.size(), &flatMVPs[0]);
+	selectNodeLods();
+}
+
 void renderScene(void) {
 	// Dark blue background
 	glClearColor(0.0f, 0.0f, 0.2f, 0.0f);
 	// Re-clear the screen for real rendering
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	beginMeshFrame();
 
-	glUseProgram(programID);
-	{
-		glm::vec3 lightPos = glm::vec3(4, 4, 4);
-		glm::mat4x4 ModelMatrix = glm::mat4(1.0);
-		glUniform3f(LightID, lightPos.x, lightPos.y, lightPos.z);
-		glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &gViewMatrix[0][0]);
-		glUniformMatrix4fv(ProjMatrixID, 1, GL_FALSE, &gProjectionMatrix[0][0]);
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
+	// Texture streaming and the HUD bind behind glstate's back
+	invalidateGLBindings();
+	resetGLStateCounters();
 
-		// light 1
-		glUniform3f(glGetUniformLocation(programID, "lightPos1"), lightPos1.x, lightPos1.y, lightPos1.z);
-		glUniform3f(glGetUniformLocation(programID, "lightDiffuse1"), lightDiffuseColor1.x, lightDiffuseColor1.y, lightDiffuseColor1.z);
-		glUniform3f(glGetUniformLocation(programID, "lightAmbient1"), lightAmbientColor1.x, lightAmbientColor1.y, lightAmbientColor1.z);
-		glUniform3f(glGetUniformLocation(programID, "lightSpecular1"), lightSpecularColor1.x, lightSpecularColor1.y, lightSpecularColor1.z);
-
-		// light 2
-		glUniform3f(glGetUniformLocation(programID, "lightPos2"), lightPos2.x, lightPos2.y, lightPos2.z);
-		glUniform3f(glGetUniformLocation(programID, "lightDiffuse2"), lightDiffuseColor2.x, lightDiffuseColor2.y, lightDiffuseColor2.z);
-		glUniform3f(glGetUniformLocation(programID, "lightAmbient2"), lightAmbientColor2.x, lightAmbientColor2.y, lightAmbientColor2.z);
-		glUniform3f(glGetUniformLocation(programID, "lightSpecular2"), lightSpecularColor2.x, lightSpecularColor2.y, lightSpecularColor2.z);
-
-		// material
-		glUniform3f(glGetUniformLocation(programID, "materialDiffuse"), materialDiffuse.x, materialDiffuse.y, materialDiffuse.z);
-		glUniform3f(glGetUniformLocation(programID, "materialAmbient"), materialAmbient.x, materialAmbient.y, materialAmbient.z);
-		glUniform3f(glGetUniformLocation(programID, "materialSpecular"), materialSpecular.x, materialSpecular.y, materialSpecular.z);
-		glUniform1f(glGetUniformLocation(programID, "materialShininess"), materialShininess);
-
-		glUniform3f(glGetUniformLocation(programID, "viewPosition"), cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-		glBindVertexArray(VertexArrayId[0]);
-		glUniform1i(glGetUniformLocation(programID, "useLighting"), false);
-		glDrawArrays(GL_LINES, 0, NumVerts[0]);
-
-		glBindVertexArray(0);
-
-		// draw grid
-		glBindVertexArray(VertexArrayId[1]);
-		glUniform1i(glGetUniformLocation(programID, "useLighting"), false);
-		glDrawArrays(GL_LINES, 0, NumVerts[1]);
+	for (int i = 0; i < NumStandardVariants; i++) {
+		setFrameUniforms(i);
+	}
 
-		glBindVertexArray(0);
+	// draw coordinate axes
+	useVariant(UNLIT_VARIANT);
+	bindVertexArray(VertexArrayId[0]);
+	glDrawArrays(GL_LINES, 0, NumVerts[0]);
 
-		// render nodes
-		updateTransforms(baseNode, glm::mat4(1.0f));
-		glUniform1i(glGetUniformLocation(programID, "useLighting"), true);
-		renderNode(baseNode);
+	// draw grid
+	bindVertexArray(VertexArrayId[1]);
+	glDrawArrays(GL_LINES, 0, NumVerts[1]);
 
-		// render projectile
-		renderProjectile();
+	// render nodes, with the matrices of updateScene(), and the projectile. Every mesh is
+	// in the registry's arena, so its vertex array is bound once for all of them.
+	bindMeshArena();
+	{
+		PROFILE_SCOPE("submitNodes");
+		if (useMultiDraw) {
+			renderNodesMultiDraw();
+		}
+		else {
+			renderNodes();
+		}
+	}
+	renderProjectile();
+	frameDrawCalls = meshDrawCallCount();
+	frameTriangles = meshTriangleCount();
+	frameGLCallsIssued = glStateCallsIssued();
+	frameGLCallsSkipped = glStateCallsSkipped();
+
+	// draw the profiler HUD on top of everything
+	if (hudAvailable && showProfilerHUD && !headless) {
+		PROFILE_GPU_SCOPE("profilerHUD");
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		drawProfilerHUD(10, viewport[3] - 10, hudTextSize);
+		glDisable(GL_DEPTH_TEST);
+		drawText2D();
+		glEnable(GL_DEPTH_TEST);
+	}
 
-		glUseProgram(0);
+	// read the frame back before it is presented
+	if (!captureImagePath.empty()) {
+		captureFrame(captureImagePath.c_str());
 	}
-	glUseProgram(0);
 
 	// Swap buffers
-	glfwSwapBuffers(window);
+	if (headless) {
+		// Nothing to present : wait for the GPU instead, so that frame times include its work
+		PROFILE_GPU_SCOPE("glFinish");
+		glFinish();
+	}
+	else {
+		PROFILE_GPU_SCOPE("glfwSwapBuffers");
+		glfwSwapBuffers(window);
+	}
 	glfwPollEvents();
 }
 
@@ -685,8 +1235,21 @@ void cleanup(void) {
 		glDeleteBuffers(1, &IndexBufferId[i]);
 		glDeleteVertexArrays(1, &VertexArrayId[i]);
 	}
-	glDeleteProgram(programID);
-	glDeleteProgram(pickingProgramID);
+	for (int mesh : sceneMeshes) {
+		releaseMesh(mesh);
+	}
+	releaseMesh(projectileNode->mesh);
+	cleanupMeshRegistry();
+	DeleteShaderPermutations();
+	cleanupFileWatches();
+	cleanupTextureStream();
+	cleanupProfiler();
+	cleanupJobSystem();
+	if (hudAvailable) cleanupText2D();
+	if (!captureFrames.empty()) cleanupFrameCapture();
+	glDeleteFramebuffers(1, &offscreenFramebufferID);
+	glDeleteRenderbuffers(1, &offscreenColorBufferID);
+	glDeleteRenderbuffers(1, &offscreenDepthBufferID);
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
@@ -710,6 +1273,7 @@ void deselectAllParts() {
 // Keyboard events
 static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	if (action == GLFW_PRESS || action == GLFW_REPEAT) {
+		ArmPose previousPose = armPose();
 		switch (key) {
 		case GLFW_KEY_C:
 			deselectAllParts();
@@ -758,7 +1322,7 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 
 			if (baseSelected) baseNode->localTransform = glm::translate(baseNode->localTransform, glm::vec3(-baseMovementSpeed, 0.0f, 0.0f));
 
-			if (topSelected) topNode->localTransform = glm::rotate(topNode->localTransform, glm::radians(-topRotationSpeed), glm::vec3(0.0f, 1.0f, 0.0f));
+			if (topSelected) turnJoint(topNode, -topRotationSpeed);
 
 			if (penSelected) {
 				if (mods & GLFW_MOD_SHIFT) {
@@ -775,7 +1339,7 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 
 			if (baseSelected) baseNode->localTransform = glm::translate(baseNode->localTransform, glm::vec3(baseMovementSpeed, 0.0f, 0.0f));
 
-			if (topSelected) topNode->localTransform = glm::rotate(topNode->localTransform, glm::radians(topRotationSpeed), glm::vec3(0.0f, 1.0f, 0.0f));
+			if (topSelected) turnJoint(topNode, topRotationSpeed);
 
 			if (penSelected) {
 				if (mods & GLFW_MOD_SHIFT) {
@@ -790,22 +1354,22 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 		case GLFW_KEY_UP:
 			if (cameraSelected && vertAngle < glm::radians(89.0f)) vertAngle += cameraSpeed;
 
-			if (penSelected) penNode->localTransform = glm::rotate(penNode->localTransform, glm::radians(5.0f), glm::vec3(1.0f, 0.0f, 0.0f));  // J5 latitude
+			if (penSelected) turnJoint(penNode, 5.0f);  // J5 latitude
 
-			if (arm1Selected) arm1Node->localTransform = glm::rotate(arm1Node->localTransform, glm::radians(5.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // J2 rotation
+			if (arm1Selected) turnJoint(arm1Node, 5.0f); // J2 rotation
 
-			if (arm2Selected) arm2Node->localTransform = glm::rotate(arm2Node->localTransform, glm::radians(5.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // J3 rotation
+			if (arm2Selected) turnJoint(arm2Node, 5.0f); // J3 rotation
 
 			break;
 
 		case GLFW_KEY_DOWN:
 			if (cameraSelected && vertAngle > glm::radians(-89.0f)) vertAngle -= cameraSpeed;
 
-			if (penSelected) penNode->localTransform = glm::rotate(penNode->localTransform, glm::radians(-5.0f), glm::vec3(1.0f, 0.0f, 0.0f));  // J5 latitude
+			if (penSelected) turnJoint(penNode, -5.0f);  // J5 latitude
 
-			if (arm1Selected) arm1Node->localTransform = glm::rotate(arm1Node->localTransform, glm::radians(-5.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // J2 rotation
+			if (arm1Selected) turnJoint(arm1Node, -5.0f); // J2 rotation
 
-			if (arm2Selected) arm2Node->localTransform = glm::rotate(arm2Node->localTransform, glm::radians(-5.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // J3 rotation
+			if (arm2Selected) turnJoint(arm2Node, -5.0f); // J3 rotation
 
 			break;
 
@@ -815,11 +1379,63 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 			}
 			break;
 
+		case GLFW_KEY_F1:
+			if (action == GLFW_PRESS) showProfilerHUD = !showProfilerHUD;
+			break;
+
+		case GLFW_KEY_F6:
+			if (action == GLFW_PRESS) {
+				rigidTransforms = !rigidTransforms;
+				printf("Hierarchy pass in %s\n", rigidTransforms ? "dual quaternions" : "matrices");
+			}
+			break;
+
+		case GLFW_KEY_F7:
+			if (action == GLFW_PRESS) {
+				checkCollisions = !checkCollisions;
+				printf("Self-collision checks %s\n", checkCollisions ? "on" : "off");
+			}
+			break;
+
+		case GLFW_KEY_F8:
+			if (action == GLFW_PRESS) {
+				useLods = !useLods;
+				printf("Levels of detail %s\n", useLods ? "on" : "off");
+			}
+			break;
+
+		case GLFW_KEY_F9:
+			if (action == GLFW_PRESS && isMeshMultiDrawSupported()) {
+				useMultiDraw = !useMultiDraw;
+				printf("Scene nodes submitted with %s\n", useMultiDraw ? "glMultiDrawElementsIndirect" : "one draw call each");
+			}
+			break;
+
+		case GLFW_KEY_F10:
+			if (action == GLFW_PRESS) printMeshRegistry();
+			break;
+
+		case GLFW_KEY_F11:
+			if (action == GLFW_PRESS) writeProfilerReport(profilerReportPath);
+			break;
+
+		case GLFW_KEY_F12:
+			if (action == GLFW_PRESS) writeChromeTrace(profilerTracePath);
+			break;
+
 
 		default:
 			break;
 		}
 
+		// The keyboard takes over from planned motions
+		if (armPose() != previousPose) {
+			armMoving = false;
+			if (checkCollisions) {
+				updateTransforms();
+				undoCollidingPose(previousPose);
+			}
+		}
 		if (cameraSelected) updateCamera();
 	}
 }
@@ -832,7 +1448,168 @@ static void mouseCallback(GLFWwindow* window, int button, int action, int mods)
 	}
 }
 
-int main(void) {
+// Color and depth renderbuffers the size of the window, bound for every later draw
+bool createOffscreenTarget(void) {
+	glGenRenderbuffers(1, &offscreenColorBufferID);
+	glBindRenderbuffer(GL_RENDERBUFFER, offscreenColorBufferID);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, window_width, window_height);
+
+	glGenRenderbuffers(1, &offscreenDepthBufferID);
+	glBindRenderbuffer(GL_RENDERBUFFER, offscreenDepthBufferID);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, window_width, window_height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &offscreenFramebufferID);
+	glBindFramebuffer(GL_FRAMEBUFFER, offscreenFramebufferID);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColorBufferID);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreenDepthBufferID);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Offscreen framebuffer is incomplete\n");
+		return false;
+	}
+	glViewport(0, 0, window_width, window_height);
+	return true;
+}
+
+// Poses the camera and the rig as a function of the frame number only, so that every
+// headless run renders the same images
+void animateScripted(int frame) {
+	float time = frame * scriptedDeltaTime;
+
+	horizAngle = 3.14f / 2.0f + 0.4f * time;
+	vertAngle = glm::radians(25.0f) + glm::radians(10.0f) * sin(0.5f * time);
+	updateCamera();
+
+	// Through turnJoint(), like the keyboard, so that the joints follow the axes and limits of
+	// the scene file
+	Node* joints[] = { topNode, arm1Node, arm2Node, penNode };
+	const float angles[] = { 0.8f * sin(0.7f * time), 0.5f * sin(1.1f * time), 0.6f * sin(1.3f * time + 1.0f), 0.7f * sin(0.9f * time) };
+	for (int j = 0; j < 4; j++) {
+		turnJoint(joints[j], glm::degrees(angles[j] - joints[j]->jointAngle));
+	}
+	updateTransforms();
+
+	// Fire every two seconds
+	if (frame % 120 == 30) launchProjectile();
+}
+
+// Nearest rank percentile of sorted values
+static double percentile(const std::vector<double>& sorted, double p) {
+	size_t rank = (size_t)ceil(p * sorted.size());
+	return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+bool writeFrameStats(std::vector<double> frameMs) {
+	FILE* file = fopen(frameStatsPath, "w");
+	if (file == NULL || frameMs.empty()) {
+		fprintf(stderr, "Could not write frame statistics to %s\n", frameStatsPath);
+		if (file) fclose(file);
+		return false;
+	}
+	std::sort(frameMs.begin(), frameMs.end());
+	double mean = 0.0;
+	for (double ms : frameMs) mean += ms;
+	mean /= frameMs.size();
+
+	fprintf(file, "renderer %s\n", (const char*)glGetString(GL_RENDERER));
+	fprintf(file, "frames %u\n", (unsigned int)frameMs.size());
+	fprintf(file, "mean_ms %.4f\n", mean);
+	fprintf(file, "p50_ms %.4f\n", percentile(frameMs, 0.50));
+	fprintf(file, "p99_ms %.4f\n", percentile(frameMs, 0.99));
+	fprintf(file, "min_ms %.4f\n", frameMs.front());
+	fprintf(file, "max_ms %.4f\n", frameMs.back());
+	fprintf(file, "draw_calls %u\n", frameDrawCalls);
+	fprintf(file, "triangles %lu\n", (unsigned long)frameTriangles);
+	fprintf(file, "gl_calls_issued %u\n", frameGLCallsIssued);
+	fprintf(file, "gl_calls_skipped %u\n", frameGLCallsSkipped);
+	TextureStreamStats streamStats = getTextureStreamStats();
+	fprintf(file, "textures_streamed %u\n", streamStats.streamed);
+	fprintf(file, "textures_failed %u\n", streamStats.failed);
+	fprintf(file, "texture_kb %lu\n", (unsigned long)(streamStats.bytes / 1024));
+	fprintf(file, "texture_read_ms %.4f\n", streamStats.readSeconds * 1000.0);
+	fprintf(file, "texture_upload_ms %.4f\n", streamStats.uploadSeconds * 1000.0);
+	fprintf(file, "texture_latency_ms %.4f\n", streamStats.longestLatency * 1000.0);
+	fclose(file);
+
+	printf("%u frames, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, written to %s\n", (unsigned int)frameMs.size(),
+		mean, percentile(frameMs, 0.50), percentile(frameMs, 0.99), frameStatsPath);
+	return true;
+}
+
+// Renders the scripted session as fast as possible, timing each frame from start to glFinish
+int runHeadless(void) {
+	if (!createOffscreenTarget())
+		return -1;
+	if (!captureFrames.empty())
+		initFrameCapture(window_width, window_height);
+
+	int totalFrames = headlessWarmupFrames + headlessFrames;
+	std::vector<double> frameMs;
+	for (int frame = 0; frame < totalFrames; frame++) {
+		double start = glfwGetTime();
+		beginProfilerFrame();
+
+		captureImagePath.clear();
+		if (std::find(captureFrames.begin(), captureFrames.end(), frame) != captureFrames.end()) {
+			std::ostringstream path;
+			path << captureDirectory << "/frame_" << std::setfill('0') << std::setw(4) << frame << ".png";
+			captureImagePath = path.str();
+		}
+
+		updateTextureStream(textureUploadBudget);
+		animateScripted(frame);
+		updateProjectile(scriptedDeltaTime);
+		updateArmMotion(scriptedDeltaTime);
+		updateScene();
+		{
+			PROFILE_GPU_SCOPE("renderScene");
+			renderScene();
+		}
+		updateFrameCapture();
+
+		endProfilerFrame();
+		if (frame >= headlessWarmupFrames) frameMs.push_back((glfwGetTime() - start) * 1000.0);
+	}
+
+	for (int frame : captureFrames) {
+		if (frame < 0 || frame >= totalFrames) fprintf(stderr, "Frame %d is not part of the script, not captured\n", frame);
+	}
+	updateFrameCapture(true);
+	if (frameCaptureErrors() > 0)
+		return -1;
+	// However few the frames, every streamed texture must make it to the GPU
+	double streamDeadline = glfwGetTime() + 5.0;
+	while (!isTextureStreamIdle() && glfwGetTime() < streamDeadline) updateTextureStream(textureUploadBudget);
+	if (!isTextureStreamIdle() || getTextureStreamStats().failed > 0) {
+		fprintf(stderr, "Texture streaming did not complete\n");
+		return -1;
+	}
+	return writeFrameStats(frameMs) ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) headless = true;
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) headlessFrames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) frameStatsPath = argv[++i];
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			std::istringstream list(argv[++i]);
+			std::string frame;
+			while (std::getline(list, frame, ',')) captureFrames.push_back(atoi(frame.c_str()));
+		}
+		else if (strcmp(argv[i], "--capture-dir") == 0 && i + 1 < argc) captureDirectory = argv[++i];
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) sceneFile = argv[++i];
+		else if (strcmp(argv[i], "--no-multidraw") == 0) useMultiDraw = false;
+		else if (strcmp(argv[i], "--no-lod") == 0) useLods = false;
+		else if (strcmp(argv[i], "--no-collision") == 0) checkCollisions = false;
+		else if (strcmp(argv[i], "--rigid") == 0) rigidTransforms = true;
+		else if (strcmp(argv[i], "--mesh-budget") == 0 && i + 1 < argc) meshBudgetBytes = (size_t)atoi(argv[++i]) * 1024 * 1024;
+		else {
+			printf("Usage : %s [--scene file.json] [--mesh-budget MB] [--no-multidraw] [--no-lod] [--no-collision] [--rigid] [--headless [--frames N] [--stats file] [--capture f1,f2,... [--capture-dir dir]]]\n", argv[0]);
+			return 1;
+		}
+	}
+
 	// Refer to https://learnopengl.com/Getting-started/Transformations, https://learnopengl.com/Getting-started/Coordinate-Systems,
 	// and https://learnopengl.com/Getting-started/Camera to familiarize yourself with implementing the camera movement
 
@@ -845,13 +1622,25 @@ int main(void) {
 		return errorCode;
 
 	// Initialize OpenGL pipeline
-	initOpenGL();
+	errorCode = initOpenGL();
+	if (errorCode != 0) {
+		glfwTerminate();
+		return errorCode;
+	}
+
+	if (headless) {
+		errorCode = runHeadless();
+		cleanup();
+		return errorCode;
+	}
 
 	// For speed computation
 	double lastTime = glfwGetTime();
 	double lastFPSUpdateTime = lastTime;
 	int nbFrames = 0;
 	do {
+		beginProfilerFrame();
+
 		// Measure speed
 		double currentTime = glfwGetTime();
 		float deltaTime = currentTime - lastTime;
@@ -859,15 +1648,26 @@ int main(void) {
 
 		nbFrames++;
 		if (currentTime - lastFPSUpdateTime >= 1.0) {
-			printf("%f ms/frame\n", 1000.0 / double(nbFrames));
+			printf("%f ms/frame, %u draw calls, %lu triangles, %u GL state calls (%u skipped)\n", 1000.0 / double(nbFrames), frameDrawCalls,
+				(unsigned long)frameTriangles, frameGLCallsIssued, frameGLCallsSkipped);
 			nbFrames = 0;
 			lastFPSUpdateTime += 1.0;
 		}
 
+		reloadChangedShaders();
+		updateTextureStream(textureUploadBudget);
+
 		updateProjectile(deltaTime);
+		updateArmMotion(deltaTime);
+		updateScene();
 
 		// DRAWING POINTS
-		renderScene();
+		{
+			PROFILE_GPU_SCOPE("renderScene");
+			renderScene();
+		}
+
+		endProfilerFrame();
 
 	} // Check if the ESC key was pressed or the window was closed
 	while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&